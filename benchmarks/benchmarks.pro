@@ -0,0 +1,8 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    environment \
+    evaluator \
+    programs \
+    qschemevalue \
+    reader
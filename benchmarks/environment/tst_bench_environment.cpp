@@ -0,0 +1,172 @@
+#include <QtTest>
+#include "qscheme.h"
+#include "qschemebenchmark.h"
+
+// The costs around evaluation rather than evaluation itself: finding names
+// through nested environments, calling lambdas from C++, and making and
+// walking lists through the public API.
+class tst_bench_Environment : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanup();
+
+    void lookup_data();
+    void lookup();
+    void apply_data();
+    void apply();
+    void buildList_data() { populateSizes(); }
+    void buildList();
+    void walkList_data() { populateSizes(); }
+    void walkList();
+    void toList_data() { populateSizes(); }
+    void toList();
+
+private:
+    void populateSizes();
+};
+
+Q_DECLARE_METATYPE(QSchemeEnvironment::Evaluator)
+
+static const int LookupCount = 1000;
+
+void tst_bench_Environment::cleanup()
+{
+    QSchemeEnvironment::setEvaluator(QSchemeEnvironment::Evaluator::Bytecode);
+}
+
+void tst_bench_Environment::lookup_data()
+{
+    QTest::addColumn<int>("depth");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("10") << 10;
+    QTest::newRow("100") << 100;
+}
+
+// A name defined in the outermost of depth environments, looked up from the
+// innermost.
+void tst_bench_Environment::lookup()
+{
+    QFETCH(int, depth);
+
+    QSchemeEnvironment outermost;
+    const QSchemeValue name(QSchemeSymbolLiteral("answer"));
+    outermost.set(name, QSchemeValue(42));
+
+    QSchemeEnvironment innermost = outermost;
+    for (int i = 1; i < depth; ++i)
+        innermost = innermost.makeInner();
+
+    QSchemeValue result;
+
+    QBENCHMARK {
+        for (int i = 0; i < LookupCount; ++i)
+            result = innermost.get(name);
+    }
+
+    QCOMPARE(result, QSchemeValue(42));
+}
+
+void tst_bench_Environment::apply_data()
+{
+    QTest::addColumn<QSchemeEnvironment::Evaluator>("evaluator");
+    QTest::addColumn<QString>("lambda");
+
+    QTest::newRow("tree identity") << QSchemeEnvironment::Evaluator::TreeWalker << QStringLiteral("(lambda (x) x)");
+    QTest::newRow("bytecode identity") << QSchemeEnvironment::Evaluator::Bytecode << QStringLiteral("(lambda (x) x)");
+    QTest::newRow("tree three arguments") << QSchemeEnvironment::Evaluator::TreeWalker
+                                          << QStringLiteral("(lambda (x y z) (+ x y z))");
+    QTest::newRow("bytecode three arguments") << QSchemeEnvironment::Evaluator::Bytecode
+                                              << QStringLiteral("(lambda (x y z) (+ x y z))");
+}
+
+// The overhead of QSchemeLambdaProcedure::apply() for a trivial body.
+void tst_bench_Environment::apply()
+{
+    QFETCH(QSchemeEnvironment::Evaluator, evaluator);
+    QFETCH(QString, lambda);
+
+    QSchemeEnvironment::setEvaluator(evaluator);
+
+    QSchemeEnvironment environment;
+    QSchemeLambdaProcedure procedure = environment.eval(environment.parse(lambda)).toLambdaProcedure();
+
+    QSchemeValueList arguments;
+    for (int i = 0; i < procedure.argnames.size(); ++i)
+        arguments.append(QSchemeValue(i + 1));
+    const QSchemeValue argumentList(arguments);
+
+    QSchemeValue result;
+
+    QBENCHMARK {
+        for (int i = 0; i < LookupCount; ++i)
+            result = procedure.apply(argumentList);
+    }
+
+    QVERIFY(result.type() == QSchemeValue::Type::Number);
+}
+
+void tst_bench_Environment::populateSizes()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("10000") << 10000;
+}
+
+static QSchemeValue makeList(int size)
+{
+    QSchemeValue list;
+    for (int i = size; i > 0; --i)
+        list = QtSchemeFunctions::cons(QSchemeValue(i), list);
+    return list;
+}
+
+void tst_bench_Environment::buildList()
+{
+    QFETCH(int, size);
+
+    QSchemeValue list;
+
+    QBENCHMARK {
+        list = makeList(size);
+    }
+
+    QCOMPARE(QtSchemeFunctions::car(list), QSchemeValue(1));
+}
+
+void tst_bench_Environment::walkList()
+{
+    QFETCH(int, size);
+
+    const QSchemeValue list = makeList(size);
+    int sum = 0;
+
+    QBENCHMARK {
+        sum = 0;
+        for (QSchemeValue it = list; QtSchemeFunctions::is_pair(it); it = QtSchemeFunctions::cdr(it))
+            sum += QtSchemeFunctions::car(it).toNumber().toInt();
+    }
+
+    QCOMPARE(sum, size * (size + 1) / 2);
+}
+
+void tst_bench_Environment::toList()
+{
+    QFETCH(int, size);
+
+    const QSchemeValue list = makeList(size);
+    QSchemeValueList items;
+
+    QBENCHMARK {
+        items = list.toList();
+    }
+
+    QCOMPARE(items.size(), size);
+}
+
+QSCHEME_BENCHMARK_MAIN(tst_bench_Environment)
+
+#include "tst_bench_environment.moc"
@@ -0,0 +1,92 @@
+#include <QtTest>
+#include "qscheme.h"
+#include "qschemebenchmark.h"
+
+// Runs the same programs on the tree walker and on the bytecode virtual
+// machine. The evaluator is picked when the lambdas are defined.
+class tst_bench_Evaluator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanup();
+
+    void loop_data() { populate(); }
+    void loop();
+    void buildList_data() { populate(); }
+    void buildList();
+    void closures_data() { populate(); }
+    void closures();
+
+private:
+    void populate();
+    QSchemeValue run(const QString &expression);
+};
+
+Q_DECLARE_METATYPE(QSchemeEnvironment::Evaluator)
+
+static const char *const definitions[] = {
+    "(define (null? L) (eq? L '()))",
+    "(define (rev L acc) (if (null? L) acc (rev (cdr L) (cons (car L) acc))))",
+    "(define (double L) (rev L L))",
+    "(define (walk L) (if (null? L) 'done (walk (cdr L))))",
+    "(define (pairs L acc) (if (null? L) acc (pairs (cdr L) (cons (cons (car L) (car L)) acc))))",
+    "(define (adder x) (lambda (y) (cons x y)))",
+    "(define (add-all L acc) (if (null? L) acc (add-all (cdr L) ((adder (car L)) acc))))",
+    "(define big (double (double (double (double (double (double (double (double (double (double"
+    "            (double (double (double (quote (1 2 3 4))))))))))))))))"
+};
+
+void tst_bench_Evaluator::populate()
+{
+    QTest::addColumn<QSchemeEnvironment::Evaluator>("evaluator");
+
+    QTest::newRow("tree") << QSchemeEnvironment::Evaluator::TreeWalker;
+    QTest::newRow("bytecode") << QSchemeEnvironment::Evaluator::Bytecode;
+}
+
+void tst_bench_Evaluator::cleanup()
+{
+    QSchemeEnvironment::setEvaluator(QSchemeEnvironment::Evaluator::Bytecode);
+}
+
+QSchemeValue tst_bench_Evaluator::run(const QString &expression)
+{
+    QFETCH(QSchemeEnvironment::Evaluator, evaluator);
+    QSchemeEnvironment::setEvaluator(evaluator);
+
+    QSchemeEnvironment environment;
+    for (const char *definition : definitions)
+        environment.eval(environment.parse(QLatin1String(definition)));
+
+    const QSchemeValue exp = environment.parse(expression);
+    QSchemeValue result;
+
+    QBENCHMARK {
+        result = environment.eval(exp);
+    }
+
+    return result;
+}
+
+void tst_bench_Evaluator::loop()
+{
+    const QSchemeValue result = run(QStringLiteral("(walk big)"));
+    QCOMPARE(result, QSchemeValue(QSchemeSymbolLiteral("done")));
+}
+
+void tst_bench_Evaluator::buildList()
+{
+    const QSchemeValue result = run(QStringLiteral("(walk (pairs big '()))"));
+    QCOMPARE(result, QSchemeValue(QSchemeSymbolLiteral("done")));
+}
+
+void tst_bench_Evaluator::closures()
+{
+    const QSchemeValue result = run(QStringLiteral("(walk (add-all big '()))"));
+    QCOMPARE(result, QSchemeValue(QSchemeSymbolLiteral("done")));
+}
+
+QSCHEME_BENCHMARK_MAIN(tst_bench_Evaluator)
+
+#include "tst_bench_evaluator.moc"
@@ -0,0 +1,129 @@
+#include <QtTest>
+#include "qscheme.h"
+#include "qschemebenchmark.h"
+
+// Classic small programs, on both evaluators. They need nothing but the
+// builtins, the prelude is not loaded.
+class tst_bench_Programs : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanup();
+
+    void fib_data() { populate(); }
+    void fib();
+    void tak_data() { populate(); }
+    void tak();
+    void nqueens_data() { populate(); }
+    void nqueens();
+    void mergeSort_data() { populate(); }
+    void mergeSort();
+    void nativeSort_data() { populate(); }
+    void nativeSort();
+
+private:
+    void populate();
+    QSchemeValue run(const QString &expression);
+};
+
+Q_DECLARE_METATYPE(QSchemeEnvironment::Evaluator)
+
+static const char *const definitions[] = {
+    "(define (null? L) (eq? L '()))",
+
+    "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))",
+
+    "(define (tak x y z) (if (< y x) (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y)) z))",
+
+    "(define (safe? row distance placed)"
+    "  (if (null? placed) #t"
+    "      (if (= (car placed) row) #f"
+    "          (if (= (car placed) (+ row distance)) #f"
+    "              (if (= (car placed) (- row distance)) #f"
+    "                  (safe? row (+ distance 1) (cdr placed)))))))",
+    "(define (try-rows row n placed)"
+    "  (if (> row n) 0"
+    "      (+ (if (safe? row 1 placed) (queens n (cons row placed)) 0)"
+    "         (try-rows (+ row 1) n placed))))",
+    "(define (queens n placed) (if (= (length placed) n) 1 (try-rows 1 n placed)))",
+
+    "(define (random-list n seed acc)"
+    "  (if (= n 0) acc (random-list (- n 1) (remainder (+ (* seed 75) 74) 65537) (cons seed acc))))",
+    "(define numbers (random-list 1000 42 '()))",
+    "(define (merge a b)"
+    "  (if (null? a) b"
+    "      (if (null? b) a"
+    "          (if (< (car b) (car a))"
+    "              (cons (car b) (merge a (cdr b)))"
+    "              (cons (car a) (merge (cdr a) b))))))",
+    "(define (split L a b) (if (null? L) (cons a b) (split (cdr L) (cons (car L) b) a)))",
+    "(define (merge-sort L)"
+    "  (if (null? L) L"
+    "      (if (null? (cdr L)) L"
+    "          ((lambda (halves) (merge (merge-sort (car halves)) (merge-sort (cdr halves))))"
+    "           (split L '() '())))))",
+    "(define (cadr L) (car (cdr L)))",
+    "(define (sorted? L) (if (null? (cdr L)) #t (if (< (cadr L) (car L)) #f (sorted? (cdr L)))))"
+};
+
+void tst_bench_Programs::populate()
+{
+    QTest::addColumn<QSchemeEnvironment::Evaluator>("evaluator");
+
+    QTest::newRow("tree") << QSchemeEnvironment::Evaluator::TreeWalker;
+    QTest::newRow("bytecode") << QSchemeEnvironment::Evaluator::Bytecode;
+}
+
+void tst_bench_Programs::cleanup()
+{
+    QSchemeEnvironment::setEvaluator(QSchemeEnvironment::Evaluator::Bytecode);
+}
+
+QSchemeValue tst_bench_Programs::run(const QString &expression)
+{
+    QFETCH(QSchemeEnvironment::Evaluator, evaluator);
+    QSchemeEnvironment::setEvaluator(evaluator);
+
+    QSchemeEnvironment environment;
+    for (const char *definition : definitions)
+        environment.eval(environment.parse(QLatin1String(definition)));
+
+    const QSchemeValue exp = environment.parse(expression);
+    QSchemeValue result;
+
+    QBENCHMARK {
+        result = environment.eval(exp);
+    }
+
+    return result;
+}
+
+void tst_bench_Programs::fib()
+{
+    QCOMPARE(run(QStringLiteral("(fib 20)")), QSchemeValue(6765));
+}
+
+void tst_bench_Programs::tak()
+{
+    QCOMPARE(run(QStringLiteral("(tak 18 12 6)")), QSchemeValue(7));
+}
+
+void tst_bench_Programs::nqueens()
+{
+    QCOMPARE(run(QStringLiteral("(queens 8 '())")), QSchemeValue(92));
+}
+
+void tst_bench_Programs::mergeSort()
+{
+    QCOMPARE(run(QStringLiteral("(sorted? (merge-sort numbers))")), QSchemeValue(true));
+}
+
+void tst_bench_Programs::nativeSort()
+{
+    QCOMPARE(run(QStringLiteral("(sorted? (sort numbers <))")), QSchemeValue(true));
+}
+
+QSCHEME_BENCHMARK_MAIN(tst_bench_Programs)
+
+#include "tst_bench_programs.moc"
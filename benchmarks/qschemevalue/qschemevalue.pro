@@ -0,0 +1,9 @@
+TARGET = tst_bench_qschemevalue
+CONFIG += c++14 testcase
+QT = core testlib
+
+include(../../qscheme.pri)
+include(../shared/shared.pri)
+
+SOURCES += \
+    tst_bench_qschemevalue.cpp
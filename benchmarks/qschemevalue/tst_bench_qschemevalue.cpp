@@ -0,0 +1,105 @@
+#include <QtTest>
+#include "qscheme.h"
+#include "qschemebenchmark.h"
+
+// Only uses the public QSchemeValue API, so the same benchmark can be built
+// against older value cores to compare them.
+class tst_bench_QSchemeValue : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void type_data() { populate(); }
+    void type();
+    void copy_data() { populate(); }
+    void copy();
+    void equals_data() { populate(); }
+    void equals();
+
+private:
+    void populate();
+};
+
+static const int ValueCount = 1000;
+
+static QSchemeValue makeValue(const QByteArray &kind)
+{
+    if (kind == "fixnum")
+        return QSchemeValue(42);
+    if (kind == "flonum")
+        return QSchemeValue(3.25);
+    if (kind == "symbol")
+        return QSchemeSymbolLiteral("lambda");
+    if (kind == "string")
+        return QStringLiteral("src/qscheme.cpp");
+    if (kind == "list")
+        return QtSchemeFunctions::list(QSchemeValue(1), QSchemeValue(2), QSchemeValue(3));
+    return QSchemeValue();
+}
+
+void tst_bench_QSchemeValue::populate()
+{
+    QTest::addColumn<QByteArray>("kind");
+
+    QTest::newRow("fixnum") << QByteArray("fixnum");
+    QTest::newRow("flonum") << QByteArray("flonum");
+    QTest::newRow("symbol") << QByteArray("symbol");
+    QTest::newRow("string") << QByteArray("string");
+    QTest::newRow("list") << QByteArray("list");
+    QTest::newRow("nil") << QByteArray("nil");
+}
+
+void tst_bench_QSchemeValue::type()
+{
+    QFETCH(QByteArray, kind);
+
+    const QSchemeValueList values(ValueCount, makeValue(kind));
+    int sum = 0;
+
+    QBENCHMARK {
+        for (const QSchemeValue &value : values)
+            sum += int(value.type());
+    }
+
+    QVERIFY(sum >= 0);
+}
+
+void tst_bench_QSchemeValue::copy()
+{
+    QFETCH(QByteArray, kind);
+
+    const QSchemeValueList values(ValueCount, makeValue(kind));
+    QSchemeValueList copies(ValueCount);
+
+    QBENCHMARK {
+        for (int i = 0; i < ValueCount; ++i)
+            copies[i] = values[i];
+    }
+
+    QVERIFY(copies.last() == values.last());
+}
+
+void tst_bench_QSchemeValue::equals()
+{
+    QFETCH(QByteArray, kind);
+
+    // separately constructed values, so heap objects are not shared
+    QSchemeValueList lhs, rhs;
+    for (int i = 0; i < ValueCount; ++i) {
+        lhs.append(makeValue(kind));
+        rhs.append(makeValue(kind));
+    }
+
+    int matches = 0;
+
+    QBENCHMARK {
+        for (int i = 0; i < ValueCount; ++i)
+            matches += lhs[i] == rhs[i];
+    }
+
+    QVERIFY(matches > 0);
+}
+
+QSCHEME_BENCHMARK_MAIN(tst_bench_QSchemeValue)
+
+#include "tst_bench_qschemevalue.moc"
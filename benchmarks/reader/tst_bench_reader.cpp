@@ -0,0 +1,142 @@
+#include <QtTest>
+#include "qscheme.h"
+#include "qschemebenchmark.h"
+
+// Reading generated programs of growing size, and printing values back.
+class tst_bench_Reader : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void tokenize_data() { populateSizes(); }
+    void tokenize();
+    void readFromTokens_data() { populateSizes(); }
+    void readFromTokens();
+    void parse_data() { populateSizes(); }
+    void parse();
+    void print_data();
+    void print();
+
+private:
+    void populateSizes();
+};
+
+// A single list of count definitions with a bit of every kind of token.
+static QString program(int count)
+{
+    QString text = QStringLiteral("(");
+    for (int i = 0; i < count; ++i) {
+        text += QStringLiteral("(define (f%1 x) (if (< x %1) \"string %1\" (+ x 1.5 (quote symbol%1))))\n")
+                .arg(i);
+    }
+    text += QLatin1Char(')');
+    return text;
+}
+
+void tst_bench_Reader::populateSizes()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("10000") << 10000;
+}
+
+void tst_bench_Reader::tokenize()
+{
+    QFETCH(int, count);
+
+    const QSchemeEnvironment environment;
+    const QString text = program(count);
+    QStringList tokens;
+
+    QBENCHMARK {
+        tokens = environment.tokenize(text);
+    }
+
+    QCOMPARE(tokens.first(), QStringLiteral("("));
+}
+
+// Includes copying the token list, readFromTokens() consumes it.
+void tst_bench_Reader::readFromTokens()
+{
+    QFETCH(int, count);
+
+    const QSchemeEnvironment environment;
+    const QStringList tokens = environment.tokenize(program(count));
+    QSchemeValue result;
+
+    QBENCHMARK {
+        QStringList remaining = tokens;
+        result = environment.readFromTokens(remaining);
+    }
+
+    QCOMPARE(result.toList().size(), count);
+}
+
+void tst_bench_Reader::parse()
+{
+    QFETCH(int, count);
+
+    const QSchemeEnvironment environment;
+    const QString text = program(count);
+    QSchemeValue result;
+
+    QBENCHMARK {
+        result = environment.parse(text);
+    }
+
+    QCOMPARE(result.toList().size(), count);
+}
+
+void tst_bench_Reader::print_data()
+{
+    QTest::addColumn<QString>("shape");
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("nested 100") << QStringLiteral("nested") << 100;
+    QTest::newRow("nested 1000") << QStringLiteral("nested") << 1000;
+    QTest::newRow("flat 10000") << QStringLiteral("flat") << 10000;
+    QTest::newRow("tree 12") << QStringLiteral("tree") << 12;
+}
+
+static QSchemeValue makeTree(const QString &shape, int size)
+{
+    using namespace QtSchemeFunctions;
+
+    QSchemeValue value;
+    if (shape == QLatin1String("nested")) {
+        // (1 (2 (3 ...)))
+        for (int i = size; i > 0; --i)
+            value = list(QSchemeValue(i), value);
+    } else if (shape == QLatin1String("flat")) {
+        for (int i = size; i > 0; --i)
+            value = cons(QStringLiteral("item"), value);
+    } else {
+        // a balanced binary tree of depth size
+        value = QSchemeSymbolLiteral("leaf");
+        for (int i = 0; i < size; ++i)
+            value = list(value, QSchemeValue(1.5), value);
+    }
+
+    return value;
+}
+
+void tst_bench_Reader::print()
+{
+    QFETCH(QString, shape);
+    QFETCH(int, size);
+
+    const QSchemeValue value = makeTree(shape, size);
+    QString text;
+
+    QBENCHMARK {
+        text = value.toPrintableString();
+    }
+
+    QVERIFY(text.startsWith(QLatin1Char('(')));
+}
+
+QSCHEME_BENCHMARK_MAIN(tst_bench_Reader)
+
+#include "tst_bench_reader.moc"
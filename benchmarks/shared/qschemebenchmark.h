@@ -0,0 +1,81 @@
+#ifndef QSCHEMEBENCHMARK_H
+#define QSCHEMEBENCHMARK_H
+
+#include <QtTest>
+
+// Runs the benchmarks like QTEST_MAIN does. Given -json <file>, the results
+// are also written to file as an array of
+//
+//   { "benchmark", "function", "tag", "metric", "value", "iterations" }
+//
+// objects, value being per iteration, so they can be compared across
+// releases. They are taken from the XML log of the run.
+inline int qSchemeBenchmarkMain(QObject *benchmark, QStringList arguments)
+{
+    const int jsonIndex = arguments.indexOf(QStringLiteral("-json"));
+    if (jsonIndex < 0 || jsonIndex + 1 >= arguments.size())
+        return QTest::qExec(benchmark, arguments);
+
+    const QString jsonPath = arguments.at(jsonIndex + 1);
+    arguments.erase(arguments.begin() + jsonIndex, arguments.begin() + jsonIndex + 2);
+
+    QTemporaryFile log;
+    if (!log.open()) {
+        qWarning("Could not create a log file: %s", qPrintable(log.errorString()));
+        return 1;
+    }
+
+    // keep the usual output on the console too
+    if (!arguments.contains(QStringLiteral("-o")))
+        arguments << QStringLiteral("-o") << QStringLiteral("-,txt");
+    arguments << QStringLiteral("-o") << log.fileName() + QStringLiteral(",xml");
+
+    const int failures = QTest::qExec(benchmark, arguments);
+
+    QFile output(log.fileName());
+    if (!output.open(QIODevice::ReadOnly)) {
+        qWarning("Could not read %s: %s", qPrintable(output.fileName()), qPrintable(output.errorString()));
+        return 1;
+    }
+
+    QJsonArray results;
+    QXmlStreamReader xml(&output);
+    QString function;
+
+    while (!xml.atEnd()) {
+        if (xml.readNext() != QXmlStreamReader::StartElement)
+            continue;
+
+        const QXmlStreamAttributes attributes = xml.attributes();
+        if (xml.name() == QLatin1String("TestFunction")) {
+            function = attributes.value(QLatin1String("name")).toString();
+        } else if (xml.name() == QLatin1String("BenchmarkResult")) {
+            results.append(QJsonObject {
+                { QStringLiteral("benchmark"), QString::fromLatin1(benchmark->metaObject()->className()) },
+                { QStringLiteral("function"), function },
+                { QStringLiteral("tag"), attributes.value(QLatin1String("tag")).toString() },
+                { QStringLiteral("metric"), attributes.value(QLatin1String("metric")).toString() },
+                { QStringLiteral("value"), attributes.value(QLatin1String("value")).toDouble() },
+                { QStringLiteral("iterations"), attributes.value(QLatin1String("iterations")).toInt() }
+            });
+        }
+    }
+
+    QSaveFile json(jsonPath);
+    if (!json.open(QIODevice::WriteOnly) || json.write(QJsonDocument(results).toJson()) < 0 || !json.commit()) {
+        qWarning("Could not write %s: %s", qPrintable(jsonPath), qPrintable(json.errorString()));
+        return 1;
+    }
+
+    return failures;
+}
+
+#define QSCHEME_BENCHMARK_MAIN(Benchmark) \
+int main(int argc, char **argv) \
+{ \
+    QCoreApplication application(argc, argv); \
+    Benchmark benchmark; \
+    return qSchemeBenchmarkMain(&benchmark, application.arguments()); \
+}
+
+#endif // QSCHEMEBENCHMARK_H
@@ -0,0 +1,4 @@
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/qschemebenchmark.h
@@ -1,14 +1,25 @@
 #include <QtCore>
+#include <cstdio>
 #include "qscheme.h"
 
+// Where print writes in batch mode: standard output, buffered and flushed
+// before exiting.
+static QFile *batchOutput = nullptr;
+
 static QSchemeValue print(const QSchemeValue &invocation)
 {
     using namespace QtSchemeFunctions;
 
-    for (const auto &arg : invocation.toList())
-        qDebug() << arg;
+    for (const auto &arg : invocation.toList()) {
+        if (batchOutput) {
+            arg.writePrintableString(batchOutput);
+            batchOutput->putChar('\n');
+        } else {
+            qDebug() << arg;
+        }
+    }
 
-    return QSchemeSymbolLiteral("#t");
+    return QSchemeValue(true);
 }
 
 static QSchemeValue string_split(const QSchemeValue &invocation)
@@ -59,6 +70,7 @@ static QSchemeValue exec_system(const QSchemeValue &invocation)
 
     process.start();
     process.waitForFinished(-1);
+    QSchemeEnvironment::invalidateFileCache();
 
     const QByteArray out = process.readAllStandardOutput();
     const QByteArray err = process.readAllStandardError();
@@ -68,18 +80,180 @@ static QSchemeValue exec_system(const QSchemeValue &invocation)
                 QString::fromLocal8Bit(err));
 }
 
+// Identifies the image of the environment made by loading path. Lambdas in
+// it are compiled only when made for the bytecode evaluator, and named only
+// when made while profiling. The build of the interpreter is part of the
+// key, another build may lay out the analyzed code the image holds
+// differently.
+static QByteArray imageKey(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&file);
+
+    const QFileInfo executable(QCoreApplication::applicationFilePath());
+    hash.addData(QByteArray::number(executable.size()));
+    hash.addData(QByteArray::number(executable.lastModified().toMSecsSinceEpoch()));
+    hash.addData(QByteArrayLiteral(QT_VERSION_STR));
+
+    const char evaluator = char(QSchemeEnvironment::evaluator());
+    hash.addData(&evaluator, 1);
+
+    const char profiling = QSchemeEnvironment::isProfilingEnabled();
+    hash.addData(&profiling, 1);
+
+    return hash.result();
+}
+
 int main(int argc, char **argv)
 {
     QCoreApplication application(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+
+    const QCommandLineOption evaluatorOption(QStringLiteral("evaluator"),
+                                             QStringLiteral("How lambdas are run: bytecode or tree."),
+                                             QStringLiteral("evaluator"),
+                                             QStringLiteral("bytecode"));
+    parser.addOption(evaluatorOption);
+
+    const QCommandLineOption noCacheOption(QStringLiteral("no-cache"),
+                                           QStringLiteral("Always parse scripts, do not use the script cache or the prelude image."));
+    parser.addOption(noCacheOption);
+
+    const QCommandLineOption jobsOption(QStringList() << QStringLiteral("j") << QStringLiteral("jobs"),
+                                        QStringLiteral("Run at most <jobs> processes at once, the number of cores by default."),
+                                        QStringLiteral("jobs"));
+    parser.addOption(jobsOption);
+
+    const QCommandLineOption profileOption(QStringLiteral("profile"),
+                                           QStringLiteral("Print the time spent in each procedure when done."));
+    parser.addOption(profileOption);
+
+    const QCommandLineOption profileStacksOption(QStringLiteral("profile-stacks"),
+                                                 QStringLiteral("Write the time of every call stack to <file>, for flame graph tools."),
+                                                 QStringLiteral("file"));
+    parser.addOption(profileStacksOption);
+
+    const QCommandLineOption statsOption(QStringLiteral("stats"),
+                                         QStringLiteral("Print how much work the interpreter did when done."));
+    parser.addOption(statsOption);
+
+    const QCommandLineOption batchOption(QStringLiteral("batch"),
+                                         QStringLiteral("Run the scripts without showing each expression and its value, "
+                                                        "print writes to standard output."));
+    parser.addOption(batchOption);
+
+    parser.addPositionalArgument(QStringLiteral("scripts"),
+                                 QStringLiteral("The scripts to run in order, the built in tests by default."),
+                                 QStringLiteral("[scripts...]"));
+    parser.process(application);
+
+    const QString evaluator = parser.value(evaluatorOption);
+    if (evaluator == QLatin1String("tree")) {
+        QSchemeEnvironment::setEvaluator(QSchemeEnvironment::Evaluator::TreeWalker);
+    } else if (evaluator != QLatin1String("bytecode")) {
+        qWarning("Unknown evaluator: %s", qPrintable(evaluator));
+        return 1;
+    }
+
+    if (parser.isSet(jobsOption)) {
+        bool ok;
+        const int jobs = parser.value(jobsOption).toInt(&ok);
+        if (!ok || jobs < 1) {
+            qWarning("Invalid number of jobs: %s", qPrintable(parser.value(jobsOption)));
+            return 1;
+        }
+        QSchemeEnvironment::setMaximumProcessCount(jobs);
+    }
+
+    QSchemeEnvironment::setProfilingEnabled(parser.isSet(profileOption) || parser.isSet(profileStacksOption));
+
+    QString cacheLocation;
+    if (!parser.isSet(noCacheOption)) {
+        cacheLocation = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        if (!cacheLocation.isEmpty())
+            QSchemeEnvironment::setScriptCacheDirectory(cacheLocation + QLatin1String("/scripts"));
+    }
+
+    const bool batch = parser.isSet(batchOption);
+    QSchemeEnvironment::setEchoEnabled(!batch);
+
+    QFile output;
+    if (batch) {
+        output.open(stdout, QIODevice::WriteOnly);
+        batchOutput = &output;
+    }
+
     QSchemeEnvironment environment;
 
     environment.set(QSchemeSymbolLiteral("system-exec"), exec_system);
     environment.set(QSchemeSymbolLiteral("string-split"), string_split);
     environment.set(QSchemeSymbolLiteral("print"), print);
 
-    environment.load(QStringLiteral(":/system.scm"));
-    environment.load(QStringLiteral(":/tests.scm"));
+    const QString prelude = QStringLiteral(":/system.scm");
+    const QString image = cacheLocation.isEmpty() ? QString() : cacheLocation + QLatin1String("/system.img");
+    const QByteArray key = imageKey(prelude);
+
+    QStringList scripts = parser.positionalArguments();
+    if (scripts.isEmpty())
+        scripts << QStringLiteral(":/tests.scm");
+
+    int status = 0;
+    QString script = prelude;
+
+    try {
+        if (image.isEmpty() || !environment.restoreImage(image, key)) {
+            environment.load(prelude);
+            if (!image.isEmpty())
+                environment.saveImage(image, key);
+        }
+
+        for (const QString &path : qAsConst(scripts)) {
+            script = path;
+            if (!environment.load(path)) {
+                status = 1;
+                break;
+            }
+        }
+    } catch (const QSchemeException &exception) {
+        fprintf(stderr, "%s: %s\n", qPrintable(script), exception.what());
+        status = 1;
+    }
+
+    if (batch)
+        output.flush();
+
+    if (parser.isSet(profileOption))
+        fputs(qPrintable(QSchemeEnvironment::profileReport()), stderr);
+
+    if (parser.isSet(statsOption)) {
+#ifndef QT_SCHEME_STATISTICS
+        fputs("Built without QT_SCHEME_STATISTICS, nothing was counted.\n", stderr);
+#endif
+        const QSchemeStatistics stats = QSchemeEnvironment::statistics();
+        fprintf(stderr, "%-18s %14llu\n", "value copies", stats.valueCopies);
+        fprintf(stderr, "%-18s %14llu\n", "allocations", stats.allocations);
+        fprintf(stderr, "%-18s %14llu\n", "pairs", stats.pairs);
+        fprintf(stderr, "%-18s %14llu\n", "list conversions", stats.listConversions);
+        fprintf(stderr, "%-18s %14llu\n", "frames", stats.frames);
+        fprintf(stderr, "%-18s %14llu\n", "symbol lookups", stats.symbolLookups);
+        fprintf(stderr, "%-18s %14llu\n", "symbol probes", stats.symbolProbes);
+        fprintf(stderr, "%-18s %14llu\n", "exceptions", stats.exceptions);
+    }
+
+    if (parser.isSet(profileStacksOption)) {
+        QFile stacks(parser.value(profileStacksOption));
+        if (!stacks.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            qWarning("Could not write %s: %s", qPrintable(stacks.fileName()), qPrintable(stacks.errorString()));
+            return 1;
+        }
+        stacks.write(QSchemeEnvironment::profileStacks().toUtf8());
+    }
 
-    return 0;
+    return status;
 }
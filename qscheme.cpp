@@ -1,8 +1,97 @@
 #include <QtCore/private/qobject_p.h>
-#include "qscheme.h"
+#include "qscheme_p.h"
+#include "qschemecache_p.h"
+#include "qschemefiles_p.h"
+#include "qschemeimage_p.h"
+#include "qschemenumber_p.h"
+#include "qschemeprinter_p.h"
+#include "qschemeprocess_p.h"
+#include "qschemeprofiler_p.h"
+#include "qschemereader_p.h"
+#include "qschemestatistics_p.h"
+#include "qschemevm_p.h"
 
 QT_BEGIN_NAMESPACE
 
+class QSchemeSymbolTable
+{
+public:
+    QSchemeSymbolTable()
+    {
+        // id 0 is the default constructed, empty symbol
+        names.append(QString());
+        next.append(-1);
+        heads.insert(qHash(QStringView()), 0);
+    }
+
+    // Looking up a name that is already interned does not allocate, which
+    // keeps the reader from copying every symbol token it sees.
+    int intern(QStringView name)
+    {
+        const uint hash = qHash(name);
+
+        {
+            QReadLocker locker(&lock);
+            const int id = find(name, hash);
+            if (id >= 0)
+                return id;
+        }
+
+        QWriteLocker locker(&lock);
+        int id = find(name, hash);
+        if (id >= 0)
+            return id;
+
+        id = names.size();
+        names.append(name.toString());
+        next.append(heads.value(hash, -1));
+        heads.insert(hash, id);
+        return id;
+    }
+
+    QString name(int id) const
+    {
+        QReadLocker locker(&lock);
+        return names.at(id);
+    }
+
+private:
+    int find(QStringView name, uint hash) const
+    {
+        for (int id = heads.value(hash, -1); id >= 0; id = next.at(id)) {
+            if (names.at(id) == name)
+                return id;
+        }
+
+        return -1;
+    }
+
+    mutable QReadWriteLock lock;
+    // names with the same hash are chained through next
+    QHash<uint, int> heads;
+    QVector<int> next;
+    QVector<QString> names;
+};
+
+Q_GLOBAL_STATIC(QSchemeSymbolTable, symbolTable)
+
+QSchemeSymbol::QSchemeSymbol(const QLatin1String &string)
+    : m_id(symbolTable()->intern(QString(string)))
+{}
+
+QSchemeSymbol::QSchemeSymbol(const QString &string)
+    : m_id(symbolTable()->intern(string))
+{}
+
+QSchemeSymbol::QSchemeSymbol(QStringView string)
+    : m_id(symbolTable()->intern(string))
+{}
+
+QString QSchemeSymbol::toString() const
+{
+    return symbolTable()->name(m_id);
+}
+
 namespace QtSchemeFunctions {
 
 QSchemeValue analyze_define(const QSchemeValue &val)
@@ -20,7 +109,10 @@ QSchemeValue analyze_define(const QSchemeValue &val)
 
 bool is_false(const QSchemeValue &val)
 {
-    return is_list(val) && val.toList().isEmpty();
+    if (val.type() == QSchemeValue::Type::Boolean)
+        return !val.toBool();
+
+    return is_null(val);
 }
 
 bool is_symbol(const QSchemeValue &val)
@@ -43,6 +135,11 @@ bool is_list(const QSchemeValue &val)
     return val.type() == QSchemeValue::Type::Cons;
 }
 
+bool is_pair(const QSchemeValue &val)
+{
+    return QSchemeValuePrivate::isPair(val);
+}
+
 bool is_native_procedure(const QSchemeValue &val)
 {
     return val.type() == QSchemeValue::Type::LambdaProcedure;
@@ -55,132 +152,202 @@ bool is_foreign_procedure(const QSchemeValue &val)
 
 QSchemeValue car(const QSchemeValue &val)
 {
-    if (is_list(val) && val.toList().size() > 0)
-        return val.toList().first();
+    if (QSchemeValuePrivate::isPair(val))
+        return QSchemeValuePrivate::pair(val)->car;
     else
-        throw QSchemeException("car: invalid argument type");
+        throw qt_scheme_error("car", "invalid argument type");
 }
 
 QSchemeValue cdr(const QSchemeValue &val)
 {
-    if (is_list(val) && val.toList().size() > 0)
-        return val.toList().mid(1);
+    if (QSchemeValuePrivate::isPair(val))
+        return QSchemeValuePrivate::pair(val)->cdr;
     else
-        throw QSchemeException("cdr: invalid argument type");
+        throw qt_scheme_error("cdr", "invalid argument type");
 }
 
 QSchemeValue cons(const QSchemeValue &a, const QSchemeValue &b)
 {
-    if (is_null(b))
-        return list(a);
-
-    if (is_list(b)) {
-        QSchemeValueList result = b.toList();
-        result.prepend(a);
-        return result;
-    }
-
-    return list(a, b);
+    QSchemePairObject *pair = QSchemeValuePrivate::allocate<QSchemePairObject>(QSchemeValue::Type::Cons);
+    QT_SCHEME_COUNT(pairs);
+    pair->car = a;
+    pair->cdr = b;
+    return QSchemeValuePrivate::adopt(pair);
 }
 
 bool is_null(const QSchemeValue &val)
 {
-    return is_list(val) && val.toList().isEmpty();
+    return val == QSchemeValue();
 }
 
 } // namespace QtSchemeFunctions
 
-QSchemeValue::QSchemeValue()
-    : d(QVariant::fromValue(QSchemeValueList()))
-{}
+QSchemeValue::QSchemeValue(QSchemeHeapObject *object)
+    : v((HeapObjectTag << PayloadBits) | quintptr(object))
+{
+    Q_ASSERT((quintptr(object) & ~quintptr(PayloadMask)) == 0);
+}
 
-QSchemeValue::QSchemeValue(const QSchemeValue &other)
-    : d(QVariant(other.d))
-{}
+void QSchemeValue::destroy(QSchemeHeapObject *object)
+{
+    if (object->kind == QSchemeHeap::CodeKind) {
+        QSchemeValuePrivate::free(static_cast<QSchemeCodeObject *>(object));
+        return;
+    }
 
-QSchemeValue::~QSchemeValue()
-{}
+    switch (Type(object->kind)) {
+    case Type::String:
+        QSchemeValuePrivate::free(static_cast<QSchemeStringObject *>(object));
+        break;
+    case Type::Cons: {
+        // Unlink the cdr chain iteratively, a recursive destructor would run
+        // out of stack on long lists.
+        QSchemePairObject *pair = static_cast<QSchemePairObject *>(object);
+        forever {
+            QSchemeValue next;
+            qSwap(next.v, pair->cdr.v);
+            QSchemeValuePrivate::free(pair);
+
+            if (!QSchemeValuePrivate::isPair(next) || next.heapObject()->ref.loadAcquire() != 1)
+                break;
+
+            // we hold the last reference, take it over instead of releasing
+            pair = next.object<QSchemePairObject>();
+            next.v = NilValue;
+        }
+    }
+        break;
+    case Type::LambdaProcedure:
+        QSchemeValuePrivate::free(static_cast<QSchemeLambdaObject *>(object));
+        break;
+    case Type::Symbol:
+        QSchemeValuePrivate::free(static_cast<QSchemeVariableObject *>(object));
+        break;
+    case Type::Environment:
+        QSchemeValuePrivate::free(static_cast<QSchemeEnvironmentPrivate *>(object));
+        break;
+    case Type::Vector:
+        QSchemeValuePrivate::free(static_cast<QSchemeVectorObject *>(object));
+        break;
+    case Type::Bytevector:
+        QSchemeValuePrivate::free(static_cast<QSchemeBytevectorObject *>(object));
+        break;
+    case Type::F64Vector:
+        QSchemeValuePrivate::free(static_cast<QSchemeF64VectorObject *>(object));
+        break;
+    case Type::HashTable:
+        QSchemeValuePrivate::free(static_cast<QSchemeHashTableObject *>(object));
+        break;
+    default:
+        Q_UNREACHABLE();
+    }
+}
 
 QSchemeValue::QSchemeValue(const QSchemeEnvironment &env)
-    : d(QVariant::fromValue(env))
-{}
+    : QSchemeValue(static_cast<QSchemeHeapObject *>(env.d_ptr))
+{
+    retain();
+}
 
 QSchemeValue::QSchemeValue(const QSchemeSymbol &symbol)
-    : d(QVariant::fromValue(symbol))
+    : v((SymbolTag << PayloadBits) | quint64(quint32(symbol.id())))
 {}
 
 QSchemeValue::QSchemeValue(const QString &string)
-    : d(string)
-{}
+    : QSchemeValue(QSchemeValuePrivate::allocate<QSchemeStringObject>(Type::String))
+{
+    object<QSchemeStringObject>()->string = string;
+}
 
 QSchemeValue::QSchemeValue(int i)
-    : d(i)
+    : v((FixnumTag << PayloadBits) | (quint64(qint64(i)) & PayloadMask))
 {}
 
 QSchemeValue::QSchemeValue(double d)
-    : d(d)
+{
+    if (qIsNaN(d))
+        v = Q_UINT64_C(0x7ff8000000000000);
+    else
+        memcpy(&v, &d, sizeof(v));
+}
+
+QSchemeValue::QSchemeValue(bool b)
+    : v(b ? TrueValue : FalseValue)
 {}
 
 QSchemeValue::QSchemeValue(const QSchemeValueList &list)
-    : d(QVariant::fromValue(list))
-{}
+    : v(NilValue)
+{
+    for (int i = list.size() - 1; i >= 0; --i)
+        *this = QtSchemeFunctions::cons(list.at(i), *this);
+}
 
 QSchemeValue::QSchemeValue(foreign_syntax_t syntax)
-    : d(QVariant::fromValue(syntax))
-{}
+    : v((ForeignSyntaxTag << PayloadBits) | quintptr(syntax))
+{
+    Q_ASSERT((quintptr(syntax) & ~quintptr(PayloadMask)) == 0);
+}
 
 QSchemeValue::QSchemeValue(foreign_proc_t proc)
-    : d(QVariant::fromValue(proc))
-{}
+    : v((ForeignProcedureTag << PayloadBits) | quintptr(proc))
+{
+    Q_ASSERT((quintptr(proc) & ~quintptr(PayloadMask)) == 0);
+}
 
 QSchemeValue::QSchemeValue(const QSchemeLambdaProcedure &proc_info)
-    : d(QVariant::fromValue(proc_info))
-{}
-
-QSchemeValue &QSchemeValue::operator=(const QSchemeValue &other)
+    : QSchemeValue(QSchemeValuePrivate::allocate<QSchemeLambdaObject>(Type::LambdaProcedure))
 {
-    d = other.d;
-    return *this;
+    QSchemeLambdaObject *lambda = object<QSchemeLambdaObject>();
+    lambda->argnames = proc_info.argnames;
+    lambda->slotNames = proc_info.argnames + proc_info.locals;
+    lambda->body = proc_info.body;
+    lambda->environment = QSchemeValue(proc_info.environment);
 }
 
 bool QSchemeValue::operator==(const QSchemeValue &other) const
 {
-    return d == other.d;
-}
+    if (isDouble() || other.isDouble() || (tag() == FixnumTag && other.tag() == FixnumTag)) {
+        if (type() != Type::Number || other.type() != Type::Number)
+            return false;
 
-QSchemeValue::Type QSchemeValue::type() const
-{
-    const int id = d.userType();
+        if (!isDouble() && !other.isDouble())
+            return v == other.v;
 
-    switch (id) {
-    case QVariant::String:
-        return QSchemeValue::Type::String;
+        const double a = isDouble() ? flonum() : double(fixnum());
+        const double b = other.isDouble() ? other.flonum() : double(other.fixnum());
+        return a == b;
+    }
 
-    case QVariant::Int:
-    case QVariant::UInt:
-    case QVariant::LongLong:
-    case QVariant::ULongLong:
-    case QVariant::Double:
-        return QSchemeValue::Type::Number;
+    if (v == other.v)
+        return true;
 
-    default:
-        break;
-    }
+    if (!isHeapObject() || !other.isHeapObject())
+        return false;
 
-    if (id == qMetaTypeId<QSchemeValueList>())
-        return QSchemeValue::Type::Cons;
-    else if (id == qMetaTypeId<QSchemeSymbol>())
-        return QSchemeValue::Type::Symbol;
-    else if (id == qMetaTypeId<QSchemeValue::foreign_proc_t>())
-        return QSchemeValue::Type::ForeignProcedure;
-    else if (id == qMetaTypeId<QSchemeEnvironment>())
-        return QSchemeValue::Type::Environment;
-    else if (id == qMetaTypeId<QSchemeLambdaProcedure>())
-        return QSchemeValue::Type::LambdaProcedure;
-    else if (id == qMetaTypeId<QSchemeValue::foreign_syntax_t>())
-        return QSchemeValue::Type::ForeignSyntax;
+    if (heapObject()->kind != other.heapObject()->kind)
+        return false;
 
-    Q_UNREACHABLE();
+    switch (Type(heapObject()->kind)) {
+    case Type::String:
+        return object<QSchemeStringObject>()->string == other.object<QSchemeStringObject>()->string;
+    case Type::Cons: {
+        QSchemeValue a = *this;
+        QSchemeValue b = other;
+        while (QSchemeValuePrivate::isPair(a) && QSchemeValuePrivate::isPair(b)) {
+            if (a.v == b.v)
+                return true;
+            if (!(a.object<QSchemePairObject>()->car == b.object<QSchemePairObject>()->car))
+                return false;
+            a = a.object<QSchemePairObject>()->cdr;
+            b = b.object<QSchemePairObject>()->cdr;
+        }
+        return a == b;
+    }
+    case Type::Symbol:
+        return toSymbol() == other.toSymbol();
+    default:
+        return false;
+    }
 }
 
 #define CHECK_TYPE(t) if (type() != t) throw QSchemeException("Invalid type!")
@@ -188,49 +355,77 @@ QSchemeValue::Type QSchemeValue::type() const
 QSchemeEnvironment QSchemeValue::toEnvironment() const
 {
     CHECK_TYPE(Type::Environment);
-    return d.value<QSchemeEnvironment>();
+    return QSchemeEnvironment(object<QSchemeEnvironmentPrivate>());
 }
 
 QSchemeSymbol QSchemeValue::toSymbol() const
 {
     CHECK_TYPE(Type::Symbol);
-    return d.value<QSchemeSymbol>();
+
+    if (isHeapObject())
+        return object<QSchemeVariableObject>()->name.toSymbol();
+
+    return QSchemeSymbol::fromId(int(payload()));
 }
 
 QSchemeValueList QSchemeValue::toList() const
 {
     CHECK_TYPE(Type::Cons);
-    return d.value<QSchemeValueList>();
+    QT_SCHEME_COUNT(listConversions);
+
+    QSchemeValueList result;
+    const QSchemeValue *it = this;
+    while (QSchemeValuePrivate::isPair(*it)) {
+        result.append(it->object<QSchemePairObject>()->car);
+        it = &it->object<QSchemePairObject>()->cdr;
+    }
+
+    if (it->v != NilValue)
+        throw QSchemeException("Improper list");
+
+    return result;
 }
 
 QString QSchemeValue::toString() const
 {
     CHECK_TYPE(Type::String);
-    return d.toString();
+    return object<QSchemeStringObject>()->string;
 }
 
 QVariant QSchemeValue::toNumber() const
 {
     CHECK_TYPE(Type::Number);
-    return d;
+
+    if (isDouble())
+        return QVariant(flonum());
+
+    return QVariant(qlonglong(fixnum()));
 }
 
 QSchemeValue::foreign_syntax_t QSchemeValue::toForeignSyntax() const
 {
     CHECK_TYPE(Type::ForeignSyntax);
-    return d.value<foreign_syntax_t>();
+    return reinterpret_cast<foreign_syntax_t>(quintptr(payload()));
 }
 
 QSchemeValue::foreign_proc_t QSchemeValue::toForeignProcedure() const
 {
     CHECK_TYPE(Type::ForeignProcedure);
-    return d.value<foreign_proc_t>();
+    return reinterpret_cast<foreign_proc_t>(quintptr(payload()));
 }
 
 QSchemeLambdaProcedure QSchemeValue::toLambdaProcedure() const
 {
     CHECK_TYPE(Type::LambdaProcedure);
-    return d.value<QSchemeLambdaProcedure>();
+    const QSchemeLambdaObject *lambda = object<QSchemeLambdaObject>();
+    return QSchemeLambdaProcedure{ lambda->argnames, lambda->body, lambda->environment.toEnvironment(),
+                                   lambda->slotNames.mid(lambda->argnames.size()) };
+}
+
+bool QSchemeValue::toBool() const
+{
+    CHECK_TYPE(Type::Boolean);
+    return v == TrueValue;
 }
 
 #undef CHECK_TYPE
@@ -238,77 +433,41 @@ QSchemeLambdaProcedure QSchemeValue::toLambdaProcedure() const
 QString QSchemeValue::toPrintableString() const
 {
     QString string;
+    QSchemePrinter(&string).print(*this);
+    return string;
+}
 
-    switch (type()) {
-    case QSchemeValue::Type::ForeignSyntax:
-        string = QStringLiteral("#<ForeignSyntax>");
-        break;
-
-    case QSchemeValue::Type::LambdaProcedure:
-        string = QStringLiteral("#<Lambda procedure>");
-        break;
-
-    case QSchemeValue::Type::Symbol:
-        string = toSymbol().toString();
-        break;
-
-    case QSchemeValue::Type::Cons:
-    {
-        QTextStream stream(&string);
-        QStringList parts;
-        for (const QSchemeValue &v : toList())
-            parts.push_back(v.toPrintableString());
-
-        stream << '(' << parts.join(QLatin1Char(' ')) << ')';
-    }
-        break;
-
-    case QSchemeValue::Type::String:
-        string = toString();
-        string.replace(QStringLiteral("\""), QStringLiteral("\\\""));
-        string = QLatin1Char('"') + string + QLatin1Char('"');
-        break;
-
-    case QSchemeValue::Type::Number:
-    {
-        QTextStream stream(&string);
-        stream << toNumber().toDouble();
-    }
-        break;
-
-    case QSchemeValue::Type::ForeignProcedure:
-    {
-        QTextStream stream(&string);
-        stream << QStringLiteral("#<Foreign ") << (void *) toForeignProcedure() << QStringLiteral(">");
-    }
-        break;
-
-    case QSchemeValue::Type::Environment:
-        string = QStringLiteral("#<Environment>");
-        break;
-    }
-
+QString QSchemeValue::toPrintableString(qint64 maxLength, int maxDepth) const
+{
+    QString string;
+    QSchemePrinter printer(&string);
+    printer.setMaxLength(maxLength);
+    printer.setMaxDepth(maxDepth);
+    printer.print(*this);
     return string;
 }
 
-class QSchemeEnvironmentPrivate : public QEnableSharedFromThis<QSchemeEnvironmentPrivate>
+bool QSchemeValue::writePrintableString(QIODevice *device) const
 {
-public:
-    QSharedPointer<QSchemeEnvironmentPrivate> outer;
-    QHash<QSchemeSymbol, QSchemeValue> symtab;
-};
+    QSchemePrinter printer(device);
+    printer.print(*this);
+    return printer.flush();
+}
 
 using namespace QtSchemeFunctions;
 
 static QSchemeValue make_bool(bool b)
 {
-    return b ? QSchemeSymbolLiteral("#t") : QSchemeSymbolLiteral("#f");
+    return QSchemeValue(b);
 }
 
 static QSchemeValue builtin_define(QSchemeEnvironment &env, const QSchemeValue &arguments)
 {
     QSchemeValue simplified = analyze_define(arguments);
-    return env.set(car(simplified), env.eval(cadr(simplified)));
+    const QSchemeValue value = env.eval(cadr(simplified));
+    if (Q_UNLIKELY(qt_scheme_profiling))
+        QSchemeProfiler::name(value, car(simplified));
+    return env.set(car(simplified), value);
 }
 
 static QSchemeValue builtin_if(QSchemeEnvironment &env, const QSchemeValue &arguments)
@@ -317,8 +476,8 @@ static QSchemeValue builtin_if(QSchemeEnvironment &env, const QSchemeValue &argu
     const QSchemeValue true_branch = cadr(arguments);
     const QSchemeValue false_branch = caddr(arguments);
 
-    return is_true(env.eval(predicate)) ? env.eval(true_branch)
-                                        : env.eval(false_branch);
+    return is_true(predicate) ? env.eval(true_branch)
+                              : env.eval(false_branch);
 }
 
 static QSchemeValue builtin_eval(QSchemeEnvironment &env, const QSchemeValue &arguments)
@@ -346,12 +505,28 @@ static QSchemeValue builtin_cdr(const QSchemeValue &arguments)
     return cdr(car(arguments));
 }
 
-static QSchemeValue builtin_lambda(QSchemeEnvironment &env, const QSchemeValue &arguments)
+static QSchemeValue analyze_lambda(QSchemeEnvironment &env, const QSchemeValue &arguments);
+
+// Creates the procedure for an analyzed lambda, arguments are the parameter
+// list, the list of locals and the analyzed body.
+static QSchemeValue builtin_closure(QSchemeEnvironment &env, const QSchemeValue &arguments)
 {
-    QSchemeLambdaProcedure proc = { car(arguments).toList(), cadr(arguments), env };
+    QSchemeLambdaProcedure proc = { car(arguments).toList(), caddr(arguments), env, cadr(arguments).toList() };
     return proc;
 }
 
+static QAtomicInt currentEvaluator = int(QSchemeEnvironment::Evaluator::Bytecode);
+
+static QSchemeValue builtin_lambda(QSchemeEnvironment &env, const QSchemeValue &arguments)
+{
+    const QSchemeValue analyzed = analyze_lambda(env, arguments);
+
+    if (QSchemeEnvironment::evaluator() == QSchemeEnvironment::Evaluator::Bytecode)
+        return QSchemeVirtualMachine::makeProcedure(QSchemeCompiler::compile(analyzed), QSchemeValue(env));
+
+    return builtin_closure(env, analyzed);
+}
+
 static QSchemeValue builtin_list(const QSchemeValue &arguments)
 {
     return arguments;
@@ -388,229 +563,1029 @@ static QSchemeValue builtin_callablep(const QSchemeValue &arguments)
     return make_bool(is_foreign_procedure(proc) || is_native_procedure(proc));
 }
 
-static QSchemeValue builtin_apply(QSchemeEnvironment &env, const QSchemeValue &arguments)
+static QSchemeValue builtin_collect_garbage(const QSchemeValue &)
 {
-    const QSchemeValue params = env.evalArgumentList(arguments);
-    return env.apply(car(params), cadr(params));
+    return QSchemeValue(QSchemeEnvironment::collectGarbage());
 }
 
-static const struct {
-    const char *name;
-    QSchemeValue::foreign_syntax_t proc;
-} builtin_syntax[] = {
-    { "define", builtin_define },
-    { "if", builtin_if },
-    { "eval", builtin_eval },
-    { "lambda", builtin_lambda },
-    { "apply", builtin_apply },
-    { "quote", builtin_quote }
-};
-
-static const struct {
-    const char *name;
-    QSchemeValue::foreign_proc_t proc;
-} builtin_procedures[] = {
-    { "cons", builtin_cons },
-    { "car", builtin_car },
-    { "cdr", builtin_cdr },
-    { "list", builtin_list},
-    { "eq?", builtin_eqp },
-    { "list?", builtin_listp },
-    { "string?", builtin_stringp },
-    { "number?", builtin_numberp },
-    { "symbol?", builtin_symbolp },
-    { "callable?", builtin_callablep },
-};
+static QSchemeValue builtin_add(const QSchemeValue &arguments)
+{
+    QSchemeValue sum(0);
+    for (QSchemeValue it = arguments; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        sum = QSchemeNumbers::add(sum, QSchemeValuePrivate::pair(it)->car);
+    return sum;
+}
 
-QSchemeEnvironment::QSchemeEnvironment()
-    : d_ptr(new QSchemeEnvironmentPrivate)
+static QSchemeValue builtin_multiply(const QSchemeValue &arguments)
 {
-    using namespace QtSchemeFunctions;
+    QSchemeValue product(1);
+    for (QSchemeValue it = arguments; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        product = QSchemeNumbers::multiply(product, QSchemeValuePrivate::pair(it)->car);
+    return product;
+}
 
-    for (const auto &builtin : builtin_syntax)
-        set(QSchemeSymbol(QLatin1String(builtin.name)), QSchemeValue(builtin.proc));
+// (- x) negates and (/ x) inverts x, more arguments are folded from the left
+template <QSchemeValue (*operation)(const QSchemeValue &, const QSchemeValue &)>
+static QSchemeValue foldInverse(const QSchemeValue &arguments, const char *name, int identity)
+{
+    if (!is_pair(arguments))
+        throw qt_scheme_error(name, "expected at least one argument");
 
-    for (const auto &builtin : builtin_procedures)
-        set(QSchemeSymbol(QLatin1String(builtin.name)), QSchemeValue(builtin.proc));
+    const QSchemeValue rest = cdr(arguments);
+    if (!is_pair(rest))
+        return operation(QSchemeValue(identity), car(arguments));
 
-    set(QSchemeSymbolLiteral("nil"), list());
-    set(QSchemeSymbolLiteral("#f"), list());
-    set(QSchemeSymbolLiteral("#t"), QSchemeSymbolLiteral("#t"));
+    QSchemeValue result = car(arguments);
+    for (QSchemeValue it = rest; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        result = operation(result, QSchemeValuePrivate::pair(it)->car);
+    return result;
 }
 
-QSchemeEnvironment::QSchemeEnvironment(const QSchemeEnvironment &other)
-    : d_ptr(other.d_ptr)
-{}
-
-QSchemeEnvironment::~QSchemeEnvironment()
-{}
-
-QSchemeEnvironment &QSchemeEnvironment::operator=(const QSchemeEnvironment &other)
+static QSchemeValue builtin_subtract(const QSchemeValue &arguments)
 {
-    d_ptr = other.d_ptr;
-    return *this;
+    return foldInverse<QSchemeNumbers::subtract>(arguments, "-", 0);
 }
 
-bool QSchemeEnvironment::load(const QString &localPath)
+static QSchemeValue builtin_divide(const QSchemeValue &arguments)
 {
-    QFile file(localPath);
+    return foldInverse<QSchemeNumbers::divide>(arguments, "/", 1);
+}
 
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Could not open" << localPath << "-" << file.errorString();
-        return false;
-    }
+// Comparisons hold when they hold for every pair of neighbours. All
+// arguments are checked to be numbers, even once the result is known.
+template <QSchemeNumbers::Comparison comparison>
+static QSchemeValue builtin_compare(const QSchemeValue &arguments)
+{
+    if (!is_pair(arguments))
+        throw qt_scheme_error(QSchemeNumbers::name(comparison), "expected at least one argument");
 
-    QTextStream stream(&file);
-    QStringList tokens = tokenize(stream.readAll());
+    QSchemeValue previous = car(arguments);
+    QSchemeNumbers::toDouble(previous, QSchemeNumbers::name(comparison));
 
-    while (!tokens.isEmpty()) {
-        const QSchemeValue exp = readFromTokens(tokens);
-        sendToRepl(Message::InputExpression, exp);
-        sendToRepl(Message::ResultOfExpression, eval(exp));
+    bool result = true;
+    for (QSchemeValue it = cdr(arguments); is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr) {
+        const QSchemeValue &next = QSchemeValuePrivate::pair(it)->car;
+        result = QSchemeNumbers::compare(previous, next, comparison) && result;
+        previous = next;
     }
 
-    return true;
+    return make_bool(result);
 }
 
-void QSchemeEnvironment::sendToRepl(Message m, const QSchemeValue &val)
+template <QSchemeNumbers::Division division>
+static QSchemeValue builtin_divide_integers(const QSchemeValue &arguments)
 {
-    switch (m) {
-    case Message::InputExpression:
-        qDebug() << val;
-        break;
-    case Message::ResultOfExpression:
-        qDebug() << " =>" << val << "\n";
-        break;
-    }
+    return QSchemeNumbers::divideIntegers(car(arguments), cadr(arguments), division);
 }
 
-QSchemeEnvironmentPrivate *QSchemeEnvironment::findSymbol(const QSchemeValue &symbol) const
+static QSchemeValue builtin_abs(const QSchemeValue &arguments)
 {
-    const QSchemeSymbol symname = symbol.toSymbol();
-    const QSchemeEnvironmentPrivate *d = d_func();
-
-    while (d && !d->symtab.contains(symname))
-        d = d->outer.data();
+    const QSchemeValue number = car(arguments);
+    if (QSchemeValuePrivate::isFixnum(number))
+        return QSchemeValuePrivate::integer(qAbs(QSchemeValuePrivate::fixnum(number)));
 
-    return const_cast<QSchemeEnvironmentPrivate *>(d);
+    return QSchemeValue(std::fabs(QSchemeNumbers::toDouble(number, "abs")));
 }
 
-QSchemeValue QSchemeEnvironment::set(const QSchemeValue &symbol, const QSchemeValue &value)
+template <QSchemeNumbers::Comparison comparison>
+static QSchemeValue builtin_extremum(const QSchemeValue &arguments)
 {
-    d_func()->symtab[symbol.toSymbol()] = value;
-    return value;
-}
+    const char *const name = comparison == QSchemeNumbers::Comparison::Less ? "min" : "max";
 
-QSchemeValue QSchemeEnvironment::get(const QSchemeValue &symbol) const
-{
-    QSchemeEnvironmentPrivate *envd = findSymbol(symbol);
+    QSchemeValue result = car(arguments);
+    QSchemeNumbers::toDouble(result, name);
 
-    if (Q_UNLIKELY(!envd))
-        throw QSchemeUndefinedSymbolException(symbol.toSymbol());
+    for (QSchemeValue it = cdr(arguments); is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr) {
+        const QSchemeValue &next = QSchemeValuePrivate::pair(it)->car;
+        if (QSchemeNumbers::compare(next, result, comparison))
+            result = next;
+    }
 
-    return envd->symtab[symbol.toSymbol()];
+    return result;
 }
 
-QSchemeValue QSchemeEnvironment::parse(const QString &program) const
+static QSchemeValue builtin_zerop(const QSchemeValue &arguments)
 {
-    QStringList tokens = tokenize(program);
-    return readFromTokens(tokens);
+    return make_bool(QSchemeNumbers::compare(car(arguments), QSchemeValue(0), QSchemeNumbers::Comparison::Equal));
 }
 
-namespace Tokens {
-
-static inline bool isDoubleQuote(QChar c) {
-    return c == QLatin1Char('"');
-}
+static QSchemeValue builtin_integerp(const QSchemeValue &arguments)
+{
+    const QSchemeValue value = car(arguments);
+    if (QSchemeValuePrivate::isFixnum(value))
+        return make_bool(true);
 
-static inline bool isBackslash(QChar c) {
-    return c == QLatin1Char('\\');
-}
+    if (!is_number(value))
+        return make_bool(false);
 
-static inline bool isSpecialSymbol(QChar c) {
-    return QStringLiteral("()'").contains(c);
+    // infinities truncate to themselves
+    const double d = QSchemeValuePrivate::flonum(value);
+    return make_bool(qIsFinite(d) && std::trunc(d) == d);
 }
 
-static inline bool isNewLine(QChar c) {
-    return c == QLatin1Char('\n');
-}
+// The length of a proper list, anything else is an error.
+static int properLength(const QSchemeValue &list, const char *name)
+{
+    int length = 0;
+    const QSchemeValue *it = &list;
+    for (; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr)
+        ++length;
 
-static inline bool isSymbolSeparator(QChar c) {
-    return c.isSpace() || QStringLiteral("();").contains(c);
-}
+    if (!is_null(*it))
+        throw qt_scheme_error(name, "expected a proper list");
 
-static inline bool isSemiColon(QChar c) {
-    return c == QLatin1Char(';');
+    return length;
 }
 
-static inline bool isDoubleQuoted(const QString &token) {
-    static const QLatin1Char doubleQuote('"');
-    return token.startsWith(doubleQuote) && token.endsWith(doubleQuote) && token.size() > 1;
+// The list library iterates over pairs through plain pointers. The argument
+// list keeps every pair alive, and pairs never change once constructed, so
+// the procedures they call back into cannot pull a pair out from under us.
+static QSchemeValue builtin_length(const QSchemeValue &arguments)
+{
+    return QSchemeValue(properLength(car(arguments), "length"));
 }
 
-} // namespace Tokens
-
-QStringList QSchemeEnvironment::tokenize(const QString &program) const
+// (append list ...) copies all lists but the last, which becomes the tail
+static QSchemeValue builtin_append(const QSchemeValue &arguments)
 {
-    using namespace Tokens;
+    QSchemeListBuilder builder;
 
-    QStringList tokens;
+    const QSchemeValue *it = &arguments;
+    for (; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr) {
+        const QSchemeValue &list = QSchemeValuePrivate::pair(*it)->car;
+        if (!QSchemeValuePrivate::isPair(QSchemeValuePrivate::pair(*it)->cdr)) {
+            builder.setTail(list);
+            break;
+        }
 
-    enum {
-        Normal,
-        InString,
-        InSymbol,
-        InComment
-    } state = Normal;
+        properLength(list, "append");
+        for (const QSchemeValue *item = &list; QSchemeValuePrivate::isPair(*item);
+             item = &QSchemeValuePrivate::pair(*item)->cdr) {
+            builder.append(QSchemeValuePrivate::pair(*item)->car);
+        }
+    }
 
-    int sym_beginning = -1;
+    return builder.result();
+}
 
-    for (int index = 0; index < program.size(); index++) {
-        const QChar current = program[index];
+static QSchemeValue builtin_reverse(const QSchemeValue &arguments)
+{
+    const QSchemeValue list = car(arguments);
+    properLength(list, "reverse");
 
-        switch (state) {
-        case Normal:
-            if (current.isSpace())
-                break;
+    QSchemeValue result;
+    for (const QSchemeValue *it = &list; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr)
+        result = cons(QSchemeValuePrivate::pair(*it)->car, result);
+    return result;
+}
 
-            if (isSpecialSymbol(current)) {
-                tokens << current;
-                break;
-            }
+static QSchemeValue builtin_list_ref(const QSchemeValue &arguments)
+{
+    const QSchemeValue index = cadr(arguments);
+    if (!QSchemeValuePrivate::isFixnum(index) || QSchemeValuePrivate::fixnum(index) < 0)
+        throw qt_scheme_error("list-ref", "expected a non-negative integer");
 
-            if (isSemiColon(current)) {
-                state = InComment;
-                break;
-            }
+    const QSchemeValue list = car(arguments);
+    const QSchemeValue *it = &list;
+    for (qint64 i = QSchemeValuePrivate::fixnum(index); i > 0 && QSchemeValuePrivate::isPair(*it); --i)
+        it = &QSchemeValuePrivate::pair(*it)->cdr;
 
-            state = isDoubleQuote(current) ? InString : InSymbol;
-            sym_beginning = index;
-            break;
+    if (!QSchemeValuePrivate::isPair(*it))
+        throw qt_scheme_error("list-ref", "index out of range");
+
+    return QSchemeValuePrivate::pair(*it)->car;
+}
+
+// (map procedure list ...) and (for-each procedure list ...) call procedure
+// with one element of each list, and stop at the end of the shortest list.
+template <bool collect>
+static QSchemeValue mapLists(const QSchemeValue &arguments, const char *name)
+{
+    const QSchemeValue procedure = car(arguments);
+
+    QVarLengthArray<const QSchemeValue *, 4> lists;
+    for (const QSchemeValue *it = &QSchemeValuePrivate::pair(arguments)->cdr; QSchemeValuePrivate::isPair(*it);
+         it = &QSchemeValuePrivate::pair(*it)->cdr) {
+        properLength(QSchemeValuePrivate::pair(*it)->car, name);
+        lists.append(&QSchemeValuePrivate::pair(*it)->car);
+    }
+
+    if (lists.isEmpty())
+        throw qt_scheme_error(name, "expected at least one list");
+
+    QSchemeListBuilder results;
+    forever {
+        QSchemeListBuilder callArguments;
+        for (const QSchemeValue *&list : lists) {
+            if (!QSchemeValuePrivate::isPair(*list))
+                return results.result();
+
+            callArguments.append(QSchemeValuePrivate::pair(*list)->car);
+            list = &QSchemeValuePrivate::pair(*list)->cdr;
+        }
+
+        const QSchemeValue result = qt_scheme_call(procedure, callArguments.result());
+        if (collect)
+            results.append(result);
+    }
+}
+
+// (map procedures items) with a list of procedures calls each one with a
+// list of the matching item, as map-list does.
+static QSchemeValue mapProcedures(const QSchemeValue &procedures, const QSchemeValue &items)
+{
+    properLength(procedures, "map");
+    properLength(items, "map");
+
+    QSchemeListBuilder results;
+    const QSchemeValue *procedure = &procedures;
+    const QSchemeValue *item = &items;
+    for (; QSchemeValuePrivate::isPair(*procedure) && QSchemeValuePrivate::isPair(*item);
+         procedure = &QSchemeValuePrivate::pair(*procedure)->cdr, item = &QSchemeValuePrivate::pair(*item)->cdr) {
+        const QSchemeValue argument = list(QSchemeValuePrivate::pair(*item)->car);
+        results.append(qt_scheme_call(QSchemeValuePrivate::pair(*procedure)->car, list(argument)));
+    }
+    return results.result();
+}
+
+static QSchemeValue builtin_map(const QSchemeValue &arguments)
+{
+    const QSchemeValue procedure = car(arguments);
+    if (!is_foreign_procedure(procedure) && !is_native_procedure(procedure) && is_pair(cdr(arguments))
+        && is_null(cddr(arguments))) {
+        return mapProcedures(procedure, cadr(arguments));
+    }
+
+    return mapLists<true>(arguments, "map");
+}
+
+static QSchemeValue builtin_for_each(const QSchemeValue &arguments)
+{
+    mapLists<false>(arguments, "for-each");
+    return QSchemeValue();
+}
+
+static QSchemeValue builtin_filter(const QSchemeValue &arguments)
+{
+    const QSchemeValue predicate = car(arguments);
+    const QSchemeValue list = cadr(arguments);
+    properLength(list, "filter");
+
+    QSchemeListBuilder builder;
+    for (const QSchemeValue *it = &list; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr) {
+        const QSchemeValue &item = QSchemeValuePrivate::pair(*it)->car;
+        if (is_true(qt_scheme_call(predicate, cons(item, QSchemeValue()))))
+            builder.append(item);
+    }
+
+    return builder.result();
+}
+
+// (fold-left f init list) is (f (f init x1) x2) ...
+static QSchemeValue builtin_fold_left(const QSchemeValue &arguments)
+{
+    const QSchemeValue procedure = car(arguments);
+    QSchemeValue result = cadr(arguments);
+    const QSchemeValue items = caddr(arguments);
+    properLength(items, "fold-left");
+
+    for (const QSchemeValue *it = &items; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr)
+        result = qt_scheme_call(procedure, list(result, QSchemeValuePrivate::pair(*it)->car));
+
+    return result;
+}
+
+// (fold-right f init list) is (f x1 (f x2 ... init))
+static QSchemeValue builtin_fold_right(const QSchemeValue &arguments)
+{
+    const QSchemeValue procedure = car(arguments);
+    QSchemeValue result = cadr(arguments);
+    const QSchemeValueList items = caddr(arguments).toList();
+
+    for (int i = items.size() - 1; i >= 0; --i)
+        result = qt_scheme_call(procedure, list(items.at(i), result));
+
+    return result;
+}
+
+// (member x list) is the first tail of list whose car is eq? to x, or #f
+static QSchemeValue builtin_member(const QSchemeValue &arguments)
+{
+    const QSchemeValue item = car(arguments);
+    const QSchemeValue list = cadr(arguments);
+
+    for (const QSchemeValue *it = &list; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr) {
+        if (QSchemeValuePrivate::pair(*it)->car == item)
+            return *it;
+    }
+
+    return make_bool(false);
+}
+
+// (assoc key alist) is the first pair in alist whose car is eq? to key, or #f
+static QSchemeValue builtin_assoc(const QSchemeValue &arguments)
+{
+    const QSchemeValue key = car(arguments);
+    const QSchemeValue alist = cadr(arguments);
+
+    for (const QSchemeValue *it = &alist; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr) {
+        const QSchemeValue &entry = QSchemeValuePrivate::pair(*it)->car;
+        if (QSchemeValuePrivate::isPair(entry) && QSchemeValuePrivate::pair(entry)->car == key)
+            return entry;
+    }
+
+    return make_bool(false);
+}
+
+// (sort list less?) returns a sorted copy, elements that are not less than
+// each other keep their order
+static QSchemeValue builtin_sort(const QSchemeValue &arguments)
+{
+    const QSchemeValue list = car(arguments);
+    const QSchemeValue less = cadr(arguments);
+    properLength(list, "sort");
+
+    QSchemeValueList items = list.toList();
+    std::stable_sort(items.begin(), items.end(), [&less](const QSchemeValue &a, const QSchemeValue &b) {
+        return is_true(qt_scheme_call(less, cons(a, cons(b, QSchemeValue()))));
+    });
+
+    return QSchemeValue(items);
+}
+
+static QSchemeValue builtin_apply(QSchemeEnvironment &env, const QSchemeValue &arguments)
+{
+    const QSchemeValue params = env.evalArgumentList(arguments);
+    return env.apply(car(params), cadr(params));
+}
+
+static const struct {
+    const char *name;
+    QSchemeValue::foreign_syntax_t proc;
+} builtin_syntax[] = {
+    { "define", builtin_define },
+    { "if", builtin_if },
+    { "eval", builtin_eval },
+    { "lambda", builtin_lambda },
+    { "apply", builtin_apply },
+    { "quote", builtin_quote }
+};
+
+static const struct {
+    const char *name;
+    QSchemeValue::foreign_proc_t proc;
+} builtin_procedures[] = {
+    { "cons", builtin_cons },
+    { "car", builtin_car },
+    { "cdr", builtin_cdr },
+    { "list", builtin_list},
+    { "eq?", builtin_eqp },
+    { "list?", builtin_listp },
+    { "string?", builtin_stringp },
+    { "number?", builtin_numberp },
+    { "symbol?", builtin_symbolp },
+    { "callable?", builtin_callablep },
+    { "collect-garbage", builtin_collect_garbage },
+    { "+", builtin_add },
+    { "-", builtin_subtract },
+    { "*", builtin_multiply },
+    { "/", builtin_divide },
+    { "=", builtin_compare<QSchemeNumbers::Comparison::Equal> },
+    { "<", builtin_compare<QSchemeNumbers::Comparison::Less> },
+    { ">", builtin_compare<QSchemeNumbers::Comparison::Greater> },
+    { "<=", builtin_compare<QSchemeNumbers::Comparison::LessEqual> },
+    { ">=", builtin_compare<QSchemeNumbers::Comparison::GreaterEqual> },
+    { "quotient", builtin_divide_integers<QSchemeNumbers::Division::Quotient> },
+    { "remainder", builtin_divide_integers<QSchemeNumbers::Division::Remainder> },
+    { "modulo", builtin_divide_integers<QSchemeNumbers::Division::Modulo> },
+    { "abs", builtin_abs },
+    { "min", builtin_extremum<QSchemeNumbers::Comparison::Less> },
+    { "max", builtin_extremum<QSchemeNumbers::Comparison::Greater> },
+    { "zero?", builtin_zerop },
+    { "integer?", builtin_integerp },
+    { "length", builtin_length },
+    { "append", builtin_append },
+    { "reverse", builtin_reverse },
+    { "list-ref", builtin_list_ref },
+    { "map", builtin_map },
+    { "for-each", builtin_for_each },
+    { "filter", builtin_filter },
+    { "fold-left", builtin_fold_left },
+    { "fold-right", builtin_fold_right },
+    { "member", builtin_member },
+    { "assoc", builtin_assoc },
+    { "sort", builtin_sort },
+};
+
+static const QSchemeBuiltinProcedure *const builtin_procedure_tables[] = {
+    QSchemeVectors::procedures,
+    QSchemeHashTables::procedures,
+    QSchemeParallel::procedures,
+    QSchemeProcesses::procedures,
+    QSchemeBuildGraphs::procedures,
+    QSchemeFiles::procedures,
+    QSchemeOutputFiles::procedures,
+    QSchemeCounters::procedures,
+    QSchemePrinting::procedures
+};
+
+// Builtins are registered once and shared by every environment. The table
+// is never modified after construction, definitions shadow it instead.
+struct QSchemeBuiltinTable
+{
+    QSchemeBuiltinTable();
+
+    QHash<QSchemeSymbol, QSchemeValue> symtab;
+};
+
+QSchemeBuiltinTable::QSchemeBuiltinTable()
+{
+    for (const auto &builtin : builtin_syntax)
+        symtab.insert(QSchemeSymbol(QLatin1String(builtin.name)), QSchemeValue(builtin.proc));
 
-        case InString:
-            if (isDoubleQuote(current) && !isBackslash(program[index - 1])) {
-                tokens << program.mid(sym_beginning, index - sym_beginning + 1);
-                tokens.last().replace(QStringLiteral("\\\""), QStringLiteral("\""));
-                state = Normal;
+    for (const auto &builtin : builtin_procedures)
+        symtab.insert(QSchemeSymbol(QLatin1String(builtin.name)), QSchemeValue(builtin.proc));
+
+    for (const QSchemeBuiltinProcedure *table : builtin_procedure_tables) {
+        for (const QSchemeBuiltinProcedure *builtin = table; builtin->name; ++builtin)
+            symtab.insert(QSchemeSymbol(QLatin1String(builtin->name)), QSchemeValue(builtin->proc));
+    }
+
+    symtab.insert(QSchemeSymbolLiteral("nil"), list());
+}
+
+Q_GLOBAL_STATIC(QSchemeBuiltinTable, builtinTable)
+
+namespace QSchemeBuiltins {
+
+Syntax classify(QSchemeValue::foreign_syntax_t syntax)
+{
+    if (syntax == builtin_quote)
+        return Syntax::Quote;
+    if (syntax == builtin_lambda)
+        return Syntax::Lambda;
+    if (syntax == builtin_closure)
+        return Syntax::Closure;
+    if (syntax == builtin_define)
+        return Syntax::Define;
+    if (syntax == builtin_if)
+        return Syntax::If;
+    if (syntax == builtin_eval)
+        return Syntax::Eval;
+    if (syntax == builtin_apply)
+        return Syntax::Apply;
+    return Syntax::Other;
+}
+
+Procedure classify(QSchemeValue::foreign_proc_t procedure)
+{
+    if (procedure == builtin_car)
+        return Procedure::Car;
+    if (procedure == builtin_cdr)
+        return Procedure::Cdr;
+    if (procedure == builtin_cons)
+        return Procedure::Cons;
+    if (procedure == builtin_eqp)
+        return Procedure::Eq;
+    if (procedure == builtin_add)
+        return Procedure::Add;
+    if (procedure == builtin_subtract)
+        return Procedure::Subtract;
+    if (procedure == builtin_multiply)
+        return Procedure::Multiply;
+    if (procedure == builtin_compare<QSchemeNumbers::Comparison::Equal>)
+        return Procedure::NumberEqual;
+    if (procedure == builtin_compare<QSchemeNumbers::Comparison::Less>)
+        return Procedure::Less;
+    if (procedure == builtin_compare<QSchemeNumbers::Comparison::Greater>)
+        return Procedure::Greater;
+    if (procedure == builtin_compare<QSchemeNumbers::Comparison::LessEqual>)
+        return Procedure::LessEqual;
+    if (procedure == builtin_compare<QSchemeNumbers::Comparison::GreaterEqual>)
+        return Procedure::GreaterEqual;
+    return Procedure::Other;
+}
+
+QSchemeValue::foreign_syntax_t closureSyntax()
+{
+    return builtin_closure;
+}
+
+static const char closureName[] = "#<closure>";
+
+QSchemeSymbol name(const QSchemeValue &builtin)
+{
+    if (builtin.type() == QSchemeValue::Type::ForeignSyntax) {
+        const QSchemeValue::foreign_syntax_t syntax = builtin.toForeignSyntax();
+        if (syntax == builtin_closure)
+            return QSchemeSymbolLiteral(closureName);
+
+        for (const auto &entry : builtin_syntax) {
+            if (entry.proc == syntax)
+                return QSchemeSymbolLiteral(entry.name);
+        }
+    } else if (builtin.type() == QSchemeValue::Type::ForeignProcedure) {
+        const QSchemeValue::foreign_proc_t procedure = builtin.toForeignProcedure();
+        for (const auto &entry : builtin_procedures) {
+            if (entry.proc == procedure)
+                return QSchemeSymbolLiteral(entry.name);
+        }
+
+        for (const QSchemeBuiltinProcedure *table : builtin_procedure_tables) {
+            for (const QSchemeBuiltinProcedure *entry = table; entry->name; ++entry) {
+                if (entry->proc == procedure)
+                    return QSchemeSymbolLiteral(entry->name);
             }
-            break;
+        }
+    }
+
+    return QSchemeSymbol();
+}
+
+bool lookup(const QSchemeSymbol &name, QSchemeValue *builtin)
+{
+    if (name == QSchemeSymbolLiteral(closureName)) {
+        *builtin = QSchemeValue(builtin_closure);
+        return true;
+    }
+
+    const QSchemeBuiltinTable *builtins = builtinTable();
+    const auto it = builtins->symtab.constFind(name);
+    if (it == builtins->symtab.constEnd())
+        return false;
+
+    *builtin = *it;
+    return true;
+}
+
+} // namespace QSchemeBuiltins
+
+static QSchemeVariableObject *makeVariable(const QSchemeValue &name, int depth, int slot, QSchemeValue &handle)
+{
+    QSchemeVariableObject *variable =
+            QSchemeValuePrivate::allocate<QSchemeVariableObject>(QSchemeValue::Type::Symbol);
+    handle = QSchemeValuePrivate::adopt(variable);
+
+    variable->name = QSchemeValue(name.toSymbol());
+    variable->depth = depth;
+    variable->slot = slot;
+    variable->value = QSchemeValuePrivate::unbound();
+    return variable;
+}
+
+// Returns the cell of a global variable, creating it if needed. New cells
+// start out holding the builtin of the same name, so the builtin is used
+// until a definition replaces it.
+static QSchemeValue globalCell(QSchemeEnvironmentPrivate *d, const QSchemeValue &name)
+{
+    const QSchemeSymbol symbol = name.toSymbol();
+
+    const auto it = d->symtab.constFind(symbol);
+    if (it != d->symtab.constEnd())
+        return *it;
+
+    if (Q_UNLIKELY(qt_scheme_in_parallel))
+        throw QSchemeException(QLatin1String("Cannot declare ") + symbol.toString()
+                               + QLatin1String(" in parallel code"));
+
+    QSchemeValue cell;
+    QSchemeVariableObject *variable = makeVariable(name, QSchemeVariableObject::Global, 0, cell);
+
+    const QSchemeBuiltinTable *builtins = builtinTable();
+    const auto builtin = builtins->symtab.constFind(symbol);
+    if (builtin != builtins->symtab.constEnd())
+        variable->value = *builtin;
+
+    d->symtab.insert(symbol, cell);
+    return cell;
+}
+
+// Resolves the variable references of a lambda body when the lambda is
+// created, see QSchemeVariableObject. Lambdas nested in the body are
+// resolved in the same pass and replaced by closure forms, so their bodies
+// are not analyzed again every time they are created. The environment the
+// outermost lambda is created in provides everything outside of it.
+class QSchemeAnalyzer
+{
+public:
+    explicit QSchemeAnalyzer(QSchemeEnvironmentPrivate *env) : env(env) {}
+
+    // (params body) -> (params locals analyzed-body)
+    QSchemeValue lambda(const QSchemeValue &arguments);
 
-        case InSymbol:
-            if (isSymbolSeparator(current)) {
-                tokens << program.mid(sym_beginning, index - sym_beginning);
+private:
+    QSchemeValue expression(const QSchemeValue &exp);
+    QSchemeValue resolve(const QSchemeValue &symbol);
+    QSchemeValue::foreign_syntax_t syntax(const QSchemeValue &head);
+    void collectLocals(const QSchemeValue &exp, QSchemeValueList &names);
 
-                if (isSpecialSymbol(current))
-                    tokens << current;
+    static int indexOf(const QSchemeValueList &names, const QSchemeValue &symbol);
 
-                state = Normal;
+    QSchemeEnvironmentPrivate *env;
+    QVector<QSchemeValueList> scopes; // innermost last
+};
+
+int QSchemeAnalyzer::indexOf(const QSchemeValueList &names, const QSchemeValue &symbol)
+{
+    for (int i = 0; i < names.size(); ++i) {
+        if (QSchemeValuePrivate::bits(names.at(i)) == QSchemeValuePrivate::bits(symbol))
+            return i;
+    }
+
+    return -1;
+}
+
+QSchemeValue QSchemeAnalyzer::lambda(const QSchemeValue &arguments)
+{
+    const QSchemeValue params = car(arguments);
+    const QSchemeValue body = cadr(arguments);
+
+    QSchemeValueList names = params.toList();
+    for (const QSchemeValue &name : qAsConst(names)) {
+        if (!is_symbol(name) || QSchemeValuePrivate::isVariable(name))
+            throw QSchemeException("lambda - invalid parameter list");
+    }
+
+    const int argumentCount = names.size();
+    collectLocals(body, names);
+
+    scopes.push_back(names);
+    const QSchemeValue analyzed = expression(body);
+    scopes.pop_back();
+
+    return list(params, QSchemeValue(names.mid(argumentCount)), analyzed);
+}
+
+QSchemeValue QSchemeAnalyzer::resolve(const QSchemeValue &symbol)
+{
+    int depth = 0;
+    QSchemeValue handle;
+
+    for (int i = scopes.size() - 1; i >= 0; --i, ++depth) {
+        const int slot = indexOf(scopes.at(i), symbol);
+        if (slot >= 0) {
+            makeVariable(symbol, depth, slot, handle);
+            return handle;
+        }
+    }
+
+    for (QSchemeEnvironmentPrivate *d = env; ; d = QSchemeValuePrivate::environment(d->outer), ++depth) {
+        const int slot = indexOf(d->slotNames, symbol);
+        if (slot >= 0) {
+            makeVariable(symbol, depth, slot, handle);
+            return handle;
+        }
+
+        if (d->symtab.contains(symbol.toSymbol()) || !QSchemeValuePrivate::environment(d->outer))
+            return globalCell(d, symbol);
+    }
+}
+
+// The builtin syntax a form's head refers to right now, if any.
+QSchemeValue::foreign_syntax_t QSchemeAnalyzer::syntax(const QSchemeValue &head)
+{
+    if (head.type() == QSchemeValue::Type::ForeignSyntax)
+        return head.toForeignSyntax();
+
+    if (!is_symbol(head) || QSchemeValuePrivate::isVariable(head))
+        return nullptr;
+
+    const QSchemeValue variable = resolve(head);
+    const QSchemeVariableObject *object = QSchemeValuePrivate::variable(variable);
+
+    if (object->depth == QSchemeVariableObject::Global && object->value.type() == QSchemeValue::Type::ForeignSyntax)
+        return object->value.toForeignSyntax();
+
+    return nullptr;
+}
+
+// Collects the names defined in a lambda body, these become slots of its
+// frame. Bodies of nested lambdas and quoted data are skipped.
+void QSchemeAnalyzer::collectLocals(const QSchemeValue &exp, QSchemeValueList &names)
+{
+    if (!is_pair(exp))
+        return;
+
+    const QSchemeValue::foreign_syntax_t special = indexOf(names, car(exp)) < 0 ? syntax(car(exp)) : nullptr;
+
+    if (special == builtin_quote || special == builtin_lambda || special == builtin_closure)
+        return;
+
+    if (special == builtin_define) {
+        const QSchemeValue simplified = analyze_define(cdr(exp));
+        const QSchemeValue name = car(simplified);
+
+        if (is_symbol(name) && indexOf(names, name) < 0)
+            names.append(name);
+
+        if (!is_pair(car(cdr(exp))))
+            collectLocals(cadr(simplified), names);
+        return;
+    }
+
+    for (QSchemeValue it = exp; is_pair(it); it = cdr(it))
+        collectLocals(car(it), names);
+}
+
+QSchemeValue QSchemeAnalyzer::expression(const QSchemeValue &exp)
+{
+    if (is_symbol(exp))
+        return QSchemeValuePrivate::isVariable(exp) ? exp : resolve(exp);
+
+    if (!is_pair(exp))
+        return exp;
+
+    const QSchemeValue head = car(exp);
+    const QSchemeValue::foreign_syntax_t special = syntax(head);
+
+    if (special == builtin_quote)
+        return cons(expression(head), cdr(exp));
+
+    if (special == builtin_closure)
+        return exp;
+
+    if (special == builtin_lambda)
+        return cons(QSchemeValue(builtin_closure), lambda(cdr(exp)));
+
+    if (special == builtin_define) {
+        const QSchemeValue simplified = analyze_define(cdr(exp));
+        return list(expression(head), car(simplified), expression(cadr(simplified)));
+    }
+
+    if (special && special != builtin_if && special != builtin_eval && special != builtin_apply)
+        return exp;
+
+    QSchemeValueList elements;
+    QSchemeValue it = exp;
+    for (; is_pair(it); it = cdr(it))
+        elements.append(expression(car(it)));
+
+    QSchemeValue result = it;
+    for (int i = elements.size() - 1; i >= 0; --i)
+        result = cons(elements.at(i), result);
+
+    return result;
+}
+
+static QSchemeValue analyze_lambda(QSchemeEnvironment &env, const QSchemeValue &arguments)
+{
+    return QSchemeAnalyzer(QSchemeValuePrivate::environment(QSchemeValue(env))).lambda(arguments);
+}
+
+QSchemeEnvironment::QSchemeEnvironment()
+    : d_ptr(QSchemeValuePrivate::allocate<QSchemeEnvironmentPrivate>(QSchemeValue::Type::Environment))
+{
+    QT_SCHEME_COUNT(frames);
+}
+
+QSchemeEnvironment::QSchemeEnvironment(const QSchemeEnvironment &other)
+    : d_ptr(other.d_ptr)
+{
+    QSchemeValuePrivate::retain(d_ptr);
+}
+
+QSchemeEnvironment::~QSchemeEnvironment()
+{
+    QSchemeValuePrivate::release(d_ptr);
+}
+
+QSchemeEnvironment &QSchemeEnvironment::operator=(const QSchemeEnvironment &other)
+{
+    QSchemeValuePrivate::retain(other.d_ptr);
+    QSchemeValuePrivate::release(d_ptr);
+    d_ptr = other.d_ptr;
+    return *this;
+}
+
+int QSchemeEnvironment::collectGarbage()
+{
+    return QSchemeHeap::collect();
+}
+
+static bool qt_scheme_echo = true;
+
+void QSchemeEnvironment::setEchoEnabled(bool enabled)
+{
+    qt_scheme_echo = enabled;
+}
+
+bool QSchemeEnvironment::isEchoEnabled()
+{
+    return qt_scheme_echo;
+}
+
+bool QSchemeEnvironment::load(const QString &localPath)
+{
+    // directories listed by the script are stored once it is done
+    struct ListingSaver
+    {
+        ~ListingSaver() { QSchemeFiles::saveListings(); }
+    } listingSaver;
+
+    QFile file(localPath);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open" << localPath << "-" << file.errorString();
+        return false;
+    }
+
+    const QSchemeScriptCache cache(&file);
+    QSchemeValueList program;
+
+    if (cache.lookup(&program)) {
+        for (const QSchemeValue &exp : qAsConst(program)) {
+            if (!qt_scheme_echo) {
+                eval(exp);
+                continue;
             }
-            break;
 
-        case InComment:
-            if (isNewLine(current))
-                state = Normal;
-            break;
+            sendToRepl(Message::InputExpression, exp);
+            sendToRepl(Message::ResultOfExpression, eval(exp));
+        }
+
+        return true;
+    }
+
+    QSchemeReader reader(&file);
+
+    while (!reader.atEnd()) {
+        const QSchemeValue exp = reader.read();
+        program.append(exp);
+
+        if (!qt_scheme_echo) {
+            eval(exp);
+            continue;
         }
+
+        sendToRepl(Message::InputExpression, exp);
+        sendToRepl(Message::ResultOfExpression, eval(exp));
+    }
+
+    cache.store(program);
+    return true;
+}
+
+bool QSchemeEnvironment::saveImage(const QString &path, const QByteArray &key) const
+{
+    return QSchemeImage::save(d_ptr, path, key);
+}
+
+bool QSchemeEnvironment::restoreImage(const QString &path, const QByteArray &key)
+{
+    return QSchemeImage::restore(d_ptr, path, key);
+}
+
+void QSchemeEnvironment::setScriptCacheDirectory(const QString &path)
+{
+    QSchemeScriptCache::setDirectory(path);
+}
+
+void QSchemeEnvironment::invalidateFileCache()
+{
+    QSchemeFiles::invalidateAll();
+}
+
+void QSchemeEnvironment::setMaximumProcessCount(int count)
+{
+    QSchemeProcesses::setLimit(count);
+}
+
+int QSchemeEnvironment::maximumProcessCount()
+{
+    return QSchemeProcesses::limit();
+}
+
+void QSchemeEnvironment::setProfilingEnabled(bool enabled)
+{
+    qt_scheme_profiling = enabled;
+}
+
+bool QSchemeEnvironment::isProfilingEnabled()
+{
+    return qt_scheme_profiling;
+}
+
+QString QSchemeEnvironment::profileReport()
+{
+    return QSchemeProfiler::report();
+}
+
+QString QSchemeEnvironment::profileStacks()
+{
+    return QSchemeProfiler::collapsedStacks();
+}
+
+QSchemeStatistics QSchemeEnvironment::statistics()
+{
+    return QSchemeCounters::sum();
+}
+
+QString QSchemeEnvironment::scriptCacheDirectory()
+{
+    return QSchemeScriptCache::directory();
+}
+
+void QSchemeEnvironment::sendToRepl(Message m, const QSchemeValue &val)
+{
+    // printed into one string, qDebug() would copy and quote every part
+    QString text;
+    QSchemePrinter printer(&text);
+
+    switch (m) {
+    case Message::InputExpression:
+        printer.print(val);
+        break;
+    case Message::ResultOfExpression:
+        text = QStringLiteral(" => ");
+        printer.print(val);
+        text += QLatin1String(" \n");
+        break;
+    }
+
+    qDebug().noquote() << text;
+}
+
+const QSchemeValue *QSchemeEnvironment::findSymbol(const QSchemeValue &symbol) const
+{
+    const QSchemeSymbol symname = symbol.toSymbol();
+    const QSchemeValue name(symname);
+    QT_SCHEME_COUNT(symbolLookups);
+
+    for (QSchemeEnvironmentPrivate *d = d_ptr; d; d = QSchemeValuePrivate::environment(d->outer)) {
+        QT_SCHEME_COUNT(symbolProbes);
+        if (const QSchemeValue *value = d->binding(name))
+            return value;
+    }
+
+    const QSchemeBuiltinTable *builtins = builtinTable();
+    const auto it = builtins->symtab.constFind(symname);
+    return it != builtins->symtab.constEnd() ? &it.value() : nullptr;
+}
+
+QSchemeValue QSchemeEnvironment::set(const QSchemeValue &symbol, const QSchemeValue &value)
+{
+    Q_D(QSchemeEnvironment);
+
+    const QSchemeSymbol symname = symbol.toSymbol();
+
+    for (int i = 0; i < d->slotNames.size(); ++i) {
+        if (d->slotNames.at(i).toSymbol() == symname)
+            return d->slotValues[i] = value;
+    }
+
+    if (Q_UNLIKELY(qt_scheme_in_parallel))
+        throw QSchemeException(QLatin1String("Cannot define ") + symname.toString()
+                               + QLatin1String(" in parallel code"));
+
+    const auto it = d->symtab.constFind(symname);
+    if (it != d->symtab.constEnd()) {
+        QSchemeValuePrivate::variable(*it)->value = value;
+        return value;
+    }
+
+    QSchemeVariableObject *variable = makeVariable(QSchemeValue(symname), QSchemeVariableObject::Global, 0,
+                                                   d->symtab[symname]);
+    variable->value = value;
+    return value;
+}
+
+QSchemeValue QSchemeEnvironment::get(const QSchemeValue &symbol) const
+{
+    const QSchemeValue *value = findSymbol(symbol);
+
+    if (Q_UNLIKELY(!value || QSchemeValuePrivate::isUnbound(*value)))
+        throw QSchemeUndefinedSymbolException(symbol.toSymbol());
+
+    return *value;
+}
+
+QSchemeValue QSchemeEnvironment::parse(const QString &program) const
+{
+    QSchemeReader reader(program);
+    return reader.read();
+}
+
+namespace Tokens {
+
+static inline bool isDoubleQuoted(const QString &token) {
+    static const QLatin1Char doubleQuote('"');
+    return token.startsWith(doubleQuote) && token.endsWith(doubleQuote) && token.size() > 1;
+}
+
+} // namespace Tokens
+
+QStringList QSchemeEnvironment::tokenize(const QString &program) const
+{
+    using TokenType = QSchemeReader::TokenType;
+
+    QSchemeReader reader(program);
+    QStringList tokens;
+
+    for (QSchemeReader::Token token = reader.nextToken(); token.type != TokenType::End; token = reader.nextToken()) {
+        if (token.type == TokenType::String)
+            tokens << QLatin1Char('"') + QSchemeReader::unescape(token.text) + QLatin1Char('"');
+        else
+            tokens << token.text.toString();
     }
 
     return tokens;
@@ -628,14 +1603,26 @@ QSchemeValue QSchemeEnvironment::readFromTokens(QStringList &tokens) const
     if (token.size() == 1) switch (token[0].toLatin1()) {
     case '(': {
         QSchemeValueList list;
+        QSchemeValue tail;
+
+        while (!tokens.isEmpty() && tokens.first() != QStringLiteral(")")) {
+            if (tokens.first() == QStringLiteral(".") && !list.isEmpty()) {
+                tokens.takeFirst();
+                tail = readFromTokens(tokens);
+                break;
+            }
 
-        while (tokens.first() != QStringLiteral(")"))
             list.push_back(readFromTokens(tokens));
+        }
 
-        Q_ASSERT(tokens.first() == QStringLiteral(")"));
+        if (tokens.isEmpty() || tokens.first() != QStringLiteral(")"))
+            throw QSchemeException("Expected )");
         tokens.takeFirst();
 
-        return QSchemeValue(list);
+        for (int i = list.size() - 1; i >= 0; --i)
+            tail = cons(list.at(i), tail);
+
+        return tail;
     }
         break;
 
@@ -662,67 +1649,243 @@ QSchemeValue QSchemeEnvironment::atomFromToken(const QString &token) const
     if (Tokens::isDoubleQuoted(token))
         return QSchemeValue(token.mid(1, token.size() - 2));
 
-    bool ok;
+    return QSchemeReader::atom(token);
+}
+
+QAtomicInt qt_scheme_recursion_limit = 10000;
+thread_local int qt_scheme_recursion_depth = 0;
+
+void QSchemeEnvironment::setEvaluator(Evaluator evaluator)
+{
+    currentEvaluator.store(int(evaluator));
+}
+
+QSchemeEnvironment::Evaluator QSchemeEnvironment::evaluator()
+{
+    return Evaluator(currentEvaluator.load());
+}
+
+void QSchemeEnvironment::setMaximumRecursionDepth(int depth)
+{
+    qt_scheme_recursion_limit.store(depth);
+}
+
+int QSchemeEnvironment::maximumRecursionDepth()
+{
+    return qt_scheme_recursion_limit.load();
+}
+
+static QSchemeValue lookupVariable(QSchemeEnvironmentPrivate *d, const QSchemeVariableObject *variable)
+{
+    if (variable->depth != QSchemeVariableObject::Global) {
+        for (int i = 0; i < variable->depth; ++i)
+            d = QSchemeValuePrivate::environment(d->outer);
+
+        Q_ASSERT(d && variable->slot < d->slotValues.size());
+    }
+
+    const QSchemeValue &value = variable->depth == QSchemeVariableObject::Global ? variable->value
+                                                                                 : d->slotValues.at(variable->slot);
+
+    if (Q_UNLIKELY(QSchemeValuePrivate::isUnbound(value)))
+        throw QSchemeUndefinedSymbolException(variable->name.toSymbol());
+
+    return value;
+}
+
+static QSchemeEnvironmentPrivate *allocateFrame(const QSchemeLambdaObject *lambda, QSchemeValue &handle)
+{
+    QSchemeEnvironmentPrivate *frame =
+            QSchemeValuePrivate::allocate<QSchemeEnvironmentPrivate>(QSchemeValue::Type::Environment);
+    handle = QSchemeValuePrivate::adopt(frame);
+    QT_SCHEME_COUNT(frames);
+
+    frame->outer = lambda->environment;
+    frame->slotNames = lambda->slotNames;
+    frame->slotValues.reserve(lambda->slotNames.size());
+    return frame;
+}
+
+static void finishFrame(QSchemeEnvironmentPrivate *frame, const QSchemeLambdaObject *lambda)
+{
+    if (Q_UNLIKELY(frame->slotValues.size() != lambda->argnames.size()))
+        throw QSchemeException("Invalid argument count");
+
+    while (frame->slotValues.size() < lambda->slotNames.size())
+        frame->slotValues.append(QSchemeValuePrivate::unbound());
+}
+
+QSchemeEnvironmentPrivate *QSchemeEnvironmentPrivate::makeFrame(const QSchemeLambdaObject *lambda,
+                                                                const QSchemeValue &arguments,
+                                                                QSchemeValue &handle)
+{
+    QSchemeEnvironmentPrivate *frame = allocateFrame(lambda, handle);
+
+    QSchemeValue it = arguments;
+    for (; QSchemeValuePrivate::isPair(it) && frame->slotValues.size() <= lambda->argnames.size();
+         it = QSchemeValuePrivate::pair(it)->cdr) {
+        frame->slotValues.append(QSchemeValuePrivate::pair(it)->car);
+    }
+
+    if (Q_UNLIKELY(!is_null(it)))
+        throw QSchemeException("Invalid argument count");
+
+    finishFrame(frame, lambda);
+    return frame;
+}
+
+QSchemeEnvironmentPrivate *QSchemeEnvironmentPrivate::makeFrame(const QSchemeLambdaObject *lambda,
+                                                                QSchemeValue *arguments, int argumentCount,
+                                                                QSchemeValue &handle)
+{
+    if (Q_UNLIKELY(argumentCount != lambda->argnames.size()))
+        throw QSchemeException("Invalid argument count");
+
+    QSchemeEnvironmentPrivate *frame = allocateFrame(lambda, handle);
+    for (int i = 0; i < argumentCount; ++i)
+        frame->slotValues.append(std::move(arguments[i]));
+
+    finishFrame(frame, lambda);
+    return frame;
+}
+
+static QSchemeValue applyLambda(const QSchemeLambdaObject *lambda, const QSchemeValue &arguments)
+{
+    if (!is_null(lambda->code))
+        return QSchemeVirtualMachine::execute(lambda, arguments);
+
+    QSchemeProfiler::Scope profile;
+    if (Q_UNLIKELY(qt_scheme_profiling))
+        profile.call(lambda);
+
+    QSchemeValue handle;
+    QSchemeEnvironment execution_env(QSchemeEnvironmentPrivate::makeFrame(lambda, arguments, handle));
+    return execution_env.eval(lambda->body);
+}
+
+static inline QSchemeValue callForeign(const QSchemeValue &procedure, const QSchemeValue &arguments)
+{
+    const QSchemeValue::foreign_proc_t function = procedure.toForeignProcedure();
+    if (Q_LIKELY(!qt_scheme_profiling))
+        return function(arguments);
+
+    QSchemeProfiler::Scope profile;
+    profile.call(function);
+    return function(arguments);
+}
 
-    const int i = token.toInt(&ok);
-    if (ok)
-        return QSchemeValue(i);
+QSchemeValue qt_scheme_call(const QSchemeValue &procedure, const QSchemeValue &arguments)
+{
+    if (is_foreign_procedure(procedure))
+        return callForeign(procedure, arguments);
 
-    const double d = token.toDouble(&ok);
-    if (ok)
-        return QSchemeValue(d);
+    if (is_native_procedure(procedure))
+        return applyLambda(QSchemeValuePrivate::object<QSchemeLambdaObject>(procedure), arguments);
 
-    return QSchemeValue(QSchemeSymbol(token));
+    throw QSchemeException("call - not a procedure");
 }
 
+// Procedure bodies and the branches of if, eval and apply are in tail
+// position. Instead of recursing, the loop below replaces the expression
+// (and for lambda calls the environment) and goes around again, so loops
+// written as tail recursion run in constant native stack.
 QSchemeValue QSchemeEnvironment::eval(const QSchemeValue &exp)
 {
     using namespace QtSchemeFunctions;
 
+    const QSchemeRecursionGuard guard;
+    QSchemeProfiler::Scope profile;
+    QSchemeCounters::registerThread();
+
+    QSchemeEnvironment *env = this;
+    QSchemeEnvironment frame_env(d_ptr);
     QSchemeValue current = exp;
 
-    switch (current.type()) {
-    case QSchemeValue::Type::String:
-    case QSchemeValue::Type::Number:
-    case QSchemeValue::Type::ForeignProcedure:
-    case QSchemeValue::Type::ForeignSyntax:
-        break;
+    forever {
+        switch (current.type()) {
+        case QSchemeValue::Type::String:
+        case QSchemeValue::Type::Number:
+        case QSchemeValue::Type::Boolean:
+        case QSchemeValue::Type::ForeignProcedure:
+        case QSchemeValue::Type::ForeignSyntax:
+        case QSchemeValue::Type::Vector:
+        case QSchemeValue::Type::Bytevector:
+        case QSchemeValue::Type::F64Vector:
+        case QSchemeValue::Type::HashTable:
+            return current;
+
+        case QSchemeValue::Type::Environment:
+        case QSchemeValue::Type::LambdaProcedure:
+            throw QSchemeException("eval - invalid parameter");
+
+        case QSchemeValue::Type::Symbol:
+            if (QSchemeValuePrivate::isVariable(current))
+                return lookupVariable(env->d_ptr, QSchemeValuePrivate::variable(current));
+            return env->get(current);
+
+        case QSchemeValue::Type::Cons:
+            break;
+        }
 
-    case QSchemeValue::Type::Environment:
-    case QSchemeValue::Type::LambdaProcedure:
-        throw QSchemeException("eval - invalid parameter");
-        break;
+        if (is_null(current))
+            return current;
 
-    case QSchemeValue::Type::Symbol:
-        current = get(current);
-        break;
+        QSchemeValue fn = env->eval(QSchemeValuePrivate::pair(current)->car);
+        QSchemeValue args = QSchemeValuePrivate::pair(current)->cdr;
 
-    case QSchemeValue::Type::Cons:
-    {
-        QSchemeValue fn = eval(car(exp));
-        QSchemeValue args = cdr(exp);
+        if (fn.type() == QSchemeValue::Type::ForeignSyntax) {
+            const QSchemeValue::foreign_syntax_t syntax = fn.toForeignSyntax();
 
-        if (fn.type() != QSchemeValue::Type::ForeignSyntax)
-            args = evalArgumentList(args);
+            if (syntax == builtin_if) {
+                const bool predicate = is_true(env->eval(car(args)));
+                current = predicate ? cadr(args) : caddr(args);
+                continue;
+            }
 
-        current = apply(fn, args);
-    }
-        break;
-    }
+            if (syntax == builtin_eval) {
+                current = args;
+                continue;
+            }
 
-    return current;
+            if (syntax == builtin_apply) {
+                const QSchemeValue params = env->evalArgumentList(args);
+                fn = car(params);
+                args = cadr(params);
+            } else {
+                return syntax(*env, args);
+            }
+        } else {
+            args = env->evalArgumentList(args);
+        }
+
+        if (!is_native_procedure(fn))
+            return env->apply(fn, args);
+
+        const QSchemeLambdaObject *lambda = QSchemeValuePrivate::object<QSchemeLambdaObject>(fn);
+        if (!is_null(lambda->code)) {
+            // the virtual machine profiles the call itself
+            profile.end();
+            return QSchemeVirtualMachine::execute(lambda, args);
+        }
+
+        if (Q_UNLIKELY(qt_scheme_profiling))
+            profile.call(lambda);
 
-    Q_UNREACHABLE();
+        QSchemeValue handle;
+        frame_env = QSchemeEnvironment(QSchemeEnvironmentPrivate::makeFrame(lambda, args, handle));
+        env = &frame_env;
+        current = lambda->body;
+    }
 }
 
 QSchemeValue QSchemeEnvironment::apply(const QSchemeValue &procedure, const QSchemeValue &arguments)
 {
     if (is_foreign_procedure(procedure)) {
-        return (procedure.toForeignProcedure())(arguments);
+        return callForeign(procedure, arguments);
     } else if (procedure.type() == QSchemeValue::Type::ForeignSyntax) {
         return (procedure.toForeignSyntax())(*this, arguments);
     } else if (is_native_procedure(procedure)) {
-        return procedure.toLambdaProcedure().apply(arguments);
+        return applyLambda(QSchemeValuePrivate::object<QSchemeLambdaObject>(procedure), arguments);
     } else {
         throw QSchemeException("apply - unknown procedure type");
     }
@@ -732,8 +1895,8 @@ QSchemeValueList QSchemeEnvironment::evalArgumentList(const QSchemeValue &args)
 {
     QSchemeValueList result;
 
-    for (const QSchemeValue &arg : args.toList())
-        result.push_back(eval(arg));
+    for (QSchemeValue it = args; is_pair(it); it = cdr(it))
+        result.push_back(eval(car(it)));
 
     return result;
 }
@@ -741,29 +1904,153 @@ QSchemeValueList QSchemeEnvironment::evalArgumentList(const QSchemeValue &args)
 QSchemeEnvironment QSchemeEnvironment::makeInner()
 {
     QSchemeEnvironment inner;
-    inner.d_ptr->outer = this->d_ptr;
+    inner.d_ptr->outer = QSchemeValue(*this);
     return inner;
 }
 
 QSchemeEnvironment::QSchemeEnvironment(QSchemeEnvironmentPrivate *dd)
-    : d_ptr(dd->sharedFromThis())
-{}
+    : d_ptr(dd)
+{
+    QSchemeValuePrivate::retain(d_ptr);
+}
 
 QSchemeValue QSchemeLambdaProcedure::apply(const QSchemeValue &arguments)
 {
-    const QSchemeValueList arglist = arguments.toList();
+    const QSchemeValue procedure(*this);
+    return applyLambda(QSchemeValuePrivate::object<QSchemeLambdaObject>(procedure), arguments);
+}
 
-    if (Q_UNLIKELY(argnames.size() != arglist.size()))
-        throw QSchemeException("Invalid argument count");
+#ifndef QT_NO_DATASTREAM
+QDataStream &operator<<(QDataStream &stream, const QSchemeValue &value)
+{
+    using namespace QSchemeSerialization;
+
+    switch (value.type()) {
+    case QSchemeValue::Type::Cons: {
+        if (is_null(value))
+            return stream << quint8(NilTag);
+
+        quint32 count = 0;
+        QSchemeValue it = value;
+        for (; QSchemeValuePrivate::isPair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+            ++count;
+
+        stream << quint8(ListTag) << count;
+        for (it = value; QSchemeValuePrivate::isPair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+            stream << QSchemeValuePrivate::pair(it)->car;
 
-    QSchemeEnvironment execution_env = this->environment.makeInner();
+        return stream << it;
+    }
+
+    case QSchemeValue::Type::Boolean:
+        return stream << quint8(value.toBool() ? TrueTag : FalseTag);
+
+    case QSchemeValue::Type::Number:
+        if (QSchemeValuePrivate::isFixnum(value))
+            return stream << quint8(FixnumTag) << qint64(QSchemeValuePrivate::fixnum(value));
+        return stream << quint8(FlonumTag) << QSchemeValuePrivate::flonum(value);
+
+    case QSchemeValue::Type::String:
+        return stream << quint8(StringTag) << value.toString();
+
+    case QSchemeValue::Type::Symbol:
+        if (!QSchemeValuePrivate::isVariable(value))
+            return stream << quint8(SymbolTag) << value.toSymbol().toString();
+        break;
 
-    for (int i = 0; i < argnames.size(); i++)
-        execution_env.set(argnames[i], arglist[i]);
+    default:
+        break;
+    }
 
-    return execution_env.eval(this->body);
+    // procedures, environments, vectors and hash tables only exist at run time
+    stream.setStatus(QDataStream::WriteFailed);
+    return stream;
 }
 
+QDataStream &operator>>(QDataStream &stream, QSchemeValue &value)
+{
+    using namespace QSchemeSerialization;
+
+    value = QSchemeValue();
+
+    quint8 tag;
+    stream >> tag;
+    if (stream.status() != QDataStream::Ok)
+        return stream;
+
+    switch (tag) {
+    case NilTag:
+        break;
+
+    case FalseTag:
+    case TrueTag:
+        value = QSchemeValue(tag == TrueTag);
+        break;
+
+    case FixnumTag: {
+        qint64 fixnum;
+        stream >> fixnum;
+        if (!QSchemeValuePrivate::fitsFixnum(fixnum))
+            stream.setStatus(QDataStream::ReadCorruptData);
+        else
+            value = QSchemeValuePrivate::fromFixnum(fixnum);
+        break;
+    }
+
+    case FlonumTag: {
+        double flonum;
+        stream >> flonum;
+        value = QSchemeValue(flonum);
+        break;
+    }
+
+    case StringTag: {
+        QString string;
+        stream >> string;
+        value = QSchemeValue(string);
+        break;
+    }
+
+    case SymbolTag: {
+        QString name;
+        stream >> name;
+        value = QSchemeValue(QSchemeSymbol(name));
+        break;
+    }
+
+    case ListTag: {
+        quint32 count;
+        stream >> count;
+
+        // the count is not trusted for preallocation, the data may be corrupt
+        QVarLengthArray<QSchemeValue, 16> items;
+        for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+            QSchemeValue item;
+            stream >> item;
+            items.append(item);
+        }
+
+        QSchemeValue tail;
+        stream >> tail;
+
+        for (int i = items.size() - 1; i >= 0; --i)
+            tail = cons(items.at(i), tail);
+        value = tail;
+        break;
+    }
+
+    default:
+        stream.setStatus(QDataStream::ReadCorruptData);
+        break;
+    }
+
+    if (stream.status() != QDataStream::Ok)
+        value = QSchemeValue();
+
+    return stream;
+}
+#endif
+
 #ifndef QT_NO_DEBUG_STREAM
 QDebug operator<<(QDebug d, const QSchemeValue &value)
 {
@@ -9,34 +9,79 @@ QT_BEGIN_NAMESPACE
 class QSchemeValue;
 class QSchemeEnvironment;
 
+// Work done by the interpreter, counted per thread and summed up by
+// QSchemeEnvironment::statistics(). Counting is only built in with
+// QT_SCHEME_STATISTICS defined, all counts are zero otherwise.
+struct QSchemeStatistics
+{
+    quint64 valueCopies;     // references taken to values held on the heap
+    quint64 allocations;     // heap objects
+    quint64 pairs;           // of them, pairs
+    quint64 listConversions; // QSchemeValueLists made from lists
+    quint64 frames;          // environments, for calls and makeInner() alike
+    quint64 symbolLookups;   // names looked up through environments
+    quint64 symbolProbes;    // environments searched by them
+    quint64 exceptions;      // QSchemeExceptions constructed
+};
+
+#ifdef QT_SCHEME_STATISTICS
+// Only written by their own thread, read by statistics() at any time.
+struct QSchemeThreadCounters
+{
+    QAtomicInteger<quint64> valueCopies;
+    QAtomicInteger<quint64> allocations;
+    QAtomicInteger<quint64> pairs;
+    QAtomicInteger<quint64> listConversions;
+    QAtomicInteger<quint64> frames;
+    QAtomicInteger<quint64> symbolLookups;
+    QAtomicInteger<quint64> symbolProbes;
+    QAtomicInteger<quint64> exceptions;
+};
+
+extern thread_local QSchemeThreadCounters qt_scheme_statistics;
+// relaxed, and not a read-modify-write: no one else writes the counter
+#  define QT_SCHEME_COUNT(counter) \
+    (qt_scheme_statistics.counter.store(qt_scheme_statistics.counter.load() + 1))
+#else
+#  define QT_SCHEME_COUNT(counter) ((void)0)
+#endif
+
 typedef QVector<QSchemeValue> QSchemeValueList;
 
+// Symbols are interned in a process-wide table, so a symbol is just the integer
+// id of its name. Hashing and comparison never touch the string data.
 class Q_SCHEME_EXPORT QSchemeSymbol {
 public:
-    inline QSchemeSymbol() {}
-    inline explicit QSchemeSymbol(const QLatin1String &string) : m_symname(string) {}
-    inline explicit QSchemeSymbol(const QString &string) : m_symname(string) {}
-    //inline explicit QSchemeSymbol(const QByteArray &name) : m_symname(name) {}
+    inline QSchemeSymbol() : m_id(0) {}
+    explicit QSchemeSymbol(const QLatin1String &string);
+    explicit QSchemeSymbol(const QString &string);
+    explicit QSchemeSymbol(QStringView string);
     inline ~QSchemeSymbol() {}
 
-    inline QSchemeSymbol &operator=(const QSchemeSymbol &other) {
-        m_symname = other.m_symname;
-        return *this;
+    inline bool operator==(const QSchemeSymbol &other) const {
+        return m_id == other.m_id;
     }
 
-    inline bool operator==(const QSchemeSymbol &other) const {
-        return m_symname == other.m_symname;
+    inline bool operator!=(const QSchemeSymbol &other) const {
+        return m_id != other.m_id;
     }
 
-    inline QByteArray toUtf8() const { return m_symname.toUtf8(); }
-    inline QString toString() const { return m_symname; }
+    inline QByteArray toUtf8() const { return toString().toUtf8(); }
+    QString toString() const;
+
+    inline int id() const { return m_id; }
+    static inline QSchemeSymbol fromId(int id) {
+        QSchemeSymbol symbol;
+        symbol.m_id = id;
+        return symbol;
+    }
 
 private:
-    QString m_symname;
+    int m_id;
 };
 
 inline uint qHash(const QSchemeSymbol &sym, uint seed) {
-    return qHash(sym.toUtf8(), seed);
+    return qHash(sym.id(), seed);
 }
 
 inline QSchemeSymbol QSchemeSymbolLiteral(const char *symname) {
@@ -46,16 +91,16 @@ inline QSchemeSymbol QSchemeSymbolLiteral(const char *symname) {
 class Q_SCHEME_EXPORT QSchemeException : public std::exception {
 public:
     QSchemeException(const char *message)
-        : m_msg(QByteArray(message)) {}
+        : m_msg(message) { QT_SCHEME_COUNT(exceptions); }
     QSchemeException(const QLatin1String &message)
-        : m_msg(message.data()) {}
+        : m_msg(message.data(), message.size()) { QT_SCHEME_COUNT(exceptions); }
     QSchemeException(const QString &message)
-        : m_msg(message.toUtf8()) {}
+        : m_msg(message.toUtf8()) { QT_SCHEME_COUNT(exceptions); }
 
-    const char *what() const noexcept Q_DECL_OVERRIDE { return m_msg.data(); }
+    const char *what() const noexcept Q_DECL_OVERRIDE { return m_msg.constData(); }
 
 private:
-    QLatin1String m_msg;
+    QByteArray m_msg;
 };
 
 class Q_SCHEME_EXPORT QSchemeUndefinedSymbolException : public QSchemeException {
@@ -73,12 +118,25 @@ private:
 
 class QSchemeLambdaProcedure;
 
+// Common header of every heap allocated value. kind holds the
+// QSchemeValue::Type of the object, the remaining fields are bookkeeping
+// for the arena allocator and the cycle collector.
+struct QSchemeHeapObject
+{
+    QAtomicInt ref;
+    quint8 kind;
+    quint8 sizeClass;
+    quint8 gcFlags;
+    qint32 gcRefs;
+};
+
 class Q_SCHEME_EXPORT QSchemeValue
 {
-public:    
-    QSchemeValue();
-    QSchemeValue(const QSchemeValue &);
-    ~QSchemeValue();
+public:
+    inline QSchemeValue() : v(NilValue) {}
+    inline QSchemeValue(const QSchemeValue &other) : v(other.v) { retain(); }
+    inline QSchemeValue(QSchemeValue &&other) Q_DECL_NOTHROW : v(other.v) { other.v = NilValue; }
+    inline ~QSchemeValue() { release(); }
 
     typedef QSchemeValue (*foreign_syntax_t)(QSchemeEnvironment &env, const QSchemeValue &arg);
     typedef QSchemeValue (*foreign_proc_t)(const QSchemeValue &arg);
@@ -93,8 +151,22 @@ public:
 
     explicit QSchemeValue(int i);
     explicit QSchemeValue(double d);
+    explicit QSchemeValue(bool b);
+
+    inline QSchemeValue &operator=(const QSchemeValue &other) {
+        // other may live inside the object we are about to release
+        const quint64 bits = other.v;
+        other.retain();
+        release();
+        v = bits;
+        return *this;
+    }
+
+    inline QSchemeValue &operator=(QSchemeValue &&other) Q_DECL_NOTHROW {
+        qSwap(v, other.v);
+        return *this;
+    }
 
-    QSchemeValue &operator=(const QSchemeValue &);
     bool operator==(const QSchemeValue &other) const;
 
     enum class Type {
@@ -105,10 +177,15 @@ public:
         Number,
         ForeignSyntax,
         ForeignProcedure,
-        LambdaProcedure
+        LambdaProcedure,
+        Boolean,
+        Vector,
+        Bytevector,
+        F64Vector,
+        HashTable
     };
 
-    Type type() const;
+    inline Type type() const;
 
     QSchemeEnvironment toEnvironment() const;
     QSchemeSymbol toSymbol() const;
@@ -118,13 +195,91 @@ public:
     foreign_syntax_t toForeignSyntax() const;
     foreign_proc_t toForeignProcedure() const;
     QSchemeLambdaProcedure toLambdaProcedure() const;
+    bool toBool() const;
 
     QString toPrintableString() const;
+    // At most maxLength characters and maxDepth levels of nesting, negative
+    // for no limit; output that is cut short ends in "...".
+    QString toPrintableString(qint64 maxLength, int maxDepth = -1) const;
+    // Writes the printable string as UTF-8, returns false on write errors.
+    bool writePrintableString(QIODevice *device) const;
 
 private:
-    QVariant d;
+    // Values are NaN-boxed into a single 64 bit word. Any bit pattern below
+    // the first tag is a double (NaNs are canonicalized to the positive quiet
+    // NaN), everything else carries a 16 bit tag and a 48 bit payload.
+    enum : quint64 {
+        PayloadBits = 48,
+        PayloadMask = (Q_UINT64_C(1) << PayloadBits) - 1,
+
+        FixnumTag = Q_UINT64_C(0xfff8),
+        ConstantTag = Q_UINT64_C(0xfff9),
+        SymbolTag = Q_UINT64_C(0xfffa),
+        ForeignProcedureTag = Q_UINT64_C(0xfffb),
+        ForeignSyntaxTag = Q_UINT64_C(0xfffc),
+        HeapObjectTag = Q_UINT64_C(0xffff),
+
+        NilValue = (ConstantTag << PayloadBits) | 0,
+        FalseValue = (ConstantTag << PayloadBits) | 1,
+        TrueValue = (ConstantTag << PayloadBits) | 2,
+        // marks variables that are declared but not defined yet, never
+        // escapes into user visible values
+        UnboundValue = (ConstantTag << PayloadBits) | 3
+    };
+
+    inline quint64 tag() const { return v >> PayloadBits; }
+    inline quint64 payload() const { return v & PayloadMask; }
+    inline bool isDouble() const { return v < (FixnumTag << PayloadBits); }
+    inline bool isHeapObject() const { return tag() == HeapObjectTag; }
+    inline QSchemeHeapObject *heapObject() const {
+        return reinterpret_cast<QSchemeHeapObject *>(quintptr(payload()));
+    }
+    inline qint64 fixnum() const { return qint64(v << (64 - PayloadBits)) >> (64 - PayloadBits); }
+    inline double flonum() const { double d; memcpy(&d, &v, sizeof(d)); return d; }
+
+    inline void retain() const {
+        if (isHeapObject()) {
+            heapObject()->ref.ref();
+            QT_SCHEME_COUNT(valueCopies);
+        }
+    }
+
+    inline void release() {
+        if (isHeapObject() && !heapObject()->ref.deref())
+            destroy(heapObject());
+    }
+
+    static void destroy(QSchemeHeapObject *object);
+
+    explicit QSchemeValue(QSchemeHeapObject *object);
+    template <typename T> inline T *object() const { return static_cast<T *>(heapObject()); }
+
+    quint64 v;
+
+    friend struct QSchemeValuePrivate;
 };
 
+inline QSchemeValue::Type QSchemeValue::type() const
+{
+    if (isDouble())
+        return Type::Number;
+
+    switch (tag()) {
+    case FixnumTag:
+        return Type::Number;
+    case ConstantTag:
+        return v == NilValue ? Type::Cons : Type::Boolean;
+    case SymbolTag:
+        return Type::Symbol;
+    case ForeignProcedureTag:
+        return Type::ForeignProcedure;
+    case ForeignSyntaxTag:
+        return Type::ForeignSyntax;
+    default:
+        return Type(heapObject()->kind);
+    }
+}
+
 namespace QtSchemeFunctions {
 // simplify arguments to define, e.g. ((double n) (* 2 n)) becomes (double (lambda (n) (* 2 n))
 Q_SCHEME_EXPORT QSchemeValue analyze_define(const QSchemeValue &val);
@@ -137,6 +292,7 @@ Q_SCHEME_EXPORT bool is_symbol(const QSchemeValue &val);
 Q_SCHEME_EXPORT bool is_number(const QSchemeValue &val);
 Q_SCHEME_EXPORT bool is_string(const QSchemeValue &val);
 Q_SCHEME_EXPORT bool is_list(const QSchemeValue &val);
+Q_SCHEME_EXPORT bool is_pair(const QSchemeValue &val);
 Q_SCHEME_EXPORT bool is_native_procedure(const QSchemeValue &val);
 Q_SCHEME_EXPORT bool is_foreign_procedure(const QSchemeValue &val);
 Q_SCHEME_EXPORT bool is_macro(const QSchemeValue &val);
@@ -206,13 +362,74 @@ public:
     virtual ~QSchemeEnvironment();
 
     QSchemeEnvironment &operator=(const QSchemeEnvironment &);
+    inline bool operator==(const QSchemeEnvironment &other) const { return d_ptr == other.d_ptr; }
+
+    // Frees unreachable reference cycles, e.g. closures stored in their own
+    // defining environment. Returns the number of objects released.
+    static int collectGarbage();
+
+    // Selects how lambdas created from now on run: Bytecode compiles their
+    // bodies for the virtual machine, TreeWalker interprets the expressions.
+    enum class Evaluator { TreeWalker, Bytecode };
+    static void setEvaluator(Evaluator evaluator);
+    static Evaluator evaluator();
+
+    // Limits how deeply evaluations may nest on a thread, exceeding it
+    // throws a QSchemeException. Tail calls do not count towards the limit.
+    static void setMaximumRecursionDepth(int depth);
+    static int maximumRecursionDepth();
+
+    // load() keeps the parsed form of scripts in path, keyed by a hash of
+    // their contents, and reads unchanged scripts back from there. Empty,
+    // the default, disables the cache.
+    static void setScriptCacheDirectory(const QString &path);
+    static QString scriptCacheDirectory();
+
+    // file-exists?, file-mtime, directory-list and glob look at every path
+    // once. Embedders that change files behind the interpreter's back, e.g.
+    // by running processes of their own, make them look again.
+    static void invalidateFileCache();
+
+    // Limits how many processes started by process-spawn run at once, the
+    // others wait in line. Defaults to the number of cores.
+    static void setMaximumProcessCount(int count);
+    static int maximumProcessCount();
+
+    // Counts calls and the time spent in procedures, by the name they were
+    // first defined with. Enable it before running the scripts to profile.
+    // The reports cover all threads and must not be made while a script
+    // runs: profileReport() lists procedures by their own time, and
+    // profileStacks() the time of every call stack for flame graph tools.
+    static void setProfilingEnabled(bool enabled);
+    static bool isProfilingEnabled();
+    static QString profileReport();
+    static QString profileStacks();
+
+    // The counters of all threads that ran scripts, added up. Threads that
+    // are running meanwhile are counted as far as they got.
+    static QSchemeStatistics statistics();
+
+    // load() shows every top level expression and its value through
+    // sendToRepl(), unless echo is disabled for running scripts in batch.
+    static void setEchoEnabled(bool enabled);
+    static bool isEchoEnabled();
 
     bool load(const QString &localPath);
 
+    // Images hold the definitions of a top level environment together with
+    // the procedures, frames and data they reach, so that the scripts that
+    // made them do not have to run again. key identifies what the image was
+    // made from; restoring fails, leaving the environment as it was, when
+    // the keys differ or the image is damaged. Foreign procedures defined
+    // by the embedder are stored by name and must be defined again before
+    // restoring.
+    bool saveImage(const QString &path, const QByteArray &key) const;
+    bool restoreImage(const QString &path, const QByteArray &key);
+
     enum class Message { InputExpression, ResultOfExpression };
     void sendToRepl(Message m, const QSchemeValue &val);
 
-    virtual QSchemeEnvironmentPrivate *findSymbol(const QSchemeValue &symbol) const;
+    virtual const QSchemeValue *findSymbol(const QSchemeValue &symbol) const;
 
     virtual QSchemeValue set(const QSchemeValue &symbol, const QSchemeValue &value);
     virtual QSchemeValue get(const QSchemeValue &symbol) const;
@@ -232,8 +449,10 @@ public:
 protected:
 
 private:
-    QSharedPointer<QSchemeEnvironmentPrivate> d_ptr;
+    QSchemeEnvironmentPrivate *d_ptr;
     Q_DECLARE_PRIVATE(QSchemeEnvironment)
+
+    friend class QSchemeValue;
 };
 
 class Q_SCHEME_EXPORT QSchemeLambdaProcedure
@@ -242,6 +461,7 @@ public:
     QSchemeValueList argnames;
     QSchemeValue body;
     QSchemeEnvironment environment;
+    QSchemeValueList locals; // variables defined in the body
 
     QSchemeValue apply(const QSchemeValue &arguments);
 };
@@ -0,0 +1,50 @@
+QT += core core-private
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+# DEFINES += QT_SCHEME_STATISTICS counts the work shown by runtime-stats and --stats
+DEFINES += \
+    QT_NO_CAST_FROM_BYTEARRAY \
+    QT_NO_CAST_FROM_ASCII \
+    QT_NO_CAST_TO_ASCII
+
+SOURCES += \
+    $$PWD/qscheme.cpp \
+    $$PWD/qschemebuild.cpp \
+    $$PWD/qschemecache.cpp \
+    $$PWD/qschemefiles.cpp \
+    $$PWD/qschemehash.cpp \
+    $$PWD/qschemeheap.cpp \
+    $$PWD/qschemeimage.cpp \
+    $$PWD/qschemenumber.cpp \
+    $$PWD/qschemeoutput.cpp \
+    $$PWD/qschemeparallel.cpp \
+    $$PWD/qschemeprinter.cpp \
+    $$PWD/qschemeprocess.cpp \
+    $$PWD/qschemeprofiler.cpp \
+    $$PWD/qschemereader.cpp \
+    $$PWD/qschemestatistics.cpp \
+    $$PWD/qschemevector.cpp \
+    $$PWD/qschemevm.cpp
+
+HEADERS += \
+    $$PWD/qscheme_p.h \
+    $$PWD/qschemebuild_p.h \
+    $$PWD/qschemecache_p.h \
+    $$PWD/qschemefiles_p.h \
+    $$PWD/qschemehash_p.h \
+    $$PWD/qschemeheap_p.h \
+    $$PWD/qschemeimage_p.h \
+    $$PWD/qschemenumber_p.h \
+    $$PWD/qschemeoutput_p.h \
+    $$PWD/qschemeparallel_p.h \
+    $$PWD/qschemeprinter_p.h \
+    $$PWD/qschemeprocess_p.h \
+    $$PWD/qschemeprofiler_p.h \
+    $$PWD/qschemereader_p.h \
+    $$PWD/qschemestatistics_p.h \
+    $$PWD/qschemevector_p.h \
+    $$PWD/qschemevm_p.h \
+    $$PWD/qscheme.h \
+    $$PWD/qtschemeglobal.h
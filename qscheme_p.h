@@ -0,0 +1,410 @@
+#ifndef QSCHEME_P_H
+#define QSCHEME_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme.h"
+#include "qschemeheap_p.h"
+
+QT_BEGIN_NAMESPACE
+
+struct QSchemeStringObject : QSchemeHeapObject
+{
+    QString string;
+};
+
+// Pairs are immutable once constructed, so they can be shared freely
+// between lists.
+struct QSchemePairObject : QSchemeHeapObject
+{
+    QSchemeValue car;
+    QSchemeValue cdr;
+};
+
+// Vectors are mutable and have a fixed size. Elements of bytevectors and
+// f64vectors are stored unboxed, so bulk operations run over plain arrays.
+struct QSchemeVectorObject : QSchemeHeapObject
+{
+    QSchemeValueList items;
+};
+
+struct QSchemeBytevectorObject : QSchemeHeapObject
+{
+    QByteArray bytes;
+};
+
+struct QSchemeF64VectorObject : QSchemeHeapObject
+{
+    QVector<double> values;
+};
+
+// Hash tables use open addressing with linear probing over a power of two
+// number of slots, free slots have an unbound key. Eq tables compare keys
+// by identity, equal tables compare them like eq? does, which looks into
+// strings and lists and treats 1 and 1.0 as the same key. See
+// qschemehash_p.h for the operations.
+struct QSchemeHashTableObject : QSchemeHeapObject
+{
+    enum class Equivalence : quint8 { Eq, Equal };
+
+    struct Slot
+    {
+        QSchemeValue key;
+        QSchemeValue value;
+        uint hash;
+    };
+
+    QVector<Slot> slots;
+    int count = 0;
+    Equivalence equivalence = Equivalence::Equal;
+};
+
+struct QSchemeLambdaObject : QSchemeHeapObject
+{
+    QSchemeValueList argnames;
+    QSchemeValueList slotNames; // argnames followed by the body's locals
+    QSchemeValue body;
+    QSchemeValue environment;
+    QSchemeValue code; // QSchemeCodeObject when compiled to bytecode, nil otherwise
+    QString name;      // what it was first defined as, for the profiler
+};
+
+// A compiled lambda body, shared by all procedures created from the same
+// lambda expression. Has kind QSchemeHeap::CodeKind.
+struct QSchemeCodeObject : QSchemeHeapObject
+{
+    QVector<qint32> instructions;
+    QSchemeValueList constants;
+    QSchemeValueList argnames;
+    QSchemeValueList slotNames;
+    QSchemeValue body; // the analyzed body the code was compiled from
+};
+
+// A variable reference resolved when its lambda was created. Locals are
+// addressed by frame depth and slot index. Globals have a depth of -1 and
+// are the binding cell itself, shared with the symtab that defines them,
+// so they are looked up once no matter how often they are referenced.
+// Reports Type::Symbol and prints as its name.
+struct QSchemeVariableObject : QSchemeHeapObject
+{
+    enum { Global = -1 };
+
+    QSchemeValue name;
+    int depth;
+    int slot;
+    QSchemeValue value;
+};
+
+// Lambda calls get a frame holding their arguments and the locals defined
+// in the body in slots named by the lambda's slotNames. Names defined at
+// run time, e.g. at the top level, live in symtab as QSchemeVariableObject
+// cells. Top level environments only use symtab and share the builtins
+// through a global table, so creating either kind costs a single arena
+// allocation.
+class QSchemeEnvironmentPrivate : public QSchemeHeapObject
+{
+public:
+    QSchemeValue outer;
+    QSchemeValueList slotNames;
+    QVarLengthArray<QSchemeValue, 4> slotValues;
+    QHash<QSchemeSymbol, QSchemeValue> symtab;
+
+    inline QSchemeValue *binding(const QSchemeValue &symbol);
+
+    // Create the frame for a call of lambda, the returned frame is owned by handle.
+    // The second overload moves the arguments into the frame.
+    static QSchemeEnvironmentPrivate *makeFrame(const QSchemeLambdaObject *lambda, const QSchemeValue &arguments,
+                                                QSchemeValue &handle);
+    static QSchemeEnvironmentPrivate *makeFrame(const QSchemeLambdaObject *lambda, QSchemeValue *arguments,
+                                                int argumentCount, QSchemeValue &handle);
+};
+
+// Builtins that the analyzer and the bytecode compiler handle themselves.
+namespace QSchemeBuiltins {
+
+enum class Syntax { Other, Quote, Lambda, Closure, Define, If, Eval, Apply };
+enum class Procedure {
+    Other, Car, Cdr, Cons, Eq,
+    Add, Subtract, Multiply, NumberEqual, Less, Greater, LessEqual, GreaterEqual
+};
+
+Syntax classify(QSchemeValue::foreign_syntax_t syntax);
+Procedure classify(QSchemeValue::foreign_proc_t procedure);
+
+QSchemeValue::foreign_syntax_t closureSyntax();
+
+// Builtins by the name they are registered under. The closure syntax is
+// named too, with a name no script can refer to. name() returns the empty
+// symbol for anything that is not a builtin.
+QSchemeSymbol name(const QSchemeValue &builtin);
+bool lookup(const QSchemeSymbol &name, QSchemeValue *builtin);
+
+} // namespace QSchemeBuiltins
+
+// Procedures implemented outside of qscheme.cpp are registered through
+// tables of these, terminated by an entry without a name.
+struct QSchemeBuiltinProcedure
+{
+    const char *name;
+    QSchemeValue::foreign_proc_t proc;
+};
+
+namespace QSchemeVectors {
+extern const QSchemeBuiltinProcedure procedures[];
+}
+
+namespace QSchemeHashTables {
+extern const QSchemeBuiltinProcedure procedures[];
+}
+
+namespace QSchemeParallel {
+extern const QSchemeBuiltinProcedure procedures[];
+}
+
+namespace QSchemeProcesses {
+extern const QSchemeBuiltinProcedure procedures[];
+}
+
+namespace QSchemeBuildGraphs {
+extern const QSchemeBuiltinProcedure procedures[];
+}
+
+namespace QSchemeFiles {
+extern const QSchemeBuiltinProcedure procedures[];
+}
+
+namespace QSchemeOutputFiles {
+extern const QSchemeBuiltinProcedure procedures[];
+}
+
+namespace QSchemeCounters {
+extern const QSchemeBuiltinProcedure procedures[];
+}
+
+namespace QSchemePrinting {
+extern const QSchemeBuiltinProcedure procedures[];
+}
+
+// The QDataStream format of QSchemeValue: a tag, followed by the payload.
+// Lists are written as their element count, the elements and the tail, so
+// that only nesting recurses.
+namespace QSchemeSerialization {
+
+enum Tag : quint8 {
+    NilTag,
+    FalseTag,
+    TrueTag,
+    FixnumTag,  // qint64
+    FlonumTag,  // double
+    StringTag,  // QString
+    SymbolTag,  // QString
+    ListTag     // quint32 count, count values, tail value
+};
+
+} // namespace QSchemeSerialization
+
+// Calls a procedure from native code, e.g. a builtin that takes one as an
+// argument. Syntax needs an environment and cannot be called this way.
+QSchemeValue qt_scheme_call(const QSchemeValue &procedure, const QSchemeValue &arguments);
+
+// The exception builtins throw, "name: message".
+inline QSchemeException qt_scheme_error(const char *name, const QString &message)
+{
+    return QSchemeException(QString::fromLatin1(name) + QLatin1String(": ") + message);
+}
+
+inline QSchemeException qt_scheme_error(const char *name, const char *message)
+{
+    return qt_scheme_error(name, QString::fromLatin1(message));
+}
+
+// Set while the current thread runs items of QSchemeParallel::forEach().
+// Environments other than call frames are shared between the threads then,
+// so adding to their symtab is an error.
+extern thread_local bool qt_scheme_in_parallel;
+
+// Vectors and hash tables may be reached by several items of parallel code
+// at once, so builtins that modify them call this first.
+inline void qt_scheme_check_not_parallel(const char *name)
+{
+    if (Q_UNLIKELY(qt_scheme_in_parallel))
+        throw qt_scheme_error(name, "cannot modify shared data in parallel code");
+}
+
+extern QAtomicInt qt_scheme_recursion_limit;
+extern thread_local int qt_scheme_recursion_depth;
+
+// Counts nested evaluations on the current thread. Tail calls do not nest,
+// everything else does and would eventually overflow the native stack.
+struct QSchemeRecursionGuard
+{
+    inline QSchemeRecursionGuard() { enter(); }
+    inline ~QSchemeRecursionGuard() { --qt_scheme_recursion_depth; }
+
+    static inline void enter() {
+        if (Q_UNLIKELY(++qt_scheme_recursion_depth > qt_scheme_recursion_limit.load())) {
+            --qt_scheme_recursion_depth;
+            throw QSchemeException("Maximum recursion depth exceeded");
+        }
+    }
+};
+
+struct QSchemeValuePrivate
+{
+    static inline quint64 bits(const QSchemeValue &value) { return value.v; }
+
+    static inline bool isObject(const QSchemeValue &value, QSchemeValue::Type kind) {
+        return value.isHeapObject() && value.heapObject()->kind == quint8(kind);
+    }
+
+    template <typename T>
+    static inline T *object(const QSchemeValue &value) { return value.object<T>(); }
+
+    template <typename T>
+    static inline T *allocate(QSchemeValue::Type kind) {
+        quint8 sizeClass;
+        void *memory = QSchemeHeap::allocate(sizeof(T), quint8(kind), &sizeClass);
+        T *object = new (memory) T;
+        QT_SCHEME_COUNT(allocations);
+        object->ref.store(1);
+        object->kind = quint8(kind);
+        object->sizeClass = sizeClass;
+        object->gcFlags = 0;
+        return object;
+    }
+
+    template <typename T>
+    static inline void free(T *object) {
+        const quint8 sizeClass = object->sizeClass;
+        object->~T();
+        QSchemeHeap::deallocate(object, sizeClass);
+    }
+
+    static inline void retain(QSchemeHeapObject *object) { object->ref.ref(); }
+    static inline void release(QSchemeHeapObject *object) {
+        if (!object->ref.deref())
+            QSchemeValue::destroy(object);
+    }
+
+    // takes over the reference of a freshly allocated object
+    static inline QSchemeValue adopt(QSchemeHeapObject *object) { return QSchemeValue(object); }
+
+    static inline QSchemeHeapObject *heapObject(const QSchemeValue &value) {
+        return value.isHeapObject() ? value.heapObject() : nullptr;
+    }
+
+    static inline QSchemeEnvironmentPrivate *environment(const QSchemeValue &value) {
+        return isObject(value, QSchemeValue::Type::Environment) ? value.object<QSchemeEnvironmentPrivate>()
+                                                               : nullptr;
+    }
+
+    static inline bool isCode(const QSchemeValue &value) {
+        return value.isHeapObject() && value.heapObject()->kind == QSchemeHeap::CodeKind;
+    }
+
+    static inline QSchemeValue unbound() {
+        QSchemeValue value;
+        value.v = QSchemeValue::UnboundValue;
+        return value;
+    }
+
+    static inline bool isUnbound(const QSchemeValue &value) { return value.v == QSchemeValue::UnboundValue; }
+
+    static inline bool isFixnum(const QSchemeValue &value) { return value.tag() == QSchemeValue::FixnumTag; }
+    static inline qint64 fixnum(const QSchemeValue &value) { return value.fixnum(); }
+
+    enum : qint64 {
+        FixnumMin = -(Q_INT64_C(1) << (QSchemeValue::PayloadBits - 1)),
+        FixnumMax = (Q_INT64_C(1) << (QSchemeValue::PayloadBits - 1)) - 1
+    };
+
+    static inline bool fitsFixnum(qint64 i) { return i >= FixnumMin && i <= FixnumMax; }
+
+    static inline QSchemeValue fromFixnum(qint64 i) {
+        Q_ASSERT(fitsFixnum(i));
+        QSchemeValue value;
+        value.v = (QSchemeValue::FixnumTag << QSchemeValue::PayloadBits) | (quint64(i) & QSchemeValue::PayloadMask);
+        return value;
+    }
+
+    // a fixnum if i fits one, the nearest double otherwise
+    static inline QSchemeValue integer(qint64 i) {
+        return fitsFixnum(i) ? fromFixnum(i) : QSchemeValue(double(i));
+    }
+    static inline double flonum(const QSchemeValue &value) { return value.flonum(); }
+
+    static inline bool isVariable(const QSchemeValue &value) {
+        return isObject(value, QSchemeValue::Type::Symbol);
+    }
+
+    static inline QSchemeVariableObject *variable(const QSchemeValue &value) {
+        return value.object<QSchemeVariableObject>();
+    }
+
+    static inline bool isPair(const QSchemeValue &value) {
+        return isObject(value, QSchemeValue::Type::Cons);
+    }
+
+    static inline QSchemePairObject *pair(const QSchemeValue &value) {
+        return value.object<QSchemePairObject>();
+    }
+};
+
+// Builds a list front to back by filling in the cdr of the last pair, which
+// no one else can see yet.
+class QSchemeListBuilder
+{
+public:
+    inline void append(const QSchemeValue &value) {
+        QSchemePairObject *pair = QSchemeValuePrivate::allocate<QSchemePairObject>(QSchemeValue::Type::Cons);
+        QT_SCHEME_COUNT(pairs);
+        pair->car = value;
+
+        if (m_last)
+            m_last->cdr = QSchemeValuePrivate::adopt(pair);
+        else
+            m_head = QSchemeValuePrivate::adopt(pair);
+        m_last = pair;
+    }
+
+    // ends the list with tail instead of nil
+    inline void setTail(const QSchemeValue &tail) {
+        if (m_last)
+            m_last->cdr = tail;
+        else
+            m_head = tail;
+    }
+
+    inline QSchemeValue result() const { return m_head; }
+
+private:
+    QSchemeValue m_head;
+    QSchemePairObject *m_last = nullptr;
+};
+
+QSchemeValue *QSchemeEnvironmentPrivate::binding(const QSchemeValue &symbol)
+{
+    for (int i = 0; i < slotNames.size(); ++i) {
+        if (QSchemeValuePrivate::bits(slotNames.at(i)) == QSchemeValuePrivate::bits(symbol))
+            return &slotValues[i];
+    }
+
+    if (symtab.isEmpty())
+        return nullptr;
+
+    const auto it = symtab.constFind(symbol.toSymbol());
+    return it != symtab.constEnd() ? &QSchemeValuePrivate::variable(*it)->value : nullptr;
+}
+
+QT_END_NAMESPACE
+
+#endif // QSCHEME_P_H
@@ -0,0 +1,498 @@
+#include "qschemebuild_p.h"
+#include "qschemefiles_p.h"
+#include "qschemeprocess_p.h"
+
+#include <exception>
+#include <queue>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+namespace {
+
+enum : quint32 {
+    Magic = 0x51534253, // "QSBS"
+    FormatVersion = 1
+};
+
+QString normalized(const QString &path)
+{
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+}
+
+QByteArray commandHash(const QSchemeBuildGraph::Target &target)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    // procedures cannot be compared across runs
+    if (target.command.isEmpty())
+        hash.addData("procedure");
+
+    for (const QString &part : target.command) {
+        hash.addData(part.toUtf8());
+        hash.addData("", 1);
+    }
+
+    return hash.result();
+}
+
+// empty if an input cannot be read
+QByteArray inputHash(const QStringList &inputs)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    for (const QString &input : inputs) {
+        QFile file(input);
+        if (!file.open(QIODevice::ReadOnly))
+            return QByteArray();
+
+        hash.addData(input.toUtf8());
+        hash.addData("", 1);
+        hash.addData(&file);
+    }
+
+    return hash.result();
+}
+
+} // namespace
+
+// A single run of QSchemeBuildGraph::build().
+class QSchemeBuild
+{
+public:
+    explicit QSchemeBuild(QSchemeBuildGraph *graph) : graph(graph) {}
+
+    QStringList run(const QStringList &names);
+
+private:
+    struct Node
+    {
+        QSchemeBuildGraph::Target target; // a copy, commands may declare targets
+        QVector<int> dependents;
+        int pending;      // prerequisites that are not complete yet
+        qint64 priority;  // the longest chain of work starting here
+    };
+
+    int visit(const QString &name, QStringList &path);
+    bool isStale(const Node &node) const;
+    void startNext();
+    void succeed(int index, qint64 duration);
+    void complete(int index);
+    void fail(const QSchemeException &exception);
+
+    QSchemeBuildGraph *const graph;
+
+    QHash<QString, QString> producers; // normalized output -> target
+    QHash<QString, int> indices;
+    QVector<Node> nodes; // prerequisites before their dependents
+
+    std::priority_queue<QPair<qint64, int>> ready; // priority, -index
+    int running = 0;
+    QObject *processes = nullptr; // their parent
+    QEventLoop *loop = nullptr;
+    QStringList ran;
+    std::exception_ptr failure;
+};
+
+// Adds name and its prerequisites to the nodes, depth first. path holds the
+// targets being visited, meeting one of them again means a cycle.
+int QSchemeBuild::visit(const QString &name, QStringList &path)
+{
+    const auto found = indices.constFind(name);
+    if (found != indices.constEnd())
+        return *found;
+
+    const int cycleStart = path.indexOf(name);
+    if (cycleStart >= 0) {
+        path.append(name);
+        throw qt_scheme_error("build", QLatin1String("dependency cycle: ") + path.mid(cycleStart).join(QLatin1String(" -> ")));
+    }
+
+    const auto it = graph->m_targets.constFind(name);
+    if (it == graph->m_targets.constEnd())
+        throw qt_scheme_error("build", QLatin1String("unknown target ") + name);
+
+    path.append(name);
+
+    QVector<int> prerequisites;
+    for (const QString &depend : it->depends)
+        prerequisites.append(visit(depend, path));
+
+    for (const QString &input : it->inputs) {
+        const QString producer = producers.value(normalized(input));
+        if (!producer.isEmpty() && producer != name)
+            prerequisites.append(visit(producer, path));
+        else if (producer.isEmpty() && !QFileInfo::exists(input))
+            throw qt_scheme_error("build", QLatin1String("no file or target for ") + input + QLatin1String(", needed by ") + name);
+    }
+
+    path.removeLast();
+
+    const int index = nodes.size();
+    for (int prerequisite : qAsConst(prerequisites))
+        nodes[prerequisite].dependents.append(index);
+
+    nodes.append(Node { *it, QVector<int>(), prerequisites.size(), 0 });
+    indices.insert(name, index);
+    return index;
+}
+
+bool QSchemeBuild::isStale(const Node &node) const
+{
+    const QSchemeBuildGraph::Target &target = node.target;
+    if (target.outputs.isEmpty())
+        return true;
+
+    const auto record = graph->m_records.constFind(target.name);
+    if (record != graph->m_records.constEnd() && record->commandHash != commandHash(target))
+        return true;
+
+    QDateTime oldestOutput;
+    for (const QString &output : target.outputs) {
+        const QFileInfo info(output);
+        if (!info.exists())
+            return true;
+        if (!oldestOutput.isValid() || info.lastModified() < oldestOutput)
+            oldestOutput = info.lastModified();
+    }
+
+    bool newerInput = false;
+    for (const QString &input : target.inputs) {
+        const QFileInfo info(input);
+        if (!info.exists())
+            return true;
+        newerInput = newerInput || info.lastModified() > oldestOutput;
+    }
+
+    if (!newerInput)
+        return false;
+
+    // an input was touched, it only counts if its contents changed too
+    return record == graph->m_records.constEnd() || record->inputHash.isEmpty()
+            || record->inputHash != inputHash(target.inputs);
+}
+
+QStringList QSchemeBuild::run(const QStringList &names)
+{
+    for (const QString &name : qAsConst(graph->m_order)) {
+        for (const QString &output : graph->m_targets.value(name).outputs)
+            producers.insert(normalized(output), name);
+    }
+
+    QStringList path;
+    for (const QString &name : names.isEmpty() ? graph->m_order : names)
+        visit(name, path);
+
+    // Dependents come after their prerequisites, so walking backwards sees
+    // every dependent's chain before the chains leading into it.
+    for (int i = nodes.size() - 1; i >= 0; --i) {
+        qint64 longest = 0;
+        for (int dependent : qAsConst(nodes.at(i).dependents))
+            longest = qMax(longest, nodes.at(dependent).priority);
+
+        const auto record = graph->m_records.constFind(nodes.at(i).target.name);
+        const qint64 cost = record != graph->m_records.constEnd() ? qMax(Q_INT64_C(1), record->duration) : 1;
+        nodes[i].priority = cost + longest;
+    }
+
+    for (int i = 0; i < nodes.size(); ++i) {
+        if (nodes.at(i).pending == 0)
+            ready.push(qMakePair(nodes.at(i).priority, -i));
+    }
+
+    QObject owner;
+    processes = &owner;
+    QEventLoop eventLoop;
+    loop = &eventLoop;
+
+    forever {
+        while (!failure && running < QSchemeProcesses::limit() && !ready.empty())
+            startNext();
+
+        if (running == 0)
+            break;
+
+        eventLoop.exec();
+    }
+
+    graph->saveState();
+
+    if (failure)
+        std::rethrow_exception(failure);
+
+    return ran;
+}
+
+void QSchemeBuild::startNext()
+{
+    const int index = -ready.top().second;
+    ready.pop();
+
+    const Node &node = nodes.at(index);
+    if (!isStale(node)) {
+        complete(index);
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (node.target.command.isEmpty()) {
+        try {
+            if (is_false(qt_scheme_call(node.target.procedure, QSchemeValue())))
+                fail(qt_scheme_error("build", node.target.name + QLatin1String(" failed")));
+            else
+                succeed(index, timer.elapsed());
+        } catch (...) {
+            if (!failure)
+                failure = std::current_exception();
+        }
+        return;
+    }
+
+    QProcess *process = new QProcess(processes);
+    process->setProcessChannelMode(QProcess::ForwardedChannels);
+    ++running;
+
+    QObject::connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+                     [this, index, timer](int exitCode, QProcess::ExitStatus status) {
+        --running;
+        if (status == QProcess::NormalExit && exitCode == 0) {
+            succeed(index, timer.elapsed());
+        } else {
+            fail(qt_scheme_error("build", nodes.at(index).target.name + QLatin1String(" failed with exit code ")
+                       + QString::number(status == QProcess::NormalExit ? exitCode : -1)));
+        }
+        loop->quit();
+    });
+
+    QObject::connect(process, &QProcess::errorOccurred, [this, index, process](QProcess::ProcessError processError) {
+        if (processError != QProcess::FailedToStart)
+            return;
+
+        --running;
+        fail(qt_scheme_error("build", nodes.at(index).target.name + QLatin1String(": ") + process->errorString()));
+        loop->quit();
+    });
+
+    QStringList arguments = node.target.command;
+    process->start(arguments.takeFirst(), arguments);
+}
+
+void QSchemeBuild::succeed(int index, qint64 duration)
+{
+    const QSchemeBuildGraph::Target &target = nodes.at(index).target;
+
+    for (const QString &output : target.outputs)
+        QSchemeFiles::invalidate(output);
+
+    const QSchemeBuildGraph::Record record = { commandHash(target), inputHash(target.inputs), duration };
+    graph->m_records.insert(target.name, record);
+    ran.append(target.name);
+
+    complete(index);
+}
+
+void QSchemeBuild::complete(int index)
+{
+    for (int dependent : qAsConst(nodes.at(index).dependents)) {
+        if (--nodes[dependent].pending == 0)
+            ready.push(qMakePair(nodes.at(dependent).priority, -dependent));
+    }
+}
+
+// Nothing new starts after a failure, commands that are running finish.
+void QSchemeBuild::fail(const QSchemeException &exception)
+{
+    if (!failure)
+        failure = std::make_exception_ptr(exception);
+}
+
+QSchemeBuildGraph *QSchemeBuildGraph::instance(const char *name)
+{
+    static QSchemeBuildGraph graph;
+    static QAtomicPointer<QThread> owner;
+
+    if (qt_scheme_in_parallel)
+        throw qt_scheme_error(name, "cannot be used in parallel code");
+
+    QThread *const current = QThread::currentThread();
+    if (!owner.testAndSetOrdered(nullptr, current) && owner.loadAcquire() != current)
+        throw qt_scheme_error(name, "can only be used from the thread that declared the first target");
+
+    return &graph;
+}
+
+void QSchemeBuildGraph::addTarget(const Target &target)
+{
+    if (!m_targets.contains(target.name))
+        m_order.append(target.name);
+    m_targets.insert(target.name, target);
+}
+
+void QSchemeBuildGraph::setStateFile(const QString &path)
+{
+    m_stateFile = path;
+    m_records.clear();
+    m_stateLoaded = false;
+}
+
+QStringList QSchemeBuildGraph::build(const QStringList &names)
+{
+    static bool building = false;
+    if (building)
+        throw qt_scheme_error("build", "cannot build from inside a build");
+
+    building = true;
+    loadState();
+
+    try {
+        QSchemeBuild build(this);
+        const QStringList ran = build.run(names);
+        building = false;
+        return ran;
+    } catch (...) {
+        building = false;
+        throw;
+    }
+}
+
+void QSchemeBuildGraph::loadState()
+{
+    if (m_stateLoaded)
+        return;
+
+    m_stateLoaded = true;
+
+    QFile file(m_stateFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if (magic != Magic || version != FormatVersion)
+        return;
+
+    QHash<QString, Record> records;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString name;
+        Record record;
+        stream >> name >> record.commandHash >> record.inputHash >> record.duration;
+        records.insert(name, record);
+    }
+
+    // a damaged file is the same as none, everything gets rebuilt
+    if (stream.status() == QDataStream::Ok)
+        m_records = records;
+}
+
+void QSchemeBuildGraph::saveState() const
+{
+    QSaveFile file(m_stateFile);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    stream << quint32(Magic) << quint32(FormatVersion) << quint32(m_records.size());
+    for (auto it = m_records.cbegin(); it != m_records.cend(); ++it)
+        stream << it.key() << it.value().commandHash << it.value().inputHash << it.value().duration;
+
+    if (stream.status() == QDataStream::Ok)
+        file.commit();
+    else
+        file.cancelWriting();
+}
+
+namespace {
+
+// Strings or symbols, a single one counts as a list of one.
+QStringList names(const QSchemeValue &value, const char *name)
+{
+    QStringList result;
+
+    const QSchemeValue list = is_list(value) ? value : cons(value, QSchemeValue());
+    for (QSchemeValue it = list; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr) {
+        const QSchemeValue item = QSchemeValuePrivate::pair(it)->car;
+        if (is_string(item))
+            result.append(item.toString());
+        else if (is_symbol(item))
+            result.append(item.toSymbol().toString());
+        else
+            throw qt_scheme_error(name, "expected strings or symbols");
+    }
+
+    return result;
+}
+
+// (build-target name (input ...) (output ...) command [(depend ...)]) where
+// command is a list of a program and its arguments, or a procedure taking
+// no arguments
+QSchemeValue build_target(const QSchemeValue &arguments)
+{
+    QSchemeBuildGraph::Target target;
+
+    const QStringList name = names(car(arguments), "build-target");
+    if (name.size() != 1)
+        throw qt_scheme_error("build-target", "expected a target name");
+
+    target.name = name.first();
+    target.inputs = names(cadr(arguments), "build-target");
+    target.outputs = names(caddr(arguments), "build-target");
+
+    const QSchemeValue command = cadddr(arguments);
+    if (is_foreign_procedure(command) || is_native_procedure(command)) {
+        target.procedure = command;
+    } else {
+        target.command = names(command, "build-target");
+        if (target.command.isEmpty())
+            throw qt_scheme_error("build-target", "expected a command");
+    }
+
+    const QSchemeValue rest = cddddr(arguments);
+    if (is_pair(rest))
+        target.depends = names(car(rest), "build-target");
+
+    QSchemeBuildGraph::instance("build-target")->addTarget(target);
+    return car(arguments);
+}
+
+// (build [target ...]) -> the targets that were rebuilt
+QSchemeValue build_build(const QSchemeValue &arguments)
+{
+    QSchemeListBuilder result;
+    for (const QString &target : QSchemeBuildGraph::instance("build")->build(names(arguments, "build")))
+        result.append(QSchemeValue(target));
+    return result.result();
+}
+
+QSchemeValue build_state_file(const QSchemeValue &arguments)
+{
+    const QSchemeValue path = car(arguments);
+    if (!is_string(path))
+        throw qt_scheme_error("build-state-file", "expected a path");
+
+    QSchemeBuildGraph::instance("build-state-file")->setStateFile(path.toString());
+    return path;
+}
+
+} // namespace
+
+namespace QSchemeBuildGraphs {
+
+const QSchemeBuiltinProcedure procedures[] = {
+    { "build-target", build_target },
+    { "build", build_build },
+    { "build-state-file", build_state_file },
+
+    { nullptr, nullptr }
+};
+
+} // namespace QSchemeBuildGraphs
+
+QT_END_NAMESPACE
@@ -0,0 +1,84 @@
+#ifndef QSCHEMEBUILD_P_H
+#define QSCHEMEBUILD_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// The targets declared by build-target and the state of earlier builds.
+//
+// A target depends on the targets it names explicitly and on those whose
+// outputs it takes as inputs. It is out of date when an output is missing,
+// when it has no outputs at all, when its command changed, or when an input
+// is newer than its oldest output and the contents of its inputs differ
+// from the last time it was built.
+//
+// Commands are either a program and its arguments, run as a process, or a
+// procedure, called on the building thread. Processes run in parallel up to
+// QSchemeEnvironment::maximumProcessCount(). Targets that are ready to run
+// are started in the order of the longest chain of work still behind them,
+// as measured by earlier builds, so long chains are not started last.
+//
+// The graph is global and belongs to the thread that first uses it, the
+// builtins throw when called from any other thread or from parallel code.
+class QSchemeBuildGraph
+{
+public:
+    struct Target
+    {
+        QString name;
+        QStringList inputs;
+        QStringList outputs;
+        QStringList depends;    // names of other targets
+        QStringList command;    // program and arguments, empty for a procedure
+        QSchemeValue procedure; // called without arguments, #f means failure
+    };
+
+    struct Record
+    {
+        QByteArray commandHash;
+        QByteArray inputHash;   // empty when not known
+        qint64 duration;        // milliseconds
+    };
+
+    // name is the builtin asking, for errors
+    static QSchemeBuildGraph *instance(const char *name);
+
+    void addTarget(const Target &target);
+
+    // Where the records of earlier builds are kept, .qremake.state in the
+    // current directory by default.
+    void setStateFile(const QString &path);
+
+    // Brings the targets in names and everything they depend on up to date,
+    // all targets when names is empty, and returns the targets whose command
+    // ran. Throws when a command fails or the targets form a cycle.
+    QStringList build(const QStringList &names);
+
+private:
+    void loadState();
+    void saveState() const;
+
+    QHash<QString, Target> m_targets;
+    QStringList m_order; // declaration order, builds are deterministic
+    QString m_stateFile = QStringLiteral(".qremake.state");
+    QHash<QString, Record> m_records;
+    bool m_stateLoaded = false;
+
+    friend class QSchemeBuild;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEBUILD_P_H
@@ -0,0 +1,258 @@
+#include "qschemecache_p.h"
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+
+enum : quint32 {
+    Magic = 0x5153434d, // "QSCM"
+    FormatVersion = 2
+};
+
+struct CacheDirectory
+{
+    QReadWriteLock lock;
+    QString path;
+};
+
+// Decodes values in their QDataStream format straight from the mapped
+// image. Going through QDataStream would cost a QIODevice read per field,
+// which makes reading the image no faster than parsing the source.
+class ImageDecoder
+{
+public:
+    ImageDecoder(const uchar *data, qint64 size) : m_it(data), m_end(data + size) {}
+
+    bool atEnd() const { return m_it == m_end; }
+    bool decode(QSchemeValue *value);
+
+private:
+    template <typename T>
+    bool read(T *result) {
+        if (m_end - m_it < qint64(sizeof(T)))
+            return false;
+
+        *result = qFromBigEndian<T>(m_it);
+        m_it += sizeof(T);
+        return true;
+    }
+
+    bool readString(QVarLengthArray<QChar, 128> *string);
+
+    const uchar *m_it;
+    const uchar *const m_end;
+    int m_depth = 0;
+};
+
+bool ImageDecoder::readString(QVarLengthArray<QChar, 128> *string)
+{
+    quint32 bytes;
+    if (!read(&bytes))
+        return false;
+
+    string->clear();
+
+    // null strings are written with a length of 0xffffffff
+    if (bytes == 0xffffffff)
+        return true;
+
+    if (bytes % 2 || m_end - m_it < qint64(bytes))
+        return false;
+
+    string->resize(int(bytes / 2));
+    for (int i = 0; i < string->size(); ++i, m_it += 2)
+        (*string)[i] = QChar(qFromBigEndian<quint16>(m_it));
+
+    return true;
+}
+
+bool ImageDecoder::decode(QSchemeValue *value)
+{
+    using namespace QSchemeSerialization;
+
+    quint8 tag;
+    if (!read(&tag))
+        return false;
+
+    switch (tag) {
+    case NilTag:
+        *value = QSchemeValue();
+        return true;
+
+    case FalseTag:
+    case TrueTag:
+        *value = QSchemeValue(tag == TrueTag);
+        return true;
+
+    case FixnumTag: {
+        qint64 fixnum;
+        if (!read(&fixnum) || !QSchemeValuePrivate::fitsFixnum(fixnum))
+            return false;
+
+        *value = QSchemeValuePrivate::fromFixnum(fixnum);
+        return true;
+    }
+
+    case FlonumTag: {
+        quint64 bits;
+        if (!read(&bits))
+            return false;
+
+        double flonum;
+        memcpy(&flonum, &bits, sizeof(flonum));
+        *value = QSchemeValue(flonum);
+        return true;
+    }
+
+    case StringTag:
+    case SymbolTag: {
+        QVarLengthArray<QChar, 128> string;
+        if (!readString(&string))
+            return false;
+
+        const QStringView view(string.constData(), string.size());
+        if (tag == StringTag)
+            *value = QSchemeValue(view.toString());
+        else
+            *value = QSchemeValue(QSchemeSymbol(view));
+        return true;
+    }
+
+    case ListTag: {
+        quint32 count;
+        if (!read(&count) || m_depth >= QSchemeEnvironment::maximumRecursionDepth())
+            return false;
+
+        ++m_depth;
+
+        QVarLengthArray<QSchemeValue, 16> items;
+        QSchemeValue tail;
+        bool ok = true;
+
+        for (quint32 i = 0; i < count && ok; ++i) {
+            QSchemeValue item;
+            ok = decode(&item);
+            items.append(item);
+        }
+
+        --m_depth;
+
+        if (!ok || !decode(&tail))
+            return false;
+
+        for (int i = items.size() - 1; i >= 0; --i)
+            tail = QtSchemeFunctions::cons(items.at(i), tail);
+
+        *value = tail;
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+Q_GLOBAL_STATIC(CacheDirectory, cacheDirectory)
+
+void QSchemeScriptCache::setDirectory(const QString &path)
+{
+    QWriteLocker locker(&cacheDirectory()->lock);
+    cacheDirectory()->path = path;
+}
+
+QString QSchemeScriptCache::directory()
+{
+    QReadLocker locker(&cacheDirectory()->lock);
+    return cacheDirectory()->path;
+}
+
+QSchemeScriptCache::QSchemeScriptCache(QFile *source)
+{
+    const QString dir = directory();
+    if (dir.isEmpty())
+        return;
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    const qint64 size = source->size();
+    if (uchar *data = size > 0 ? source->map(0, size) : nullptr) {
+        hash.addData(reinterpret_cast<const char *>(data), int(size));
+        source->unmap(data);
+    } else {
+        hash.addData(source->readAll());
+        source->seek(0);
+    }
+
+    m_key = hash.result();
+    m_path = dir + QLatin1Char('/') + QString::fromLatin1(m_key.toHex()) + QLatin1String(".qsc");
+}
+
+bool QSchemeScriptCache::lookup(QSchemeValueList *program) const
+{
+    if (m_path.isEmpty())
+        return false;
+
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = file.size();
+    const uchar *data = file.map(0, size);
+    if (!data)
+        return false;
+
+    // the header is small, QDataStream is fine for it
+    QDataStream stream(QByteArray::fromRawData(reinterpret_cast<const char *>(data), int(size)));
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic, version;
+    QByteArray key;
+    stream >> magic >> version >> key;
+
+    if (stream.status() != QDataStream::Ok || magic != Magic || version != FormatVersion || key != m_key)
+        return false;
+
+    const qint64 headerSize = stream.device()->pos();
+    ImageDecoder decoder(data + headerSize, size - headerSize);
+
+    QSchemeValueList values;
+    while (!decoder.atEnd()) {
+        QSchemeValue value;
+        if (!decoder.decode(&value))
+            return false;
+
+        values.append(value);
+    }
+
+    *program = values;
+    return true;
+}
+
+void QSchemeScriptCache::store(const QSchemeValueList &program) const
+{
+    if (m_path.isEmpty() || !QDir().mkpath(QFileInfo(m_path).path()))
+        return;
+
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << quint32(Magic) << quint32(FormatVersion) << m_key;
+
+    for (const QSchemeValue &value : program)
+        stream << value;
+
+    if (stream.status() != QDataStream::Ok) {
+        file.cancelWriting();
+        return;
+    }
+
+    file.commit();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,46 @@
+#ifndef QSCHEMECACHE_P_H
+#define QSCHEMECACHE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme.h"
+
+QT_BEGIN_NAMESPACE
+
+// Parsed scripts, stored in the QDataStream format of QSchemeValue under the
+// hash of their source. Loading an unchanged script maps the stored image
+// instead of reading the source again.
+//
+// Entries are never invalidated, a changed script simply hashes to a new
+// one. They are written through QSaveFile, so concurrent runs either see a
+// complete entry or none.
+class QSchemeScriptCache
+{
+public:
+    // Hashes the contents of the open source file. Without a directory the
+    // cache is disabled and does nothing.
+    explicit QSchemeScriptCache(QFile *source);
+
+    static void setDirectory(const QString &path);
+    static QString directory();
+
+    bool lookup(QSchemeValueList *program) const;
+    void store(const QSchemeValueList &program) const;
+
+private:
+    QString m_path;
+    QByteArray m_key;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMECACHE_P_H
@@ -0,0 +1,484 @@
+#include "qschemefiles_p.h"
+#include "qschemecache_p.h"
+#include "qschemeparallel_p.h"
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+namespace {
+
+enum : quint32 {
+    Magic = 0x51534443, // "QSDC"
+    FormatVersion = 1
+};
+
+// directories modified more recently than this are not stored
+enum { RacyInterval = 3000 };
+
+struct Listing
+{
+    qint64 modified;
+    QVector<QSchemeFiles::Entry> entries;
+    bool storable;
+};
+
+struct Cache
+{
+    QReadWriteLock lock;
+    QHash<QString, QSchemeFiles::Stat> stats;
+    QHash<QString, Listing> listings; // read by this process
+    QHash<QString, Listing> stored;   // read from the script cache, to be validated
+    bool loaded = false;
+    bool dirty = false;
+};
+
+Q_GLOBAL_STATIC(Cache, cache)
+
+QString normalized(const QString &path)
+{
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+}
+
+QString listingsPath()
+{
+    const QString directory = QSchemeScriptCache::directory();
+    return directory.isEmpty() ? QString() : directory + QLatin1String("/directories.qsd");
+}
+
+// with the cache locked for writing
+void loadStored()
+{
+    if (cache()->loaded)
+        return;
+
+    cache()->loaded = true;
+
+    QFile file(listingsPath());
+    if (file.fileName().isEmpty() || !file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if (magic != Magic || version != FormatVersion)
+        return;
+
+    QHash<QString, Listing> stored;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString path;
+        quint32 entryCount;
+        Listing listing = { 0, QVector<QSchemeFiles::Entry>(), true };
+        stream >> path >> listing.modified >> entryCount;
+
+        for (quint32 j = 0; j < entryCount && stream.status() == QDataStream::Ok; ++j) {
+            QSchemeFiles::Entry entry;
+            stream >> entry.name >> entry.flags;
+            listing.entries.append(entry);
+        }
+
+        stored.insert(path, listing);
+    }
+
+    if (stream.status() == QDataStream::Ok)
+        cache()->stored = stored;
+}
+
+bool isWildcard(const QString &segment)
+{
+    for (QChar c : segment) {
+        if (c == QLatin1Char('*') || c == QLatin1Char('?') || c == QLatin1Char('['))
+            return true;
+    }
+    return false;
+}
+
+// Matches a whole name against *, ? and [...], where [!...] negates and
+// a-z ranges are allowed. A [ without a closing ] is literal.
+bool wildcardMatch(const QChar *p, const QChar *pEnd, const QChar *s, const QChar *sEnd)
+{
+    while (p != pEnd) {
+        if (*p == QLatin1Char('*')) {
+            ++p;
+            for (;; ++s) {
+                if (wildcardMatch(p, pEnd, s, sEnd))
+                    return true;
+                if (s == sEnd)
+                    return false;
+            }
+        }
+
+        if (s == sEnd)
+            return false;
+
+        if (*p == QLatin1Char('[')) {
+            const QChar *q = p + 1;
+            const bool negate = q != pEnd && (*q == QLatin1Char('!') || *q == QLatin1Char('^'));
+            if (negate)
+                ++q;
+
+            const QChar *first = q;
+            bool matched = false;
+            while (q != pEnd && (*q != QLatin1Char(']') || q == first)) {
+                if (pEnd - q > 2 && q[1] == QLatin1Char('-') && q[2] != QLatin1Char(']')) {
+                    matched = matched || (*s >= q[0] && *s <= q[2]);
+                    q += 3;
+                } else {
+                    matched = matched || *s == *q;
+                    ++q;
+                }
+            }
+
+            if (q != pEnd) {
+                if (matched == negate)
+                    return false;
+                p = q + 1;
+                ++s;
+                continue;
+            }
+        } else if (*p == QLatin1Char('?')) {
+            ++p;
+            ++s;
+            continue;
+        }
+
+        if (*p != *s)
+            return false;
+        ++p;
+        ++s;
+    }
+
+    return s == sEnd;
+}
+
+bool wildcardMatch(const QString &pattern, const QString &name)
+{
+    return wildcardMatch(pattern.constData(), pattern.constData() + pattern.size(),
+                         name.constData(), name.constData() + name.size());
+}
+
+QString join(const QString &directory, const QString &name)
+{
+    if (directory.isEmpty())
+        return name;
+    if (directory.endsWith(QLatin1Char('/')))
+        return directory + name;
+    return directory + QLatin1Char('/') + name;
+}
+
+// A directory yet to be matched against segments from segment on. prefix is
+// the same directory as it is returned, relative when the pattern is.
+struct Walk
+{
+    QString directory;
+    QString prefix;
+    int segment;
+};
+
+} // namespace
+
+namespace QSchemeFiles {
+
+Stat stat(const QString &path)
+{
+    const QString key = normalized(path);
+
+    {
+        QReadLocker locker(&cache()->lock);
+        const auto it = cache()->stats.constFind(key);
+        if (it != cache()->stats.constEnd())
+            return *it;
+    }
+
+    const QFileInfo info(key);
+    const bool exists = info.exists();
+    const Stat result = { exists, exists && info.isDir(), exists ? info.lastModified().toMSecsSinceEpoch() : 0 };
+
+    QWriteLocker locker(&cache()->lock);
+    cache()->stats.insert(key, result);
+    return result;
+}
+
+bool list(const QString &path, QVector<Entry> *entries)
+{
+    const QString key = normalized(path);
+    const Stat directory = stat(key);
+    if (!directory.isDirectory)
+        return false;
+
+    {
+        QReadLocker locker(&cache()->lock);
+        const auto it = cache()->listings.constFind(key);
+        if (it != cache()->listings.constEnd()) {
+            *entries = it->entries;
+            return true;
+        }
+    }
+
+    {
+        QWriteLocker locker(&cache()->lock);
+        loadStored();
+
+        const auto it = cache()->stored.constFind(key);
+        if (it != cache()->stored.constEnd() && it->modified == directory.modified) {
+            cache()->listings.insert(key, *it);
+            *entries = it->entries;
+            return true;
+        }
+    }
+
+    Listing listing = { directory.modified, QVector<Entry>(), false };
+
+    QDirIterator it(key, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+
+        Entry entry = { info.fileName(), 0 };
+        if (info.isDir())
+            entry.flags |= Entry::Directory;
+        if (info.isSymLink())
+            entry.flags |= Entry::SymLink;
+        listing.entries.append(entry);
+    }
+
+    std::sort(listing.entries.begin(), listing.entries.end(), [](const Entry &a, const Entry &b) {
+        return a.name < b.name;
+    });
+
+    listing.storable = QDateTime::currentMSecsSinceEpoch() - directory.modified > RacyInterval;
+
+    QWriteLocker locker(&cache()->lock);
+    cache()->listings.insert(key, listing);
+    cache()->dirty = cache()->dirty || listing.storable;
+
+    *entries = listing.entries;
+    return true;
+}
+
+QStringList glob(const QString &pattern)
+{
+    const bool absolute = pattern.startsWith(QLatin1Char('/'));
+    const QStringList segments = pattern.split(QLatin1Char('/'), QString::SkipEmptyParts);
+
+    QSet<QString> matches;
+    QSet<QString> seen; // ** reaches the same walk more than once
+    QVector<Walk> walks = {
+        { absolute ? QDir::rootPath() : QDir::currentPath(), absolute ? QStringLiteral("/") : QString(), 0 }
+    };
+
+    while (!walks.isEmpty()) {
+        // list the directories of this level in parallel first
+        QStringList directories;
+        for (const Walk &walk : qAsConst(walks)) {
+            if (walk.segment < segments.size() && isWildcard(segments.at(walk.segment)))
+                directories.append(walk.directory);
+        }
+        directories.removeDuplicates();
+
+        QSchemeParallel::forEach(directories.size(), [&directories](int index) {
+            QVector<Entry> entries;
+            list(directories.at(index), &entries);
+        });
+
+        QVector<Walk> next;
+        for (const Walk &walk : qAsConst(walks)) {
+            if (walk.segment == segments.size()) {
+                if (!walk.prefix.isEmpty())
+                    matches.insert(walk.prefix);
+                continue;
+            }
+
+            const QString &segment = segments.at(walk.segment);
+            const bool last = walk.segment + 1 == segments.size();
+
+            if (!isWildcard(segment)) {
+                const QString path = join(walk.directory, segment);
+                const Stat info = stat(path);
+                if (last && info.exists)
+                    matches.insert(join(walk.prefix, segment));
+                else if (!last && info.isDirectory)
+                    next.append({ path, join(walk.prefix, segment), walk.segment + 1 });
+                continue;
+            }
+
+            QVector<Entry> entries;
+            if (!list(walk.directory, &entries))
+                continue;
+
+            if (segment == QLatin1String("**")) {
+                const QString key = walk.prefix + QChar(0) + QString::number(walk.segment);
+                if (seen.contains(key))
+                    continue;
+                seen.insert(key);
+
+                next.append({ walk.directory, walk.prefix, walk.segment + 1 });
+                for (const Entry &entry : qAsConst(entries)) {
+                    // symbolic links are not followed, they may form loops
+                    if (entry.flags == Entry::Directory && !entry.name.startsWith(QLatin1Char('.')))
+                        next.append({ join(walk.directory, entry.name), join(walk.prefix, entry.name), walk.segment });
+                }
+                continue;
+            }
+
+            for (const Entry &entry : qAsConst(entries)) {
+                // hidden files only match patterns asking for them
+                if (entry.name.startsWith(QLatin1Char('.')) && !segment.startsWith(QLatin1Char('.')))
+                    continue;
+                if (!wildcardMatch(segment, entry.name))
+                    continue;
+
+                if (last)
+                    matches.insert(join(walk.prefix, entry.name));
+                else if (entry.flags & Entry::Directory)
+                    next.append({ join(walk.directory, entry.name), join(walk.prefix, entry.name), walk.segment + 1 });
+            }
+        }
+
+        walks = next;
+    }
+
+    QStringList result = matches.values();
+    result.sort();
+    return result;
+}
+
+void invalidate(const QString &path)
+{
+    const QString key = normalized(path);
+    const QString directory = QFileInfo(key).path();
+
+    QWriteLocker locker(&cache()->lock);
+    cache()->stats.remove(key);
+    cache()->stats.remove(directory);
+    cache()->listings.remove(key);
+    cache()->listings.remove(directory);
+}
+
+void invalidateAll()
+{
+    QWriteLocker locker(&cache()->lock);
+
+    for (auto it = cache()->listings.cbegin(); it != cache()->listings.cend(); ++it) {
+        if (it->storable)
+            cache()->stored.insert(it.key(), *it);
+    }
+
+    cache()->stats.clear();
+    cache()->listings.clear();
+}
+
+void saveListings()
+{
+    QWriteLocker locker(&cache()->lock);
+    if (!cache()->dirty)
+        return;
+
+    cache()->dirty = false;
+
+    const QString path = listingsPath();
+    if (path.isEmpty() || !QDir().mkpath(QFileInfo(path).path()))
+        return;
+
+    for (auto it = cache()->listings.cbegin(); it != cache()->listings.cend(); ++it) {
+        if (it->storable)
+            cache()->stored.insert(it.key(), *it);
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << quint32(Magic) << quint32(FormatVersion) << quint32(cache()->stored.size());
+
+    for (auto it = cache()->stored.cbegin(); it != cache()->stored.cend(); ++it) {
+        stream << it.key() << it->modified << quint32(it->entries.size());
+        for (const Entry &entry : it->entries)
+            stream << entry.name << entry.flags;
+    }
+
+    if (stream.status() == QDataStream::Ok)
+        file.commit();
+    else
+        file.cancelWriting();
+}
+
+} // namespace QSchemeFiles
+
+namespace {
+
+QString path(const QSchemeValue &value, const char *name)
+{
+    if (!is_string(value))
+        throw qt_scheme_error(name, "expected a path");
+
+    return value.toString();
+}
+
+QSchemeValue file_exists(const QSchemeValue &arguments)
+{
+    return QSchemeValue(QSchemeFiles::stat(path(car(arguments), "file-exists?")).exists);
+}
+
+// (file-mtime path) -> milliseconds since the epoch, #f if there is no file
+QSchemeValue file_mtime(const QSchemeValue &arguments)
+{
+    const QSchemeFiles::Stat info = QSchemeFiles::stat(path(car(arguments), "file-mtime"));
+    return info.exists ? QSchemeValuePrivate::integer(info.modified) : QSchemeValue(false);
+}
+
+// (directory-list path) -> the names in it, sorted
+QSchemeValue directory_list(const QSchemeValue &arguments)
+{
+    const QString directory = path(car(arguments), "directory-list");
+
+    QVector<QSchemeFiles::Entry> entries;
+    if (!QSchemeFiles::list(directory, &entries))
+        throw qt_scheme_error("directory-list", QLatin1String("cannot list ") + directory);
+
+    QSchemeListBuilder result;
+    for (const QSchemeFiles::Entry &entry : qAsConst(entries))
+        result.append(QSchemeValue(entry.name));
+    return result.result();
+}
+
+// (glob pattern ...) -> the paths matching any of the patterns, sorted
+QSchemeValue glob(const QSchemeValue &arguments)
+{
+    QStringList paths;
+    for (QSchemeValue it = arguments; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        paths += QSchemeFiles::glob(path(QSchemeValuePrivate::pair(it)->car, "glob"));
+
+    if (is_pair(cdr(arguments))) {
+        paths.sort();
+        paths.removeDuplicates();
+    }
+
+    QSchemeListBuilder result;
+    for (const QString &match : qAsConst(paths))
+        result.append(QSchemeValue(match));
+    return result.result();
+}
+
+} // namespace
+
+namespace QSchemeFiles {
+
+const QSchemeBuiltinProcedure procedures[] = {
+    { "file-exists?", file_exists },
+    { "file-mtime", file_mtime },
+    { "directory-list", directory_list },
+    { "glob", glob },
+
+    { nullptr, nullptr }
+};
+
+} // namespace QSchemeFiles
+
+QT_END_NAMESPACE
@@ -0,0 +1,77 @@
+#ifndef QSCHEMEFILES_P_H
+#define QSCHEMEFILES_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// What file-exists?, file-mtime, directory-list and glob know about the file
+// system. Every path is stat'ed and every directory listed at most once
+// until a process started by the scripts finishes, other changes made
+// meanwhile go unnoticed.
+//
+// Listings are also kept in the script cache directory between runs, and
+// are used again as long as the modification time of their directory is
+// unchanged. Listings of directories modified in the last few seconds are
+// not stored, a change within the same timestamp would be missed otherwise.
+//
+// All functions are thread-safe, glob lists directories in parallel.
+namespace QSchemeFiles {
+
+struct Stat
+{
+    bool exists;
+    bool isDirectory;
+    qint64 modified; // milliseconds since the epoch
+};
+
+struct Entry
+{
+    enum Flag : quint8 {
+        Directory = 0x1,
+        SymLink = 0x2
+    };
+
+    QString name;
+    quint8 flags;
+};
+
+Stat stat(const QString &path);
+
+// The entries of a directory sorted by name, without . and .., or false if
+// it cannot be listed.
+bool list(const QString &path, QVector<Entry> *entries);
+
+// Paths matching a pattern of *, ? and [...] in each segment, and ** for
+// any number of directories, sorted.
+QStringList glob(const QString &pattern);
+
+// Forgets what is known about path and the directory containing it, after
+// this process changed it.
+void invalidate(const QString &path);
+
+// Forgets everything, after a child process may have changed any file.
+// Listings are kept for saveListings(), they are checked against the
+// modification time of their directory before being used again.
+void invalidateAll();
+
+// Writes the listings read since the last call to the script cache. Called
+// when load() is done, not after every directory read.
+void saveListings();
+
+} // namespace QSchemeFiles
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEFILES_P_H
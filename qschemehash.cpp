@@ -0,0 +1,388 @@
+#include "qschemehash_p.h"
+
+#include <cmath>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+namespace {
+
+typedef QSchemeHashTableObject::Slot Slot;
+typedef QSchemeHashTableObject::Equivalence Equivalence;
+
+enum { MinimumCapacity = 8 };
+
+inline uint mix(quint64 bits)
+{
+    // the finalizer of MurmurHash3, spreads fixnums and pointers that only
+    // differ in a few low bits over the whole table
+    bits ^= bits >> 33;
+    bits *= Q_UINT64_C(0xff51afd7ed558ccd);
+    bits ^= bits >> 33;
+    bits *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    bits ^= bits >> 33;
+    return uint(bits);
+}
+
+uint hashEqual(const QSchemeValue &key)
+{
+    switch (key.type()) {
+    case QSchemeValue::Type::Number: {
+        if (QSchemeValuePrivate::isFixnum(key))
+            return mix(quint64(QSchemeValuePrivate::fixnum(key)));
+
+        // integral doubles are equal to the fixnum of the same value
+        const double d = QSchemeValuePrivate::flonum(key);
+        if (std::trunc(d) == d && d >= double(QSchemeValuePrivate::FixnumMin)
+                && d <= double(QSchemeValuePrivate::FixnumMax)) {
+            return mix(quint64(qint64(d)));
+        }
+        return mix(QSchemeValuePrivate::bits(key));
+    }
+
+    case QSchemeValue::Type::Symbol:
+        return mix(quint64(key.toSymbol().id()));
+
+    case QSchemeValue::Type::String:
+        return qHash(QSchemeValuePrivate::object<QSchemeStringObject>(key)->string);
+
+    case QSchemeValue::Type::Cons: {
+        if (!QSchemeValuePrivate::isPair(key))
+            return mix(QSchemeValuePrivate::bits(key));
+
+        uint h = 1;
+        const QSchemeValue *it = &key;
+        for (; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr)
+            h = 31 * h + hashEqual(QSchemeValuePrivate::pair(*it)->car);
+        return 31 * h + hashEqual(*it);
+    }
+
+    default:
+        // everything else is only equal to itself
+        return mix(QSchemeValuePrivate::bits(key));
+    }
+}
+
+inline bool equivalent(const QSchemeValue &a, const QSchemeValue &b, Equivalence equivalence)
+{
+    if (equivalence == Equivalence::Eq)
+        return QSchemeValuePrivate::bits(a) == QSchemeValuePrivate::bits(b);
+    return a == b;
+}
+
+inline bool isFree(const Slot &slot)
+{
+    return QSchemeValuePrivate::isUnbound(slot.key);
+}
+
+inline Slot freeSlot()
+{
+    return Slot { QSchemeValuePrivate::unbound(), QSchemeValue(), 0 };
+}
+
+// The slot holding key, or the free slot where it would be inserted. The
+// table needs at least one free slot.
+int probe(const QSchemeHashTableObject *table, const QSchemeValue &key, uint hash)
+{
+    const int mask = table->slots.size() - 1;
+
+    for (int i = int(hash) & mask; ; i = (i + 1) & mask) {
+        const Slot &slot = table->slots.at(i);
+        if (isFree(slot) || (slot.hash == hash && equivalent(slot.key, key, table->equivalence)))
+            return i;
+    }
+}
+
+void rehash(QSchemeHashTableObject *table, int capacity)
+{
+    QVector<Slot> slots(capacity, freeSlot());
+    const int mask = capacity - 1;
+
+    for (Slot &slot : table->slots) {
+        if (isFree(slot))
+            continue;
+
+        int i = int(slot.hash) & mask;
+        while (!isFree(slots.at(i)))
+            i = (i + 1) & mask;
+        slots[i] = std::move(slot);
+    }
+
+    table->slots.swap(slots);
+}
+
+// tables are kept at most three quarters full
+inline int capacityFor(int count)
+{
+    const int needed = int((qint64(count) * 4 + 2) / 3) + 1;
+    return needed <= MinimumCapacity ? int(MinimumCapacity) : int(qNextPowerOfTwo(quint32(needed - 1)));
+}
+
+} // namespace
+
+namespace QSchemeHashTables {
+
+uint hash(const QSchemeValue &key, Equivalence equivalence)
+{
+    if (equivalence == Equivalence::Eq)
+        return mix(QSchemeValuePrivate::bits(key));
+    return hashEqual(key);
+}
+
+const QSchemeValue *find(const QSchemeHashTableObject *table, const QSchemeValue &key)
+{
+    if (table->count == 0)
+        return nullptr;
+
+    const Slot &slot = table->slots.at(probe(table, key, hash(key, table->equivalence)));
+    return isFree(slot) ? nullptr : &slot.value;
+}
+
+void insert(QSchemeHashTableObject *table, const QSchemeValue &key, const QSchemeValue &value)
+{
+    const uint h = hash(key, table->equivalence);
+
+    if (table->slots.isEmpty())
+        rehash(table, MinimumCapacity);
+
+    int i = probe(table, key, h);
+    if (!isFree(table->slots.at(i))) {
+        table->slots[i].value = value;
+        return;
+    }
+
+    if (capacityFor(table->count + 1) > table->slots.size()) {
+        rehash(table, table->slots.size() * 2);
+        i = probe(table, key, h);
+    }
+
+    Slot &slot = table->slots[i];
+    slot.key = key;
+    slot.value = value;
+    slot.hash = h;
+    ++table->count;
+}
+
+// Removal shifts the entries following the removed one back into the gap
+// where their probe sequence allows it, so lookups never need tombstones.
+bool remove(QSchemeHashTableObject *table, const QSchemeValue &key)
+{
+    if (table->count == 0)
+        return false;
+
+    int hole = probe(table, key, hash(key, table->equivalence));
+    if (isFree(table->slots.at(hole)))
+        return false;
+
+    const int mask = table->slots.size() - 1;
+    for (int i = (hole + 1) & mask; !isFree(table->slots.at(i)); i = (i + 1) & mask) {
+        const int home = int(table->slots.at(i).hash) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table->slots[hole] = std::move(table->slots[i]);
+            hole = i;
+        }
+    }
+
+    table->slots[hole] = freeSlot();
+    --table->count;
+    return true;
+}
+
+void reserve(QSchemeHashTableObject *table, int count)
+{
+    const int capacity = capacityFor(count);
+    if (capacity > table->slots.size())
+        rehash(table, capacity);
+}
+
+} // namespace QSchemeHashTables
+
+namespace {
+
+QSchemeHashTableObject *table(const QSchemeValue &value, const char *name)
+{
+    if (value.type() != QSchemeValue::Type::HashTable)
+        throw qt_scheme_error(name, "expected a hash table");
+
+    return QSchemeValuePrivate::object<QSchemeHashTableObject>(value);
+}
+
+// 'eq or 'equal, equal when absent
+Equivalence equivalence(const QSchemeValue &arguments, const char *name)
+{
+    if (!is_pair(arguments))
+        return Equivalence::Equal;
+
+    const QSchemeValue value = car(arguments);
+    if (is_symbol(value)) {
+        const QSchemeSymbol symbol = value.toSymbol();
+        if (symbol == QSchemeSymbolLiteral("eq"))
+            return Equivalence::Eq;
+        if (symbol == QSchemeSymbolLiteral("equal"))
+            return Equivalence::Equal;
+    }
+
+    throw qt_scheme_error(name, "expected 'eq or 'equal");
+}
+
+QSchemeValue make(Equivalence equivalence, QSchemeHashTableObject **object)
+{
+    *object = QSchemeValuePrivate::allocate<QSchemeHashTableObject>(QSchemeValue::Type::HashTable);
+    (*object)->equivalence = equivalence;
+    return QSchemeValuePrivate::adopt(*object);
+}
+
+// Collects key, value or both of every entry, in table order.
+template <typename Function>
+QSchemeValue collect(const QSchemeHashTableObject *table, Function function)
+{
+    QSchemeValue result;
+    for (const Slot &slot : table->slots) {
+        if (!isFree(slot))
+            result = cons(function(slot), result);
+    }
+    return result;
+}
+
+// (make-hash-table ['eq | 'equal])
+QSchemeValue hash_make(const QSchemeValue &arguments)
+{
+    QSchemeHashTableObject *object;
+    return make(equivalence(arguments, "make-hash-table"), &object);
+}
+
+// (list->hash-table alist ['eq | 'equal]), later entries replace earlier
+// ones with the same key
+QSchemeValue hash_from_list(const QSchemeValue &arguments)
+{
+    const QSchemeValue alist = car(arguments);
+
+    int count = 0;
+    QSchemeValue it = alist;
+    for (; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr) {
+        if (!is_pair(QSchemeValuePrivate::pair(it)->car))
+            throw qt_scheme_error("list->hash-table", "expected a list of pairs");
+        ++count;
+    }
+
+    if (!is_null(it))
+        throw qt_scheme_error("list->hash-table", "expected a proper list");
+
+    QSchemeHashTableObject *object;
+    const QSchemeValue result = make(equivalence(cdr(arguments), "list->hash-table"), &object);
+
+    QSchemeHashTables::reserve(object, count);
+    for (it = alist; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr) {
+        const QSchemePairObject *entry = QSchemeValuePrivate::pair(QSchemeValuePrivate::pair(it)->car);
+        QSchemeHashTables::insert(object, entry->car, entry->cdr);
+    }
+
+    return result;
+}
+
+QSchemeValue hash_tablep(const QSchemeValue &arguments)
+{
+    return QSchemeValue(car(arguments).type() == QSchemeValue::Type::HashTable);
+}
+
+QSchemeValue hash_count(const QSchemeValue &arguments)
+{
+    return QSchemeValue(table(car(arguments), "hash-count")->count);
+}
+
+// (hash-ref table key [default]), without a default a missing key is an error
+QSchemeValue hash_ref(const QSchemeValue &arguments)
+{
+    const QSchemeValue *value = QSchemeHashTables::find(table(car(arguments), "hash-ref"), cadr(arguments));
+    if (value)
+        return *value;
+
+    if (!is_pair(cddr(arguments)))
+        throw qt_scheme_error("hash-ref", "no value for key");
+
+    return caddr(arguments);
+}
+
+QSchemeValue hash_containsp(const QSchemeValue &arguments)
+{
+    return QSchemeValue(QSchemeHashTables::find(table(car(arguments), "hash-contains?"), cadr(arguments)) != nullptr);
+}
+
+QSchemeValue hash_set(const QSchemeValue &arguments)
+{
+    qt_scheme_check_not_parallel("hash-set!");
+    const QSchemeValue value = caddr(arguments);
+    QSchemeHashTables::insert(table(car(arguments), "hash-set!"), cadr(arguments), value);
+    return value;
+}
+
+// (hash-update! table key proc [default]) stores the result of calling proc
+// with the current value, or with default when key is missing
+QSchemeValue hash_update(const QSchemeValue &arguments)
+{
+    qt_scheme_check_not_parallel("hash-update!");
+    QSchemeHashTableObject *object = table(car(arguments), "hash-update!");
+    const QSchemeValue key = cadr(arguments);
+    const QSchemeValue rest = cddr(arguments);
+
+    QSchemeValue current;
+    if (const QSchemeValue *value = QSchemeHashTables::find(object, key))
+        current = *value;
+    else if (is_pair(cdr(rest)))
+        current = cadr(rest);
+    else
+        throw qt_scheme_error("hash-update!", "no value for key");
+
+    // the procedure may modify the table, so look the key up again
+    const QSchemeValue value = qt_scheme_call(car(rest), cons(current, QSchemeValue()));
+    QSchemeHashTables::insert(object, key, value);
+    return value;
+}
+
+QSchemeValue hash_remove(const QSchemeValue &arguments)
+{
+    qt_scheme_check_not_parallel("hash-remove!");
+    return QSchemeValue(QSchemeHashTables::remove(table(car(arguments), "hash-remove!"), cadr(arguments)));
+}
+
+QSchemeValue hash_keys(const QSchemeValue &arguments)
+{
+    return collect(table(car(arguments), "hash-keys"), [](const Slot &slot) { return slot.key; });
+}
+
+QSchemeValue hash_values(const QSchemeValue &arguments)
+{
+    return collect(table(car(arguments), "hash-values"), [](const Slot &slot) { return slot.value; });
+}
+
+QSchemeValue hash_to_list(const QSchemeValue &arguments)
+{
+    return collect(table(car(arguments), "hash->list"),
+                   [](const Slot &slot) { return cons(slot.key, slot.value); });
+}
+
+} // namespace
+
+namespace QSchemeHashTables {
+
+const QSchemeBuiltinProcedure procedures[] = {
+    { "make-hash-table", hash_make },
+    { "list->hash-table", hash_from_list },
+    { "hash-table?", hash_tablep },
+    { "hash-count", hash_count },
+    { "hash-ref", hash_ref },
+    { "hash-contains?", hash_containsp },
+    { "hash-set!", hash_set },
+    { "hash-update!", hash_update },
+    { "hash-remove!", hash_remove },
+    { "hash-keys", hash_keys },
+    { "hash-values", hash_values },
+    { "hash->list", hash_to_list },
+
+    { nullptr, nullptr }
+};
+
+} // namespace QSchemeHashTables
+
+QT_END_NAMESPACE
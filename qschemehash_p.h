@@ -0,0 +1,39 @@
+#ifndef QSCHEMEHASH_P_H
+#define QSCHEMEHASH_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// Operations on QSchemeHashTableObject. Keys are hashed straight from the
+// value: symbols by id, numbers by value, strings by their characters and
+// lists by their elements. A key that is mutated while it is in an equal
+// table cannot be found anymore.
+namespace QSchemeHashTables {
+
+uint hash(const QSchemeValue &key, QSchemeHashTableObject::Equivalence equivalence);
+
+// nullptr if key is not in table
+const QSchemeValue *find(const QSchemeHashTableObject *table, const QSchemeValue &key);
+void insert(QSchemeHashTableObject *table, const QSchemeValue &key, const QSchemeValue &value);
+bool remove(QSchemeHashTableObject *table, const QSchemeValue &key);
+
+// makes room for count entries without growing again
+void reserve(QSchemeHashTableObject *table, int count);
+
+} // namespace QSchemeHashTables
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEHASH_P_H
@@ -0,0 +1,444 @@
+#include "qschemeheap_p.h"
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+
+enum {
+    Granularity = 16,
+    SizeClassCount = 32, // objects of up to 512 bytes live in arenas
+    ChunkSize = 64 * 1024,
+    MinimumCollectionThreshold = 16 * 1024
+};
+
+enum GcFlag {
+    Reachable = 0x1
+};
+
+// Layout of a slot on a free list. kind overlays QSchemeHeapObject::kind, so
+// walking a chunk can tell free slots from live objects.
+struct FreeSlot
+{
+    QAtomicInt ref;
+    quint8 kind;
+    quint8 sizeClass;
+    quint8 gcFlags;
+    FreeSlot *next;
+};
+
+struct Chunk
+{
+    char *begin;
+    char *bump; // first slot that was never handed out
+    char *end;
+};
+
+struct SizeClass
+{
+    QMutex mutex;
+    QVector<Chunk *> chunks;
+    FreeSlot *orphans = nullptr; // free slots left behind by finished threads
+};
+
+struct HeapState
+{
+    SizeClass classes[SizeClassCount];
+
+    QMutex largeObjectMutex;
+    QSet<QSchemeHeapObject *> largeObjects;
+
+    QAtomicInt containerAllocations;
+    QAtomicInt suspended;
+    int threshold = MinimumCollectionThreshold;
+    bool collecting = false;
+
+    qint64 collections = 0;
+    qint64 collected = 0;
+};
+
+Q_GLOBAL_STATIC(HeapState, heapState)
+
+struct ThreadCache
+{
+    FreeSlot *freeList[SizeClassCount] = {};
+    Chunk *chunk[SizeClassCount] = {};
+
+    ~ThreadCache();
+};
+
+static thread_local ThreadCache threadCache;
+static thread_local bool threadCacheDestroyed = false;
+
+static inline size_t slotSize(int sizeClass)
+{
+    return size_t(sizeClass + 1) * Granularity;
+}
+
+static void pushOrphans(int sizeClass, FreeSlot *first)
+{
+    HeapState *heap = heapState();
+    if (!heap || !first)
+        return;
+
+    FreeSlot *last = first;
+    while (last->next)
+        last = last->next;
+
+    SizeClass &cls = heap->classes[sizeClass];
+    QMutexLocker locker(&cls.mutex);
+    last->next = cls.orphans;
+    cls.orphans = first;
+}
+
+ThreadCache::~ThreadCache()
+{
+    for (int i = 0; i < SizeClassCount; ++i)
+        pushOrphans(i, freeList[i]);
+
+    threadCacheDestroyed = true;
+}
+
+static inline bool isContainer(quint8 kind)
+{
+    if (kind == QSchemeHeap::CodeKind)
+        return true;
+
+    switch (QSchemeValue::Type(kind)) {
+    case QSchemeValue::Type::Cons:
+    case QSchemeValue::Type::LambdaProcedure:
+    case QSchemeValue::Type::Environment:
+    case QSchemeValue::Type::Symbol:
+    case QSchemeValue::Type::Vector:
+    case QSchemeValue::Type::HashTable:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline QSchemeHeapObject *container(const QSchemeValue &value)
+{
+    QSchemeHeapObject *object = QSchemeValuePrivate::heapObject(value);
+    return object && isContainer(object->kind) ? object : nullptr;
+}
+
+template <typename Visitor>
+static void visitChildren(QSchemeHeapObject *object, Visitor visit)
+{
+    const auto visitValue = [&visit](const QSchemeValue &value) {
+        if (QSchemeHeapObject *child = container(value))
+            visit(child);
+    };
+
+    if (object->kind == QSchemeHeap::CodeKind) {
+        const QSchemeCodeObject *code = static_cast<QSchemeCodeObject *>(object);
+        for (const QSchemeValue &constant : code->constants)
+            visitValue(constant);
+        visitValue(code->body);
+        return;
+    }
+
+    switch (QSchemeValue::Type(object->kind)) {
+    case QSchemeValue::Type::Cons: {
+        const QSchemePairObject *pair = static_cast<QSchemePairObject *>(object);
+        visitValue(pair->car);
+        visitValue(pair->cdr);
+    }
+        break;
+
+    case QSchemeValue::Type::LambdaProcedure: {
+        const QSchemeLambdaObject *lambda = static_cast<QSchemeLambdaObject *>(object);
+        for (const QSchemeValue &argname : lambda->argnames)
+            visitValue(argname);
+        visitValue(lambda->body);
+        visitValue(lambda->environment);
+        visitValue(lambda->code);
+    }
+        break;
+
+    case QSchemeValue::Type::Environment: {
+        const QSchemeEnvironmentPrivate *env = static_cast<QSchemeEnvironmentPrivate *>(object);
+        visitValue(env->outer);
+        for (const QSchemeValue &value : env->slotValues)
+            visitValue(value);
+        for (const QSchemeValue &value : env->symtab)
+            visitValue(value);
+    }
+        break;
+
+    case QSchemeValue::Type::Symbol:
+        visitValue(static_cast<QSchemeVariableObject *>(object)->value);
+        break;
+
+    case QSchemeValue::Type::Vector:
+        for (const QSchemeValue &item : static_cast<QSchemeVectorObject *>(object)->items)
+            visitValue(item);
+        break;
+
+    case QSchemeValue::Type::HashTable:
+        for (const QSchemeHashTableObject::Slot &slot : static_cast<QSchemeHashTableObject *>(object)->slots) {
+            visitValue(slot.key);
+            visitValue(slot.value);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+// Drops every reference an object holds, which breaks the cycles it is in.
+static void clearReferences(QSchemeHeapObject *object)
+{
+    if (object->kind == QSchemeHeap::CodeKind) {
+        QSchemeCodeObject *code = static_cast<QSchemeCodeObject *>(object);
+        code->constants.clear();
+        code->body = QSchemeValue();
+        return;
+    }
+
+    switch (QSchemeValue::Type(object->kind)) {
+    case QSchemeValue::Type::Cons: {
+        QSchemePairObject *pair = static_cast<QSchemePairObject *>(object);
+        pair->car = QSchemeValue();
+        pair->cdr = QSchemeValue();
+    }
+        break;
+
+    case QSchemeValue::Type::LambdaProcedure: {
+        QSchemeLambdaObject *lambda = static_cast<QSchemeLambdaObject *>(object);
+        lambda->argnames.clear();
+        lambda->body = QSchemeValue();
+        lambda->environment = QSchemeValue();
+        lambda->code = QSchemeValue();
+    }
+        break;
+
+    case QSchemeValue::Type::Environment: {
+        QSchemeEnvironmentPrivate *env = static_cast<QSchemeEnvironmentPrivate *>(object);
+        env->outer = QSchemeValue();
+        env->slotValues.clear();
+        QHash<QSchemeSymbol, QSchemeValue> symtab;
+        qSwap(symtab, env->symtab);
+    }
+        break;
+
+    case QSchemeValue::Type::Symbol:
+        static_cast<QSchemeVariableObject *>(object)->value = QSchemeValue();
+        break;
+
+    case QSchemeValue::Type::Vector:
+        static_cast<QSchemeVectorObject *>(object)->items.clear();
+        break;
+
+    case QSchemeValue::Type::HashTable: {
+        QSchemeHashTableObject *table = static_cast<QSchemeHashTableObject *>(object);
+        table->slots.clear();
+        table->count = 0;
+    }
+        break;
+
+    default:
+        break;
+    }
+}
+
+template <typename Function>
+static void forEachObject(HeapState *heap, Function function)
+{
+    for (int i = 0; i < SizeClassCount; ++i) {
+        const size_t size = slotSize(i);
+        for (const Chunk *chunk : heap->classes[i].chunks) {
+            for (char *slot = chunk->begin; slot < chunk->bump; slot += size) {
+                QSchemeHeapObject *object = reinterpret_cast<QSchemeHeapObject *>(slot);
+                if (object->kind != QSchemeHeap::FreeKind)
+                    function(object);
+            }
+        }
+    }
+
+    for (QSchemeHeapObject *object : heap->largeObjects)
+        function(object);
+}
+
+} // namespace
+
+void *QSchemeHeap::allocate(size_t size, quint8 kind, quint8 *sizeClass)
+{
+    HeapState *heap = heapState();
+
+    if (isContainer(kind) && heap->containerAllocations.fetchAndAddRelaxed(1) >= heap->threshold)
+        collect();
+
+    const size_t index = (size + Granularity - 1) / Granularity - 1;
+
+    if (Q_UNLIKELY(index >= SizeClassCount)) {
+        QSchemeHeapObject *object = static_cast<QSchemeHeapObject *>(::operator new(size));
+        QMutexLocker locker(&heap->largeObjectMutex);
+        heap->largeObjects.insert(object);
+        *sizeClass = LargeObject;
+        return object;
+    }
+
+    *sizeClass = quint8(index);
+
+    if (Q_UNLIKELY(threadCacheDestroyed)) {
+        // allocating during thread shutdown, bypass the cache
+        return ::operator new(slotSize(int(index)));
+    }
+
+    ThreadCache &cache = threadCache;
+
+    if (FreeSlot *slot = cache.freeList[index]) {
+        cache.freeList[index] = slot->next;
+        return slot;
+    }
+
+    SizeClass &cls = heap->classes[index];
+
+    if (cls.orphans) {
+        QMutexLocker locker(&cls.mutex);
+        if (FreeSlot *slot = cls.orphans) {
+            cache.freeList[index] = slot->next;
+            cls.orphans = nullptr;
+            return slot;
+        }
+    }
+
+    const size_t step = slotSize(int(index));
+    Chunk *chunk = cache.chunk[index];
+
+    if (!chunk || chunk->bump + step > chunk->end) {
+        chunk = new Chunk;
+        chunk->begin = static_cast<char *>(::operator new(ChunkSize));
+        chunk->bump = chunk->begin;
+        chunk->end = chunk->begin + ChunkSize;
+        cache.chunk[index] = chunk;
+
+        QMutexLocker locker(&cls.mutex);
+        cls.chunks.append(chunk);
+    }
+
+    void *memory = chunk->bump;
+    chunk->bump += step;
+    return memory;
+}
+
+void QSchemeHeap::deallocate(void *memory, quint8 sizeClass)
+{
+    if (Q_UNLIKELY(sizeClass == LargeObject)) {
+        if (HeapState *heap = heapState()) {
+            QMutexLocker locker(&heap->largeObjectMutex);
+            heap->largeObjects.remove(static_cast<QSchemeHeapObject *>(memory));
+        }
+        ::operator delete(memory);
+        return;
+    }
+
+    FreeSlot *slot = static_cast<FreeSlot *>(memory);
+    slot->kind = FreeKind;
+    slot->next = nullptr;
+
+    if (Q_UNLIKELY(threadCacheDestroyed)) {
+        pushOrphans(sizeClass, slot);
+        return;
+    }
+
+    slot->next = threadCache.freeList[sizeClass];
+    threadCache.freeList[sizeClass] = slot;
+}
+
+int QSchemeHeap::collect()
+{
+    HeapState *heap = heapState();
+    if (!heap || heap->collecting || heap->suspended.loadAcquire() > 0)
+        return 0;
+
+    heap->collecting = true;
+    heap->containerAllocations.store(0);
+
+    // Start from the reference counts and subtract every reference that comes
+    // from another heap object. Whatever is left is held from the C++ side.
+    QVector<QSchemeHeapObject *> containers;
+    forEachObject(heap, [&containers](QSchemeHeapObject *object) {
+        if (isContainer(object->kind)) {
+            object->gcRefs = object->ref.load();
+            object->gcFlags = 0;
+            containers.append(object);
+        }
+    });
+
+    for (QSchemeHeapObject *object : qAsConst(containers))
+        visitChildren(object, [](QSchemeHeapObject *child) { --child->gcRefs; });
+
+    QVector<QSchemeHeapObject *> pending;
+    for (QSchemeHeapObject *object : qAsConst(containers)) {
+        if (object->gcRefs > 0) {
+            object->gcFlags |= Reachable;
+            pending.append(object);
+        }
+    }
+
+    while (!pending.isEmpty()) {
+        visitChildren(pending.takeLast(), [&pending](QSchemeHeapObject *child) {
+            if (!(child->gcFlags & Reachable)) {
+                child->gcFlags |= Reachable;
+                pending.append(child);
+            }
+        });
+    }
+
+    QVector<QSchemeHeapObject *> garbage;
+    for (QSchemeHeapObject *object : qAsConst(containers)) {
+        if (!(object->gcFlags & Reachable))
+            garbage.append(object);
+    }
+
+    // Keep the garbage alive while breaking its references, then drop it.
+    for (QSchemeHeapObject *object : qAsConst(garbage))
+        QSchemeValuePrivate::retain(object);
+    for (QSchemeHeapObject *object : qAsConst(garbage))
+        clearReferences(object);
+    for (QSchemeHeapObject *object : qAsConst(garbage))
+        QSchemeValuePrivate::release(object);
+
+    heap->threshold = qMax(int(MinimumCollectionThreshold), containers.size() - garbage.size());
+    heap->collections++;
+    heap->collected += garbage.size();
+    heap->collecting = false;
+
+    return garbage.size();
+}
+
+void QSchemeHeap::suspendCollection()
+{
+    heapState()->suspended.ref();
+}
+
+void QSchemeHeap::resumeCollection()
+{
+    heapState()->suspended.deref();
+}
+
+QSchemeHeap::Statistics QSchemeHeap::statistics()
+{
+    HeapState *heap = heapState();
+    Statistics stats = {};
+
+    for (SizeClass &cls : heap->classes) {
+        QMutexLocker locker(&cls.mutex);
+        stats.arenaBytes += qint64(cls.chunks.size()) * ChunkSize;
+    }
+
+    {
+        QMutexLocker locker(&heap->largeObjectMutex);
+        stats.largeObjects = heap->largeObjects.size();
+    }
+
+    stats.collections = heap->collections;
+    stats.collected = heap->collected;
+    return stats;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,57 @@
+#ifndef QSCHEMEHEAP_P_H
+#define QSCHEMEHEAP_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme.h"
+
+QT_BEGIN_NAMESPACE
+
+// Storage for all heap allocated values.
+//
+// Objects are carved out of 64k arena chunks, one set of chunks per 16 byte
+// size class, and recycled through per-thread free lists. Reference counting
+// frees acyclic garbage immediately; collect() reclaims the cycles refcounting
+// cannot, using trial deletion: every reference an object receives that is
+// not accounted for by another heap object comes from the C++ side and makes
+// it a root, so embedders never have to register roots explicitly.
+class QSchemeHeap
+{
+public:
+    enum { LargeObject = 0xff };
+    enum { FreeKind = 0xff };
+    enum { CodeKind = 0x20 }; // internal objects that are not QSchemeValue::Types
+
+    static void *allocate(size_t size, quint8 kind, quint8 *sizeClass);
+    static void deallocate(void *memory, quint8 sizeClass);
+
+    static int collect();
+
+    // Collection walks every object and must not run while other threads
+    // use the heap. While suspended, collect() does nothing and the next
+    // allocation after resuming catches up.
+    static void suspendCollection();
+    static void resumeCollection();
+
+    struct Statistics {
+        qint64 arenaBytes;
+        qint64 largeObjects;
+        qint64 collections;
+        qint64 collected;
+    };
+
+    static Statistics statistics();
+};
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEHEAP_P_H
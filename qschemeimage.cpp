@@ -0,0 +1,1161 @@
+#include "qschemeimage_p.h"
+#include "qschemehash_p.h"
+#include "qschemevm_p.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+
+enum : quint32 {
+    Magic = 0x5153494d, // "QSIM"
+    FormatVersion = 3
+};
+
+// Layout, all integers big endian:
+//
+//   magic, version, key                   quint32, quint32, QByteArray
+//   symbols                               quint32 count, QString names
+//   object kinds                          quint32 count, quint8 kinds
+//   globals                               quint32 count, (quint32 symbol, quint32 cell) pairs
+//   object fields                         in object order, see writeObject()
+//
+// Values are a tag followed by its payload.
+enum ValueTag : quint8 {
+    NilValue,
+    FalseValue,
+    TrueValue,
+    UnboundValue,
+    FixnumValue,    // qint64
+    FlonumValue,    // double
+    SymbolValue,    // quint32 symbol
+    ObjectValue,    // quint32 object
+    RootValue,      // the environment the image is restored into
+    BuiltinValue,   // quint32 symbol, a builtin of that name
+    ForeignValue    // quint32 symbol, the foreign procedure bound to it when restoring
+};
+
+inline bool isStorableKind(quint8 kind)
+{
+    if (kind == QSchemeHeap::CodeKind)
+        return true;
+
+    switch (QSchemeValue::Type(kind)) {
+    case QSchemeValue::Type::String:
+    case QSchemeValue::Type::Cons:
+    case QSchemeValue::Type::Symbol:
+    case QSchemeValue::Type::LambdaProcedure:
+    case QSchemeValue::Type::Environment:
+    case QSchemeValue::Type::Vector:
+    case QSchemeValue::Type::Bytevector:
+    case QSchemeValue::Type::F64Vector:
+    case QSchemeValue::Type::HashTable:
+        return true;
+    default:
+        return false;
+    }
+}
+
+inline bool isForeign(const QSchemeValue &value)
+{
+    return value.type() == QSchemeValue::Type::ForeignProcedure
+            || value.type() == QSchemeValue::Type::ForeignSyntax;
+}
+
+inline bool isPlainSymbol(const QSchemeValue &value)
+{
+    return value.type() == QSchemeValue::Type::Symbol && !QSchemeValuePrivate::isVariable(value);
+}
+
+class ImageWriter
+{
+public:
+    explicit ImageWriter(const QSchemeEnvironmentPrivate *root);
+
+    // Numbers every object reachable from the root, fails if some value
+    // cannot be stored.
+    bool collect();
+    void write(QDataStream &stream, const QByteArray &key) const;
+
+private:
+    bool add(const QSchemeValue &value);
+    bool addChildren(const QSchemeHeapObject *object);
+    void addSymbol(const QSchemeSymbol &symbol);
+
+    void writeValue(QDataStream &stream, const QSchemeValue &value) const;
+    void writeList(QDataStream &stream, const QSchemeValueList &list) const;
+    void writeObject(QDataStream &stream, const QSchemeHeapObject *object) const;
+
+    const QSchemeEnvironmentPrivate *root;
+    QVector<const QSchemeHeapObject *> objects;
+    QHash<const QSchemeHeapObject *, quint32> objectIndices;
+    QVector<QSchemeSymbol> symbols;
+    QHash<int, quint32> symbolIndices;
+    QHash<quint64, QSchemeSymbol> foreignNames; // foreign procedures defined by the embedder
+};
+
+ImageWriter::ImageWriter(const QSchemeEnvironmentPrivate *root)
+    : root(root)
+{
+    for (auto it = root->symtab.cbegin(); it != root->symtab.cend(); ++it) {
+        const QSchemeValue &value = QSchemeValuePrivate::variable(*it)->value;
+        const quint64 bits = QSchemeValuePrivate::bits(value);
+
+        if (isForeign(value) && QSchemeBuiltins::name(value) == QSchemeSymbol() && !foreignNames.contains(bits))
+            foreignNames.insert(bits, it.key());
+    }
+}
+
+void ImageWriter::addSymbol(const QSchemeSymbol &symbol)
+{
+    if (symbolIndices.contains(symbol.id()))
+        return;
+
+    symbolIndices.insert(symbol.id(), quint32(symbols.size()));
+    symbols.append(symbol);
+}
+
+bool ImageWriter::add(const QSchemeValue &value)
+{
+    if (isForeign(value)) {
+        QSchemeSymbol name = QSchemeBuiltins::name(value);
+        if (name == QSchemeSymbol())
+            name = foreignNames.value(QSchemeValuePrivate::bits(value));
+        if (name == QSchemeSymbol())
+            return false;
+
+        addSymbol(name);
+        return true;
+    }
+
+    if (isPlainSymbol(value)) {
+        addSymbol(value.toSymbol());
+        return true;
+    }
+
+    const QSchemeHeapObject *object = QSchemeValuePrivate::heapObject(value);
+    if (!object || object == root || objectIndices.contains(object))
+        return true;
+
+    if (!isStorableKind(object->kind))
+        return false;
+
+    objectIndices.insert(object, quint32(objects.size()));
+    objects.append(object);
+    return true;
+}
+
+bool ImageWriter::addChildren(const QSchemeHeapObject *object)
+{
+    const auto addAll = [this](const QSchemeValueList &values) {
+        for (const QSchemeValue &value : values) {
+            if (!add(value))
+                return false;
+        }
+        return true;
+    };
+
+    if (object->kind == QSchemeHeap::CodeKind) {
+        const QSchemeCodeObject *code = static_cast<const QSchemeCodeObject *>(object);
+        return addAll(code->argnames) && addAll(code->slotNames) && add(code->body);
+    }
+
+    switch (QSchemeValue::Type(object->kind)) {
+    case QSchemeValue::Type::Cons: {
+        const QSchemePairObject *pair = static_cast<const QSchemePairObject *>(object);
+        return add(pair->car) && add(pair->cdr);
+    }
+
+    case QSchemeValue::Type::Symbol: {
+        const QSchemeVariableObject *variable = static_cast<const QSchemeVariableObject *>(object);
+        return add(variable->name) && add(variable->value);
+    }
+
+    case QSchemeValue::Type::LambdaProcedure: {
+        const QSchemeLambdaObject *lambda = static_cast<const QSchemeLambdaObject *>(object);
+        return addAll(lambda->argnames) && addAll(lambda->slotNames) && add(lambda->body)
+                && add(lambda->environment) && add(lambda->code);
+    }
+
+    case QSchemeValue::Type::Environment: {
+        const QSchemeEnvironmentPrivate *env = static_cast<const QSchemeEnvironmentPrivate *>(object);
+        if (!add(env->outer) || !addAll(env->slotNames))
+            return false;
+
+        for (const QSchemeValue &value : env->slotValues) {
+            if (!add(value))
+                return false;
+        }
+
+        for (auto it = env->symtab.cbegin(); it != env->symtab.cend(); ++it) {
+            addSymbol(it.key());
+            if (!add(it.value()))
+                return false;
+        }
+        return true;
+    }
+
+    case QSchemeValue::Type::Vector:
+        return addAll(static_cast<const QSchemeVectorObject *>(object)->items);
+
+    case QSchemeValue::Type::HashTable:
+        for (const QSchemeHashTableObject::Slot &slot : static_cast<const QSchemeHashTableObject *>(object)->slots) {
+            if (!QSchemeValuePrivate::isUnbound(slot.key) && (!add(slot.key) || !add(slot.value)))
+                return false;
+        }
+        return true;
+
+    default:
+        return true;
+    }
+}
+
+bool ImageWriter::collect()
+{
+    for (auto it = root->symtab.cbegin(); it != root->symtab.cend(); ++it) {
+        addSymbol(it.key());
+        if (!add(it.value()))
+            return false;
+    }
+
+    // objects grows while it is walked, so nesting does not recurse
+    for (int i = 0; i < objects.size(); ++i) {
+        if (!addChildren(objects.at(i)))
+            return false;
+    }
+
+    return true;
+}
+
+void ImageWriter::writeValue(QDataStream &stream, const QSchemeValue &value) const
+{
+    if (isForeign(value)) {
+        const QSchemeSymbol builtin = QSchemeBuiltins::name(value);
+        if (builtin != QSchemeSymbol())
+            stream << quint8(BuiltinValue) << symbolIndices.value(builtin.id());
+        else
+            stream << quint8(ForeignValue)
+                   << symbolIndices.value(foreignNames.value(QSchemeValuePrivate::bits(value)).id());
+        return;
+    }
+
+    if (QSchemeValuePrivate::isUnbound(value)) {
+        stream << quint8(UnboundValue);
+        return;
+    }
+
+    switch (value.type()) {
+    case QSchemeValue::Type::Boolean:
+        stream << quint8(value.toBool() ? TrueValue : FalseValue);
+        return;
+
+    case QSchemeValue::Type::Number:
+        if (QSchemeValuePrivate::isFixnum(value))
+            stream << quint8(FixnumValue) << qint64(QSchemeValuePrivate::fixnum(value));
+        else
+            stream << quint8(FlonumValue) << QSchemeValuePrivate::flonum(value);
+        return;
+
+    default:
+        break;
+    }
+
+    if (isPlainSymbol(value)) {
+        stream << quint8(SymbolValue) << symbolIndices.value(value.toSymbol().id());
+        return;
+    }
+
+    const QSchemeHeapObject *object = QSchemeValuePrivate::heapObject(value);
+    if (!object)
+        stream << quint8(NilValue);
+    else if (object == root)
+        stream << quint8(RootValue);
+    else
+        stream << quint8(ObjectValue) << objectIndices.value(object);
+}
+
+void ImageWriter::writeList(QDataStream &stream, const QSchemeValueList &list) const
+{
+    stream << quint32(list.size());
+    for (const QSchemeValue &value : list)
+        writeValue(stream, value);
+}
+
+void ImageWriter::writeObject(QDataStream &stream, const QSchemeHeapObject *object) const
+{
+    if (object->kind == QSchemeHeap::CodeKind) {
+        // only what the code was compiled from, see ImageReader::compileCode()
+        const QSchemeCodeObject *code = static_cast<const QSchemeCodeObject *>(object);
+        writeList(stream, code->argnames);
+        writeList(stream, code->slotNames);
+        writeValue(stream, code->body);
+        return;
+    }
+
+    switch (QSchemeValue::Type(object->kind)) {
+    case QSchemeValue::Type::String:
+        stream << static_cast<const QSchemeStringObject *>(object)->string;
+        break;
+
+    case QSchemeValue::Type::Cons: {
+        const QSchemePairObject *pair = static_cast<const QSchemePairObject *>(object);
+        writeValue(stream, pair->car);
+        writeValue(stream, pair->cdr);
+        break;
+    }
+
+    case QSchemeValue::Type::Symbol: {
+        const QSchemeVariableObject *variable = static_cast<const QSchemeVariableObject *>(object);
+        writeValue(stream, variable->name);
+        stream << qint32(variable->depth) << qint32(variable->slot);
+        writeValue(stream, variable->value);
+        break;
+    }
+
+    case QSchemeValue::Type::LambdaProcedure: {
+        const QSchemeLambdaObject *lambda = static_cast<const QSchemeLambdaObject *>(object);
+        writeList(stream, lambda->argnames);
+        writeList(stream, lambda->slotNames);
+        writeValue(stream, lambda->body);
+        writeValue(stream, lambda->environment);
+        writeValue(stream, lambda->code);
+        stream << lambda->name;
+        break;
+    }
+
+    case QSchemeValue::Type::Environment: {
+        const QSchemeEnvironmentPrivate *env = static_cast<const QSchemeEnvironmentPrivate *>(object);
+        writeValue(stream, env->outer);
+        writeList(stream, env->slotNames);
+
+        stream << quint32(env->slotValues.size());
+        for (const QSchemeValue &value : env->slotValues)
+            writeValue(stream, value);
+
+        stream << quint32(env->symtab.size());
+        for (auto it = env->symtab.cbegin(); it != env->symtab.cend(); ++it) {
+            stream << symbolIndices.value(it.key().id());
+            writeValue(stream, it.value());
+        }
+        break;
+    }
+
+    case QSchemeValue::Type::Vector:
+        writeList(stream, static_cast<const QSchemeVectorObject *>(object)->items);
+        break;
+
+    case QSchemeValue::Type::Bytevector:
+        stream << static_cast<const QSchemeBytevectorObject *>(object)->bytes;
+        break;
+
+    case QSchemeValue::Type::F64Vector: {
+        const QVector<double> &values = static_cast<const QSchemeF64VectorObject *>(object)->values;
+        stream << quint32(values.size());
+        for (double value : values)
+            stream << value;
+        break;
+    }
+
+    case QSchemeValue::Type::HashTable: {
+        // hashes depend on addresses and symbol ids, tables are rebuilt
+        // from their entries when restoring
+        const QSchemeHashTableObject *table = static_cast<const QSchemeHashTableObject *>(object);
+        stream << quint8(table->equivalence) << quint32(table->count);
+        for (const QSchemeHashTableObject::Slot &slot : table->slots) {
+            if (QSchemeValuePrivate::isUnbound(slot.key))
+                continue;
+            writeValue(stream, slot.key);
+            writeValue(stream, slot.value);
+        }
+        break;
+    }
+
+    default:
+        Q_UNREACHABLE();
+    }
+}
+
+void ImageWriter::write(QDataStream &stream, const QByteArray &key) const
+{
+    stream << quint32(Magic) << quint32(FormatVersion) << key;
+
+    stream << quint32(symbols.size());
+    for (const QSchemeSymbol &symbol : symbols)
+        stream << symbol.toString();
+
+    stream << quint32(objects.size());
+    for (const QSchemeHeapObject *object : objects)
+        stream << object->kind;
+
+    stream << quint32(root->symtab.size());
+    for (auto it = root->symtab.cbegin(); it != root->symtab.cend(); ++it)
+        stream << symbolIndices.value(it.key().id()) << objectIndices.value(QSchemeValuePrivate::heapObject(*it));
+
+    for (const QSchemeHeapObject *object : objects)
+        writeObject(stream, object);
+}
+
+// Decodes the image straight from the mapped file. Indices, kinds and
+// lengths are checked, so a damaged image fails to restore instead of
+// producing objects that do not fit together. Instruction streams are not
+// stored at all, the virtual machine trusts them: code is compiled again
+// from its analyzed body. Local variables are followed without checks when
+// code runs, so each must address a slot of a frame its lambda will have.
+class ImageReader
+{
+public:
+    ImageReader(QSchemeEnvironmentPrivate *root, const uchar *data, qint64 size)
+        : root(root), rootValue(QSchemeEnvironment(root)), m_it(data), m_end(data + size) {}
+
+    bool restore(const QByteArray &key);
+
+private:
+    template <typename T>
+    bool read(T *result) {
+        if (m_end - m_it < qint64(sizeof(T)))
+            return false;
+
+        *result = qFromBigEndian<T>(m_it);
+        m_it += sizeof(T);
+        return true;
+    }
+
+    bool readCount(quint32 *count, qint64 minimumItemSize);
+    bool readBytes(QByteArray *bytes);
+    bool readString(QString *string);
+    bool readSymbol(QSchemeSymbol *symbol);
+    bool readValue(QSchemeValue *value);
+    bool readList(QSchemeValueList *list);
+    bool readNames(QSchemeValueList *names);
+    bool readObject(int index);
+
+    bool allocateObjects();
+    bool checkVariables();
+    bool compileCode();
+
+    // the frames around a body while checking its variables
+    struct BodyCheck
+    {
+        QVector<int> scopes; // slot counts of the closures in the body, innermost last
+        QVector<int> frames; // slot counts of the environments closed over, innermost first
+        QSet<QPair<const QSchemePairObject *, const QSchemePairObject *>> done; // pairs by closure
+        QSet<const QSchemePairObject *> open; // pairs on the current path
+        QHash<const QSchemePairObject *, const QSchemePairObject *> closures; // the closure around each
+    };
+    bool checkBody(const QSchemeValue &exp, BodyCheck *check, const QSchemePairObject *closure);
+    int listLength(const QSchemeValue &list) const;
+
+    QSchemeEnvironmentPrivate *const root;
+    const QSchemeValue rootValue;
+
+    QVector<QSchemeSymbol> symbols;
+    QVector<quint8> kinds;
+    QSchemeValueList objects;
+    QVector<QPair<QSchemeSymbol, quint32>> globals;
+
+    // cells of the root environment that already existed, their values are
+    // only assigned once the whole image has been read
+    QSet<int> existingCells;
+    QVector<QPair<QSchemeVariableObject *, QSchemeValue>> pendingValues;
+
+    // hash tables are filled once all keys are complete, as hashing a key
+    // may look into other objects of the image
+    struct PendingTable
+    {
+        QSchemeHashTableObject *table;
+        QSchemeValueList entries; // keys and values, alternating
+    };
+    QVector<PendingTable> pendingTables;
+
+    QVector<int> codeObjects;
+    QSet<const QSchemeVariableObject *> checkedVariables;
+    QSet<const QSchemeCodeObject *> checkedCode;
+
+    const uchar *m_it;
+    const uchar *const m_end;
+};
+
+// Counts are checked against the bytes left, so corrupt data cannot make
+// us reserve more than the image could hold.
+bool ImageReader::readCount(quint32 *count, qint64 minimumItemSize)
+{
+    return read(count) && qint64(*count) * minimumItemSize <= m_end - m_it;
+}
+
+bool ImageReader::readBytes(QByteArray *bytes)
+{
+    quint32 size;
+    if (!read(&size))
+        return false;
+
+    // null byte arrays are written with a length of 0xffffffff
+    if (size == 0xffffffff) {
+        *bytes = QByteArray();
+        return true;
+    }
+
+    if (m_end - m_it < qint64(size))
+        return false;
+
+    *bytes = QByteArray(reinterpret_cast<const char *>(m_it), int(size));
+    m_it += size;
+    return true;
+}
+
+bool ImageReader::readString(QString *string)
+{
+    quint32 bytes;
+    if (!read(&bytes))
+        return false;
+
+    if (bytes == 0xffffffff) {
+        *string = QString();
+        return true;
+    }
+
+    if (bytes % 2 || m_end - m_it < qint64(bytes))
+        return false;
+
+    string->resize(int(bytes / 2));
+    QChar *data = string->data();
+    for (int i = 0; i < string->size(); ++i, m_it += 2)
+        data[i] = QChar(qFromBigEndian<quint16>(m_it));
+
+    return true;
+}
+
+bool ImageReader::readSymbol(QSchemeSymbol *symbol)
+{
+    quint32 index;
+    if (!read(&index) || index >= quint32(symbols.size()))
+        return false;
+
+    *symbol = symbols.at(int(index));
+    return true;
+}
+
+bool ImageReader::readValue(QSchemeValue *value)
+{
+    quint8 tag;
+    if (!read(&tag))
+        return false;
+
+    switch (tag) {
+    case NilValue:
+        *value = QSchemeValue();
+        return true;
+
+    case FalseValue:
+    case TrueValue:
+        *value = QSchemeValue(tag == TrueValue);
+        return true;
+
+    case UnboundValue:
+        *value = QSchemeValuePrivate::unbound();
+        return true;
+
+    case FixnumValue: {
+        qint64 fixnum;
+        if (!read(&fixnum) || !QSchemeValuePrivate::fitsFixnum(fixnum))
+            return false;
+
+        *value = QSchemeValuePrivate::fromFixnum(fixnum);
+        return true;
+    }
+
+    case FlonumValue: {
+        quint64 bits;
+        if (!read(&bits))
+            return false;
+
+        double flonum;
+        memcpy(&flonum, &bits, sizeof(flonum));
+        *value = QSchemeValue(flonum);
+        return true;
+    }
+
+    case SymbolValue: {
+        QSchemeSymbol symbol;
+        if (!readSymbol(&symbol))
+            return false;
+
+        *value = QSchemeValue(symbol);
+        return true;
+    }
+
+    case ObjectValue: {
+        quint32 index;
+        if (!read(&index) || index >= quint32(objects.size()))
+            return false;
+
+        *value = objects.at(int(index));
+        return true;
+    }
+
+    case RootValue:
+        *value = rootValue;
+        return true;
+
+    case BuiltinValue: {
+        QSchemeSymbol name;
+        return readSymbol(&name) && QSchemeBuiltins::lookup(name, value);
+    }
+
+    case ForeignValue: {
+        QSchemeSymbol name;
+        if (!readSymbol(&name))
+            return false;
+
+        const QSchemeValue *binding = QSchemeEnvironment(root).findSymbol(QSchemeValue(name));
+        if (!binding || !isForeign(*binding))
+            return false;
+
+        *value = *binding;
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+bool ImageReader::readList(QSchemeValueList *list)
+{
+    quint32 count;
+    if (!readCount(&count, 1))
+        return false;
+
+    list->resize(int(count));
+    for (QSchemeValue &value : *list) {
+        if (!readValue(&value))
+            return false;
+    }
+
+    return true;
+}
+
+bool ImageReader::readNames(QSchemeValueList *names)
+{
+    if (!readList(names))
+        return false;
+
+    for (const QSchemeValue &name : qAsConst(*names)) {
+        if (!isPlainSymbol(name))
+            return false;
+    }
+
+    return true;
+}
+
+bool ImageReader::allocateObjects()
+{
+    objects.reserve(kinds.size());
+
+    for (quint8 kind : qAsConst(kinds)) {
+        if (kind == QSchemeHeap::CodeKind) {
+            objects.append(QSchemeValuePrivate::adopt(
+                    QSchemeValuePrivate::allocate<QSchemeCodeObject>(QSchemeValue::Type(kind))));
+            continue;
+        }
+
+        switch (QSchemeValue::Type(kind)) {
+        case QSchemeValue::Type::String:
+            objects.append(QSchemeValuePrivate::adopt(
+                    QSchemeValuePrivate::allocate<QSchemeStringObject>(QSchemeValue::Type::String)));
+            break;
+        case QSchemeValue::Type::Cons:
+            objects.append(QSchemeValuePrivate::adopt(
+                    QSchemeValuePrivate::allocate<QSchemePairObject>(QSchemeValue::Type::Cons)));
+            break;
+        case QSchemeValue::Type::Symbol: {
+            QSchemeVariableObject *variable =
+                    QSchemeValuePrivate::allocate<QSchemeVariableObject>(QSchemeValue::Type::Symbol);
+            variable->depth = QSchemeVariableObject::Global;
+            variable->slot = 0;
+            variable->value = QSchemeValuePrivate::unbound();
+            objects.append(QSchemeValuePrivate::adopt(variable));
+            break;
+        }
+        case QSchemeValue::Type::LambdaProcedure:
+            objects.append(QSchemeValuePrivate::adopt(
+                    QSchemeValuePrivate::allocate<QSchemeLambdaObject>(QSchemeValue::Type::LambdaProcedure)));
+            break;
+        case QSchemeValue::Type::Environment:
+            objects.append(QSchemeValuePrivate::adopt(
+                    QSchemeValuePrivate::allocate<QSchemeEnvironmentPrivate>(QSchemeValue::Type::Environment)));
+            break;
+        case QSchemeValue::Type::Vector:
+            objects.append(QSchemeValuePrivate::adopt(
+                    QSchemeValuePrivate::allocate<QSchemeVectorObject>(QSchemeValue::Type::Vector)));
+            break;
+        case QSchemeValue::Type::Bytevector:
+            objects.append(QSchemeValuePrivate::adopt(
+                    QSchemeValuePrivate::allocate<QSchemeBytevectorObject>(QSchemeValue::Type::Bytevector)));
+            break;
+        case QSchemeValue::Type::F64Vector:
+            objects.append(QSchemeValuePrivate::adopt(
+                    QSchemeValuePrivate::allocate<QSchemeF64VectorObject>(QSchemeValue::Type::F64Vector)));
+            break;
+        case QSchemeValue::Type::HashTable:
+            objects.append(QSchemeValuePrivate::adopt(
+                    QSchemeValuePrivate::allocate<QSchemeHashTableObject>(QSchemeValue::Type::HashTable)));
+            break;
+        default:
+            return false;
+        }
+    }
+
+    // globals the environment already has keep their cell
+    for (const auto &global : qAsConst(globals)) {
+        const auto it = root->symtab.constFind(global.first);
+        if (it == root->symtab.constEnd() || existingCells.contains(int(global.second)))
+            continue;
+
+        objects[int(global.second)] = *it;
+        existingCells.insert(int(global.second));
+    }
+
+    return true;
+}
+
+bool ImageReader::readObject(int index)
+{
+    const quint8 kind = kinds.at(index);
+
+    if (kind == QSchemeHeap::CodeKind) {
+        QSchemeCodeObject *code = QSchemeValuePrivate::object<QSchemeCodeObject>(objects.at(index));
+        codeObjects.append(index);
+
+        return readNames(&code->argnames) && readNames(&code->slotNames)
+                && code->argnames.size() <= code->slotNames.size() && readValue(&code->body);
+    }
+
+    switch (QSchemeValue::Type(kind)) {
+    case QSchemeValue::Type::String:
+        return readString(&QSchemeValuePrivate::object<QSchemeStringObject>(objects.at(index))->string);
+
+    case QSchemeValue::Type::Cons: {
+        QSchemePairObject *pair = QSchemeValuePrivate::pair(objects.at(index));
+        return readValue(&pair->car) && readValue(&pair->cdr);
+    }
+
+    case QSchemeValue::Type::Symbol: {
+        QSchemeVariableObject *variable = QSchemeValuePrivate::variable(objects.at(index));
+
+        QSchemeValue name, value;
+        qint32 depth, slot;
+        if (!readValue(&name) || !isPlainSymbol(name) || !read(&depth) || !read(&slot) || !readValue(&value)
+                || depth < QSchemeVariableObject::Global || slot < 0) {
+            return false;
+        }
+
+        if (existingCells.contains(index)) {
+            if (name.toSymbol() != variable->name.toSymbol())
+                return false;
+
+            pendingValues.append(qMakePair(variable, value));
+            return true;
+        }
+
+        variable->name = name;
+        variable->depth = depth;
+        variable->slot = slot;
+        variable->value = value;
+        return true;
+    }
+
+    case QSchemeValue::Type::LambdaProcedure: {
+        QSchemeLambdaObject *lambda = QSchemeValuePrivate::object<QSchemeLambdaObject>(objects.at(index));
+
+        return readNames(&lambda->argnames) && readNames(&lambda->slotNames)
+                && lambda->argnames.size() <= lambda->slotNames.size() && readValue(&lambda->body)
+                && readValue(&lambda->environment) && QSchemeValuePrivate::environment(lambda->environment)
+                && readValue(&lambda->code)
+                && (QtSchemeFunctions::is_null(lambda->code) || QSchemeValuePrivate::isCode(lambda->code))
+                && readString(&lambda->name);
+    }
+
+    case QSchemeValue::Type::Environment: {
+        QSchemeEnvironmentPrivate *env = QSchemeValuePrivate::environment(objects.at(index));
+
+        QSchemeValueList slotValues;
+        if (!readValue(&env->outer)
+                || !(QtSchemeFunctions::is_null(env->outer) || QSchemeValuePrivate::environment(env->outer))
+                || !readNames(&env->slotNames) || !readList(&slotValues)
+                || slotValues.size() != env->slotNames.size()) {
+            return false;
+        }
+
+        env->slotValues.reserve(slotValues.size());
+        for (const QSchemeValue &value : qAsConst(slotValues))
+            env->slotValues.append(value);
+
+        quint32 count;
+        if (!readCount(&count, 2 * sizeof(quint32)))
+            return false;
+
+        for (quint32 i = 0; i < count; ++i) {
+            QSchemeSymbol symbol;
+            QSchemeValue cell;
+            if (!readSymbol(&symbol) || !readValue(&cell) || !QSchemeValuePrivate::isVariable(cell))
+                return false;
+
+            env->symtab.insert(symbol, cell);
+        }
+        return true;
+    }
+
+    case QSchemeValue::Type::Vector:
+        return readList(&QSchemeValuePrivate::object<QSchemeVectorObject>(objects.at(index))->items);
+
+    case QSchemeValue::Type::Bytevector:
+        return readBytes(&QSchemeValuePrivate::object<QSchemeBytevectorObject>(objects.at(index))->bytes);
+
+    case QSchemeValue::Type::F64Vector: {
+        QVector<double> &values = QSchemeValuePrivate::object<QSchemeF64VectorObject>(objects.at(index))->values;
+
+        quint32 count;
+        if (!readCount(&count, sizeof(double)))
+            return false;
+
+        values.resize(int(count));
+        for (double &value : values) {
+            quint64 bits;
+            read(&bits);
+            memcpy(&value, &bits, sizeof(value));
+        }
+        return true;
+    }
+
+    case QSchemeValue::Type::HashTable: {
+        QSchemeHashTableObject *table = QSchemeValuePrivate::object<QSchemeHashTableObject>(objects.at(index));
+
+        quint8 equivalence;
+        quint32 count;
+        if (!read(&equivalence) || equivalence > quint8(QSchemeHashTableObject::Equivalence::Equal)
+                || !readCount(&count, 2))
+            return false;
+
+        table->equivalence = QSchemeHashTableObject::Equivalence(equivalence);
+
+        PendingTable pending = { table, QSchemeValueList() };
+        pending.entries.reserve(2 * int(count));
+        for (quint32 i = 0; i < 2 * count; ++i) {
+            QSchemeValue value;
+            // unbound keys would mark their slot as free
+            if (!readValue(&value) || (i % 2 == 0 && QSchemeValuePrivate::isUnbound(value)))
+                return false;
+            pending.entries.append(value);
+        }
+
+        pendingTables.append(pending);
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+// The length of a proper list, -1 for anything else. A list longer than
+// the image has objects must be a cycle.
+int ImageReader::listLength(const QSchemeValue &list) const
+{
+    int length = 0;
+    const QSchemeValue *it = &list;
+    for (; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr) {
+        if (++length > objects.size())
+            return -1;
+    }
+
+    return QtSchemeFunctions::is_null(*it) ? length : -1;
+}
+
+// Analyzed bodies are trees, only closure forms open a frame. Data can be
+// shared between places that see the same frames, cycles are damage.
+bool ImageReader::checkBody(const QSchemeValue &exp, BodyCheck *check, const QSchemePairObject *closure)
+{
+    if (QSchemeValuePrivate::isVariable(exp)) {
+        const QSchemeVariableObject *variable = QSchemeValuePrivate::variable(exp);
+        if (variable->depth == QSchemeVariableObject::Global)
+            return true;
+
+        const int depth = variable->depth;
+        const int scopes = check->scopes.size();
+        int slots = 0;
+        if (depth < scopes)
+            slots = check->scopes.at(scopes - 1 - depth);
+        else if (depth - scopes < check->frames.size())
+            slots = check->frames.at(depth - scopes);
+
+        if (variable->slot >= slots)
+            return false;
+
+        checkedVariables.insert(variable);
+        return true;
+    }
+
+    if (!QSchemeValuePrivate::isPair(exp))
+        return true;
+
+    const QSchemePairObject *pair = QSchemeValuePrivate::pair(exp);
+    if (check->done.contains(qMakePair(pair, closure)))
+        return true;
+
+    if (pair->car.type() == QSchemeValue::Type::ForeignSyntax
+            && pair->car.toForeignSyntax() == QSchemeBuiltins::closureSyntax()) {
+        // (closure params locals body), each of them opens one frame
+        const auto seen = check->closures.constFind(pair);
+        if (seen != check->closures.constEnd())
+            return *seen == closure;
+        if (listLength(pair->cdr) != 3)
+            return false;
+        check->closures.insert(pair, closure);
+
+        const QSchemeValue args = pair->cdr;
+        const int params = listLength(QtSchemeFunctions::car(args));
+        const int locals = listLength(QtSchemeFunctions::cadr(args));
+        if (params < 0 || locals < 0)
+            return false;
+
+        check->scopes.append(params + locals);
+        const bool valid = checkBody(QtSchemeFunctions::caddr(args), check, pair);
+        check->scopes.removeLast();
+        return valid;
+    }
+
+    QVector<const QSchemePairObject *> path;
+    const QSchemeValue *it = &exp;
+    for (; QSchemeValuePrivate::isPair(*it); it = &QSchemeValuePrivate::pair(*it)->cdr) {
+        const QSchemePairObject *item = QSchemeValuePrivate::pair(*it);
+        if (check->open.contains(item))
+            return false;
+        if (check->done.contains(qMakePair(item, closure)))
+            break;
+
+        check->open.insert(item);
+        path.append(item);
+        if (!checkBody(item->car, check, closure))
+            return false;
+    }
+
+    for (const QSchemePairObject *item : qAsConst(path)) {
+        check->open.remove(item);
+        check->done.insert(qMakePair(item, closure));
+    }
+
+    return QSchemeValuePrivate::isPair(*it) || checkBody(*it, check, closure);
+}
+
+bool ImageReader::checkVariables()
+{
+    for (int i = 0; i < objects.size(); ++i) {
+        if (QSchemeValue::Type(kinds.at(i)) != QSchemeValue::Type::Environment)
+            continue;
+
+        // the analyzer walks outwards until it finds a name
+        QSet<const QSchemeEnvironmentPrivate *> chain;
+        for (const QSchemeEnvironmentPrivate *env = QSchemeValuePrivate::environment(objects.at(i)); env;
+             env = QSchemeValuePrivate::environment(env->outer)) {
+            if (chain.contains(env))
+                return false;
+            chain.insert(env);
+        }
+
+        for (const QSchemeValue &cell : qAsConst(QSchemeValuePrivate::environment(objects.at(i))->symtab)) {
+            if (QSchemeValuePrivate::variable(cell)->depth != QSchemeVariableObject::Global)
+                return false;
+        }
+    }
+
+    for (int i = 0; i < objects.size(); ++i) {
+        if (QSchemeValue::Type(kinds.at(i)) != QSchemeValue::Type::LambdaProcedure)
+            continue;
+
+        const QSchemeLambdaObject *lambda = QSchemeValuePrivate::object<QSchemeLambdaObject>(objects.at(i));
+
+        BodyCheck check;
+        check.scopes.append(lambda->slotNames.size());
+        for (const QSchemeEnvironmentPrivate *env = QSchemeValuePrivate::environment(lambda->environment); env;
+             env = QSchemeValuePrivate::environment(env->outer)) {
+            check.frames.append(env->slotValues.size());
+        }
+
+        if (!checkBody(lambda->body, &check, nullptr))
+            return false;
+
+        if (QSchemeValuePrivate::isCode(lambda->code)) {
+            // the frame is made for the lambda, the code indexes it
+            const QSchemeCodeObject *code = QSchemeValuePrivate::object<QSchemeCodeObject>(lambda->code);
+            if (code->argnames.size() != lambda->argnames.size()
+                    || code->slotNames.size() != lambda->slotNames.size()
+                    || !checkBody(code->body, &check, nullptr)) {
+                return false;
+            }
+            checkedCode.insert(code);
+        }
+    }
+
+    for (const auto &global : qAsConst(globals)) {
+        if (QSchemeValuePrivate::variable(objects.at(int(global.second)))->depth != QSchemeVariableObject::Global)
+            return false;
+    }
+
+    // locals and code outside of any lambda were not checked, and could
+    // still be run through eval
+    for (int i = 0; i < objects.size(); ++i) {
+        if (kinds.at(i) == QSchemeHeap::CodeKind) {
+            if (!checkedCode.contains(QSchemeValuePrivate::object<QSchemeCodeObject>(objects.at(i))))
+                return false;
+        } else if (QSchemeValue::Type(kinds.at(i)) == QSchemeValue::Type::Symbol) {
+            const QSchemeVariableObject *variable = QSchemeValuePrivate::variable(objects.at(i));
+            if (variable->depth != QSchemeVariableObject::Global && !checkedVariables.contains(variable))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool ImageReader::compileCode()
+{
+    for (int index : qAsConst(codeObjects)) {
+        QSchemeCodeObject *code = QSchemeValuePrivate::object<QSchemeCodeObject>(objects.at(index));
+        const QSchemeValue locals(code->slotNames.mid(code->argnames.size()));
+
+        try {
+            const QSchemeValue compiled =
+                    QSchemeCompiler::compile(QtSchemeFunctions::list(QSchemeValue(code->argnames), locals, code->body));
+            const QSchemeCodeObject *fresh = QSchemeValuePrivate::object<QSchemeCodeObject>(compiled);
+            code->instructions = fresh->instructions;
+            code->constants = fresh->constants;
+        } catch (const QSchemeException &) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ImageReader::restore(const QByteArray &key)
+{
+    quint32 magic, version, count;
+    QByteArray imageKey;
+
+    if (!read(&magic) || !read(&version) || magic != Magic || version != FormatVersion
+            || !readBytes(&imageKey) || imageKey != key) {
+        return false;
+    }
+
+    if (!readCount(&count, sizeof(quint32)))
+        return false;
+
+    symbols.reserve(int(count));
+    for (quint32 i = 0; i < count; ++i) {
+        QString name;
+        if (!readString(&name))
+            return false;
+
+        symbols.append(QSchemeSymbol(name));
+    }
+
+    if (!readCount(&count, 1))
+        return false;
+
+    kinds.resize(int(count));
+    for (quint8 &kind : kinds) {
+        read(&kind);
+        if (!isStorableKind(kind))
+            return false;
+    }
+
+    if (!readCount(&count, 2 * sizeof(quint32)))
+        return false;
+
+    for (quint32 i = 0; i < count; ++i) {
+        QSchemeSymbol symbol;
+        quint32 cell;
+        if (!readSymbol(&symbol) || !read(&cell) || cell >= quint32(kinds.size())
+                || QSchemeValue::Type(kinds.at(int(cell))) != QSchemeValue::Type::Symbol) {
+            return false;
+        }
+
+        globals.append(qMakePair(symbol, cell));
+    }
+
+    if (!allocateObjects())
+        return false;
+
+    for (int i = 0; i < objects.size(); ++i) {
+        if (!readObject(i))
+            return false;
+    }
+
+    if (m_it != m_end)
+        return false;
+
+    for (const PendingTable &pending : qAsConst(pendingTables)) {
+        QSchemeHashTables::reserve(pending.table, pending.entries.size() / 2);
+        for (int i = 0; i < pending.entries.size(); i += 2)
+            QSchemeHashTables::insert(pending.table, pending.entries.at(i), pending.entries.at(i + 1));
+    }
+
+    // before anything of the environment changes; the builtins compiled
+    // inline are checked against their cells when called anyway
+    if (!checkVariables() || !compileCode())
+        return false;
+
+    for (const auto &pending : qAsConst(pendingValues))
+        pending.first->value = pending.second;
+
+    for (const auto &global : qAsConst(globals)) {
+        if (!root->symtab.contains(global.first))
+            root->symtab.insert(global.first, objects.at(int(global.second)));
+    }
+
+    return true;
+}
+
+} // namespace
+
+bool QSchemeImage::save(const QSchemeEnvironmentPrivate *environment, const QString &path, const QByteArray &key)
+{
+    ImageWriter writer(environment);
+    if (!writer.collect())
+        return false;
+
+    const QString dir = QFileInfo(path).path();
+    if (!QDir().mkpath(dir))
+        return false;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    writer.write(stream, key);
+
+    if (stream.status() != QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
+
+bool QSchemeImage::restore(QSchemeEnvironmentPrivate *environment, const QString &path, const QByteArray &key)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = file.size();
+    const uchar *data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data)
+        return false;
+
+    ImageReader reader(environment, data, size);
+    return reader.restore(key);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,44 @@
+#ifndef QSCHEMEIMAGE_P_H
+#define QSCHEMEIMAGE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// Snapshots of the definitions of a top level environment.
+//
+// An image holds every heap object reachable from the environment's symtab:
+// cells, procedures, frames they closed over and constant data. Compiled
+// code is stored as the analyzed body it came from and compiled again when
+// restoring, so no instruction stream is ever read from disk. Objects refer
+// to each other by index, so the image does not depend on where the heap
+// lives and shared structure and cycles come back as they were. Builtins
+// and foreign procedures are stored by name and resolved again when
+// restoring.
+//
+// Restoring maps the file and decodes it in place. It either succeeds as a
+// whole or leaves the environment untouched; cells the environment already
+// has are reused, so code referring to them sees the restored values.
+class QSchemeImage
+{
+public:
+    static bool save(const QSchemeEnvironmentPrivate *environment, const QString &path,
+                     const QByteArray &key);
+    static bool restore(QSchemeEnvironmentPrivate *environment, const QString &path,
+                        const QByteArray &key);
+};
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEIMAGE_P_H
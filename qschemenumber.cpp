@@ -0,0 +1,145 @@
+#include "qschemenumber_p.h"
+
+#include <cmath>
+
+QT_BEGIN_NAMESPACE
+
+namespace QSchemeNumbers {
+
+double toDouble(const QSchemeValue &value, const char *name)
+{
+    if (QSchemeValuePrivate::isFixnum(value))
+        return double(QSchemeValuePrivate::fixnum(value));
+
+    if (value.type() != QSchemeValue::Type::Number)
+        throw qt_scheme_error(name, "expected a number");
+
+    return QSchemeValuePrivate::flonum(value);
+}
+
+QSchemeValue addSlow(const QSchemeValue &a, const QSchemeValue &b)
+{
+    return QSchemeValue(toDouble(a, "+") + toDouble(b, "+"));
+}
+
+QSchemeValue subtractSlow(const QSchemeValue &a, const QSchemeValue &b)
+{
+    return QSchemeValue(toDouble(a, "-") - toDouble(b, "-"));
+}
+
+QSchemeValue multiplySlow(const QSchemeValue &a, const QSchemeValue &b)
+{
+    const double product = toDouble(a, "*") * toDouble(b, "*");
+
+    // Products of fixnums below 2^53 are exact as doubles, so a product in
+    // the fixnum range can be computed in 64 bits without overflowing.
+    if (bothFixnums(a, b) && std::fabs(product) <= double(QSchemeValuePrivate::FixnumMax))
+        return QSchemeValuePrivate::integer(QSchemeValuePrivate::fixnum(a) * QSchemeValuePrivate::fixnum(b));
+
+    return QSchemeValue(product);
+}
+
+QSchemeValue divide(const QSchemeValue &a, const QSchemeValue &b)
+{
+    if (bothFixnums(a, b)) {
+        const qint64 x = QSchemeValuePrivate::fixnum(a);
+        const qint64 y = QSchemeValuePrivate::fixnum(b);
+
+        if (y == 0)
+            throw qt_scheme_error("/", "division by zero");
+
+        if (x % y == 0)
+            return QSchemeValuePrivate::integer(x / y);
+
+        return QSchemeValue(double(x) / double(y));
+    }
+
+    return QSchemeValue(toDouble(a, "/") / toDouble(b, "/"));
+}
+
+QSchemeValue divideIntegers(const QSchemeValue &a, const QSchemeValue &b, Division division)
+{
+    const char *const name = division == Division::Quotient ? "quotient"
+                           : division == Division::Remainder ? "remainder"
+                           : "modulo";
+
+    if (bothFixnums(a, b)) {
+        const qint64 x = QSchemeValuePrivate::fixnum(a);
+        const qint64 y = QSchemeValuePrivate::fixnum(b);
+
+        if (y == 0)
+            throw qt_scheme_error(name, "division by zero");
+
+        if (division == Division::Quotient)
+            return QSchemeValuePrivate::integer(x / y);
+
+        qint64 r = x % y;
+        if (division == Division::Modulo && r != 0 && (r < 0) != (y < 0))
+            r += y;
+        return QSchemeValuePrivate::fromFixnum(r);
+    }
+
+    // integral doubles, e.g. the result of an overflow, are integers too
+    const double x = toDouble(a, name);
+    const double y = toDouble(b, name);
+
+    if (std::trunc(x) != x || std::trunc(y) != y)
+        throw qt_scheme_error(name, "expected an integer");
+
+    if (y == 0)
+        throw qt_scheme_error(name, "division by zero");
+
+    if (division == Division::Quotient)
+        return QSchemeValue(std::trunc(x / y));
+
+    double r = std::fmod(x, y);
+    if (division == Division::Modulo && r != 0 && (r < 0) != (y < 0))
+        r += y;
+    return QSchemeValue(r);
+}
+
+const char *name(Comparison comparison)
+{
+    switch (comparison) {
+    case Comparison::Equal:
+        return "=";
+    case Comparison::Less:
+        return "<";
+    case Comparison::Greater:
+        return ">";
+    case Comparison::LessEqual:
+        return "<=";
+    case Comparison::GreaterEqual:
+        return ">=";
+    }
+
+    Q_UNREACHABLE();
+    return nullptr;
+}
+
+bool compareSlow(const QSchemeValue &a, const QSchemeValue &b, Comparison comparison)
+{
+    // fixnums have 48 bits, they convert to doubles exactly
+    const double x = toDouble(a, name(comparison));
+    const double y = toDouble(b, name(comparison));
+
+    switch (comparison) {
+    case Comparison::Equal:
+        return x == y;
+    case Comparison::Less:
+        return x < y;
+    case Comparison::Greater:
+        return x > y;
+    case Comparison::LessEqual:
+        return x <= y;
+    case Comparison::GreaterEqual:
+        return x >= y;
+    }
+
+    Q_UNREACHABLE();
+    return false;
+}
+
+} // namespace QSchemeNumbers
+
+QT_END_NAMESPACE
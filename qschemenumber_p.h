@@ -0,0 +1,106 @@
+#ifndef QSCHEMENUMBER_P_H
+#define QSCHEMENUMBER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// Arithmetic on the two kinds of numbers a QSchemeValue holds: 48 bit
+// fixnums and doubles. Operations on fixnums stay exact as long as the
+// result fits a fixnum and fall back to doubles when it does not, mixing
+// in a double makes the result a double.
+//
+// The fixnum cases are inline so that the builtins and the virtual machine
+// run them without a call, everything else goes through the out of line
+// slow paths. name is the procedure reported when an argument is not a
+// number.
+namespace QSchemeNumbers {
+
+double toDouble(const QSchemeValue &value, const char *name);
+
+QSchemeValue addSlow(const QSchemeValue &a, const QSchemeValue &b);
+QSchemeValue subtractSlow(const QSchemeValue &a, const QSchemeValue &b);
+QSchemeValue multiplySlow(const QSchemeValue &a, const QSchemeValue &b);
+QSchemeValue divide(const QSchemeValue &a, const QSchemeValue &b);
+
+enum class Division { Quotient, Remainder, Modulo };
+QSchemeValue divideIntegers(const QSchemeValue &a, const QSchemeValue &b, Division division);
+
+enum class Comparison { Equal, Less, Greater, LessEqual, GreaterEqual };
+const char *name(Comparison comparison);
+
+// NaN compares false to everything, itself included
+bool compareSlow(const QSchemeValue &a, const QSchemeValue &b, Comparison comparison);
+
+inline bool bothFixnums(const QSchemeValue &a, const QSchemeValue &b)
+{
+    return QSchemeValuePrivate::isFixnum(a) && QSchemeValuePrivate::isFixnum(b);
+}
+
+// The sum and difference of two fixnums always fit 64 bits.
+inline QSchemeValue add(const QSchemeValue &a, const QSchemeValue &b)
+{
+    if (Q_LIKELY(bothFixnums(a, b)))
+        return QSchemeValuePrivate::integer(QSchemeValuePrivate::fixnum(a) + QSchemeValuePrivate::fixnum(b));
+    return addSlow(a, b);
+}
+
+inline QSchemeValue subtract(const QSchemeValue &a, const QSchemeValue &b)
+{
+    if (Q_LIKELY(bothFixnums(a, b)))
+        return QSchemeValuePrivate::integer(QSchemeValuePrivate::fixnum(a) - QSchemeValuePrivate::fixnum(b));
+    return subtractSlow(a, b);
+}
+
+inline QSchemeValue multiply(const QSchemeValue &a, const QSchemeValue &b)
+{
+    if (Q_LIKELY(bothFixnums(a, b))) {
+        const qint64 x = QSchemeValuePrivate::fixnum(a);
+        const qint64 y = QSchemeValuePrivate::fixnum(b);
+
+        // factors below 2^31 cannot overflow 64 bits, integer() then
+        // checks the fixnum range; larger ones take the slow path
+        if (x > -0x80000000LL && x < 0x80000000LL && y > -0x80000000LL && y < 0x80000000LL)
+            return QSchemeValuePrivate::integer(x * y);
+    }
+    return multiplySlow(a, b);
+}
+
+inline bool compare(const QSchemeValue &a, const QSchemeValue &b, Comparison comparison)
+{
+    if (Q_LIKELY(bothFixnums(a, b))) {
+        const qint64 x = QSchemeValuePrivate::fixnum(a);
+        const qint64 y = QSchemeValuePrivate::fixnum(b);
+
+        switch (comparison) {
+        case Comparison::Equal:
+            return x == y;
+        case Comparison::Less:
+            return x < y;
+        case Comparison::Greater:
+            return x > y;
+        case Comparison::LessEqual:
+            return x <= y;
+        case Comparison::GreaterEqual:
+            return x >= y;
+        }
+    }
+    return compareSlow(a, b, comparison);
+}
+
+} // namespace QSchemeNumbers
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMENUMBER_P_H
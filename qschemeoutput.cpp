@@ -0,0 +1,218 @@
+#include "qschemeoutput_p.h"
+#include "qschemefiles_p.h"
+#include "qschemeparallel_p.h"
+#include "qschemeprinter_p.h"
+
+#include <algorithm>
+#include <cstring>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+namespace {
+
+bool isUnchanged(const QSchemeOutputFiles::File &output)
+{
+    QFile file(output.path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() != output.contents.size())
+        return false;
+
+    if (output.contents.isEmpty())
+        return true;
+
+    if (const uchar *data = file.map(0, file.size()))
+        return memcmp(data, output.contents.constData(), size_t(output.contents.size())) == 0;
+
+    return file.readAll() == output.contents;
+}
+
+// Files being written by output-write, by handle.
+struct Buffers
+{
+    QMutex mutex;
+    QHash<int, QSchemeOutputFiles::File> files;
+    int nextId = 1;
+};
+
+Q_GLOBAL_STATIC(Buffers, buffers)
+
+} // namespace
+
+namespace QSchemeOutputFiles {
+
+bool commit(const File &file)
+{
+    if (isUnchanged(file))
+        return false;
+
+    const QString directory = QFileInfo(file.path).absolutePath();
+    if (!QDir().mkpath(directory))
+        throw qt_scheme_error("output", QLatin1String("cannot create ") + directory);
+
+    QSaveFile output(file.path);
+    if (!output.open(QIODevice::WriteOnly) || output.write(file.contents) != file.contents.size() || !output.commit())
+        throw qt_scheme_error("output", QLatin1String("cannot write ") + file.path + QLatin1String(": ") + output.errorString());
+
+    QSchemeFiles::invalidate(file.path);
+    return true;
+}
+
+QStringList commit(const QVector<File> &files)
+{
+    QVector<char> written(files.size());
+    QVector<QString> errors(files.size());
+    char *const out = written.data();
+    QString *const failures = errors.data();
+
+    // a file that cannot be written must not keep the others from being
+    // committed, so nothing throws until all of them were tried
+    QSchemeParallel::forEach(files.size(), [&files, out, failures](int index) {
+        try {
+            out[index] = commit(files.at(index));
+        } catch (const QSchemeException &exception) {
+            failures[index] = QString::fromUtf8(exception.what());
+        }
+    });
+
+    QStringList result;
+    QStringList failed;
+    for (int i = 0; i < files.size(); ++i) {
+        if (!errors.at(i).isEmpty())
+            failed.append(errors.at(i));
+        else if (written.at(i))
+            result.append(files.at(i).path);
+    }
+
+    if (!failed.isEmpty())
+        throw QSchemeException(failed.join(QLatin1String("; ")));
+
+    return result;
+}
+
+} // namespace QSchemeOutputFiles
+
+namespace {
+
+QString path(const QSchemeValue &value, const char *name)
+{
+    if (!is_string(value))
+        throw qt_scheme_error(name, "expected a path");
+
+    return value.toString();
+}
+
+int handle(const QSchemeValue &value, const char *name)
+{
+    if (!QSchemeValuePrivate::isFixnum(value))
+        throw qt_scheme_error(name, "expected an output file");
+
+    return int(QSchemeValuePrivate::fixnum(value));
+}
+
+// strings as they are, everything else as print shows it
+void appendValues(QString *text, const QSchemeValue &values)
+{
+    QSchemePrinter printer(text);
+    for (QSchemeValue it = values; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr) {
+        const QSchemeValue value = QSchemeValuePrivate::pair(it)->car;
+        if (is_string(value))
+            *text += value.toString();
+        else
+            printer.print(value);
+    }
+}
+
+// (output-file path) -> a handle to write the new contents of path to
+QSchemeValue output_file(const QSchemeValue &arguments)
+{
+    const QString file = path(car(arguments), "output-file");
+
+    QMutexLocker locker(&buffers()->mutex);
+    const int id = buffers()->nextId++;
+    buffers()->files.insert(id, { file, QByteArray() });
+    return QSchemeValue(id);
+}
+
+// (output-write handle value ...)
+QSchemeValue output_write(const QSchemeValue &arguments)
+{
+    const int id = handle(car(arguments), "output-write");
+
+    QString text;
+    appendValues(&text, cdr(arguments));
+    const QByteArray contents = text.toUtf8();
+
+    QMutexLocker locker(&buffers()->mutex);
+    const auto it = buffers()->files.find(id);
+    if (it == buffers()->files.end())
+        throw qt_scheme_error("output-write", "unknown output file");
+
+    it->contents += contents;
+    return QSchemeValue();
+}
+
+// (output-commit handle) -> whether the file changed. The handle is invalid
+// afterwards.
+QSchemeValue output_commit(const QSchemeValue &arguments)
+{
+    const int id = handle(car(arguments), "output-commit");
+
+    QSchemeOutputFiles::File file;
+    {
+        QMutexLocker locker(&buffers()->mutex);
+        if (!buffers()->files.contains(id))
+            throw qt_scheme_error("output-commit", "unknown output file");
+        file = buffers()->files.take(id);
+    }
+
+    return QSchemeValue(QSchemeOutputFiles::commit(file));
+}
+
+// (output-commit-all) commits every output file not committed yet, and
+// returns the paths of those that changed
+QSchemeValue output_commit_all(const QSchemeValue &)
+{
+    QVector<QSchemeOutputFiles::File> files;
+    {
+        QMutexLocker locker(&buffers()->mutex);
+        QList<int> ids = buffers()->files.keys();
+        std::sort(ids.begin(), ids.end());
+        for (int id : qAsConst(ids))
+            files.append(buffers()->files.take(id));
+    }
+
+    QSchemeListBuilder result;
+    for (const QString &written : QSchemeOutputFiles::commit(files))
+        result.append(QSchemeValue(written));
+    return result.result();
+}
+
+// (write-file-if-changed path value ...) -> whether the file changed
+QSchemeValue write_file_if_changed(const QSchemeValue &arguments)
+{
+    const QString file = path(car(arguments), "write-file-if-changed");
+
+    QString text;
+    appendValues(&text, cdr(arguments));
+    const QSchemeOutputFiles::File output = { file, text.toUtf8() };
+    return QSchemeValue(QSchemeOutputFiles::commit(output));
+}
+
+} // namespace
+
+namespace QSchemeOutputFiles {
+
+const QSchemeBuiltinProcedure procedures[] = {
+    { "output-file", output_file },
+    { "output-write", output_write },
+    { "output-commit", output_commit },
+    { "output-commit-all", output_commit_all },
+    { "write-file-if-changed", write_file_if_changed },
+
+    { nullptr, nullptr }
+};
+
+} // namespace QSchemeOutputFiles
+
+QT_END_NAMESPACE
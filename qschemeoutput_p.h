@@ -0,0 +1,45 @@
+#ifndef QSCHEMEOUTPUT_P_H
+#define QSCHEMEOUTPUT_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// Generated files, written only when their contents change so that their
+// modification time, and everything built from them, stays as it is.
+//
+// Contents are compared with the existing file before anything is written,
+// files of a different size are never read. Changed files are replaced
+// atomically through QSaveFile.
+namespace QSchemeOutputFiles {
+
+struct File
+{
+    QString path;
+    QByteArray contents;
+};
+
+// Returns whether the file was written, throws when it cannot be.
+bool commit(const File &file);
+
+// Commits the files in parallel and returns the paths of the ones that were
+// written, in the order given. Every file is tried; when some could not be
+// written, throws afterwards with the errors of all of them.
+QStringList commit(const QVector<File> &files);
+
+} // namespace QSchemeOutputFiles
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEOUTPUT_P_H
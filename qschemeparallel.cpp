@@ -0,0 +1,232 @@
+#include "qschemeparallel_p.h"
+#include "qschemestatistics_p.h"
+
+#include <exception>
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+thread_local bool qt_scheme_in_parallel = false;
+
+namespace {
+
+enum { WorkerStackSize = 8 * 1024 * 1024 }; // as much as a main thread usually gets
+
+struct Pool
+{
+    Pool()
+    {
+        pool.setStackSize(WorkerStackSize);
+        // the calling thread is a worker too
+        pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    }
+
+    QThreadPool pool;
+};
+
+Q_GLOBAL_STATIC(Pool, workerPool)
+
+// A slice of the items. Its owner and thieves alike claim items from the
+// front, one at a time.
+struct Slice
+{
+    QAtomicInt next;
+    int end;
+};
+
+class Job
+{
+public:
+    Job(int count, int workers, const std::function<void(int)> &function)
+        : function(function), slices(new Slice[workers]), workers(workers)
+    {
+        for (int i = 0; i < workers; ++i) {
+            slices[i].next.store(int(qint64(count) * i / workers));
+            slices[i].end = int(qint64(count) * (i + 1) / workers);
+        }
+    }
+
+    void work(int worker);
+    void rethrow() const;
+
+    QSemaphore finished;
+
+private:
+    const std::function<void(int)> function;
+    const std::unique_ptr<Slice[]> slices;
+    const int workers;
+
+    QAtomicInt failed;
+    QMutex errorMutex;
+    std::exception_ptr error;
+};
+
+void Job::work(int worker)
+{
+    QSchemeCounters::registerThread();
+
+    const bool wasInParallel = qt_scheme_in_parallel;
+    qt_scheme_in_parallel = true;
+
+    for (int k = 0; k < workers && !failed.loadAcquire(); ++k) {
+        Slice &slice = slices[(worker + k) % workers];
+
+        for (int i = slice.next.fetchAndAddRelaxed(1); i < slice.end; i = slice.next.fetchAndAddRelaxed(1)) {
+            try {
+                function(i);
+            } catch (...) {
+                QMutexLocker locker(&errorMutex);
+                if (!error)
+                    error = std::current_exception();
+                failed.storeRelease(1);
+            }
+
+            if (failed.loadAcquire())
+                break;
+        }
+    }
+
+    qt_scheme_in_parallel = wasInParallel;
+}
+
+void Job::rethrow() const
+{
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Owns a reference to the job, the calling thread may be gone from
+// forEach() by the time a helper has released the semaphore.
+class Helper : public QRunnable
+{
+public:
+    Helper(const QSharedPointer<Job> &job, int worker) : job(job), worker(worker) {}
+
+    void run() override
+    {
+        job->work(worker);
+        job->finished.release();
+    }
+
+private:
+    const QSharedPointer<Job> job;
+    const int worker;
+};
+
+struct CollectionSuspender
+{
+    CollectionSuspender() { QSchemeHeap::suspendCollection(); }
+    ~CollectionSuspender() { QSchemeHeap::resumeCollection(); }
+};
+
+} // namespace
+
+namespace QSchemeParallel {
+
+void forEach(int count, const std::function<void(int)> &function)
+{
+    const int workers = qMin(count, threadCount());
+
+    if (workers <= 1 || qt_scheme_in_parallel) {
+        for (int i = 0; i < count; ++i)
+            function(i);
+        return;
+    }
+
+    const CollectionSuspender suspender;
+    const QSharedPointer<Job> job(new Job(count, workers, function));
+
+    for (int worker = 1; worker < workers; ++worker)
+        workerPool()->pool.start(new Helper(job, worker));
+
+    job->work(0);
+    job->finished.acquire(workers - 1);
+    job->rethrow();
+}
+
+int threadCount()
+{
+    return workerPool()->pool.maxThreadCount() + 1;
+}
+
+void setThreadCount(int count)
+{
+    workerPool()->pool.setMaxThreadCount(qMax(1, count - 1));
+}
+
+} // namespace QSchemeParallel
+
+namespace {
+
+// The arguments of every call, one list per item. Lists of unequal length
+// are cut to the shortest, as with map.
+QVector<QSchemeValueList> argumentLists(const QSchemeValue &lists, const char *name)
+{
+    QVector<QSchemeValueList> items;
+    for (QSchemeValue it = lists; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr) {
+        const QSchemeValue list = QSchemeValuePrivate::pair(it)->car;
+        if (!is_list(list))
+            throw qt_scheme_error(name, "expected a list");
+        items.append(list.toList());
+    }
+
+    if (items.isEmpty())
+        throw qt_scheme_error(name, "expected at least one list");
+
+    return items;
+}
+
+template <bool collect>
+QSchemeValue parallelMap(const QSchemeValue &arguments, const char *name)
+{
+    const QSchemeValue procedure = car(arguments);
+    const QVector<QSchemeValueList> lists = argumentLists(cdr(arguments), name);
+
+    int count = lists.first().size();
+    for (const QSchemeValueList &list : lists)
+        count = qMin(count, list.size());
+
+    QSchemeValueList results(collect ? count : 0);
+    QSchemeValue *const out = results.data();
+
+    QSchemeParallel::forEach(count, [&](int index) {
+        QSchemeValue callArguments;
+        for (int i = lists.size() - 1; i >= 0; --i)
+            callArguments = cons(lists.at(i).at(index), callArguments);
+
+        const QSchemeValue result = qt_scheme_call(procedure, callArguments);
+        if (collect)
+            out[index] = result;
+    });
+
+    return collect ? QSchemeValue(results) : QSchemeValue();
+}
+
+// (parallel-map procedure list ...) is map with the calls spread over all
+// cores, in no particular order
+QSchemeValue parallel_map(const QSchemeValue &arguments)
+{
+    return parallelMap<true>(arguments, "parallel-map");
+}
+
+QSchemeValue parallel_for_each(const QSchemeValue &arguments)
+{
+    return parallelMap<false>(arguments, "parallel-for-each");
+}
+
+} // namespace
+
+namespace QSchemeParallel {
+
+const QSchemeBuiltinProcedure procedures[] = {
+    { "parallel-map", parallel_map },
+    { "parallel-for-each", parallel_for_each },
+
+    { nullptr, nullptr }
+};
+
+} // namespace QSchemeParallel
+
+QT_END_NAMESPACE
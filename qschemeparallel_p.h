@@ -0,0 +1,48 @@
+#ifndef QSCHEMEPARALLEL_P_H
+#define QSCHEMEPARALLEL_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+
+// Runs independent work items on a shared pool of threads.
+//
+// The calling thread works along with the pool. Every thread starts on its
+// own slice of the items and steals from the slices of the others once it
+// is done, so items of uneven cost still keep all threads busy. Cycle
+// collection is suspended while items run.
+//
+// Values are reference counted atomically and call frames belong to the
+// thread that makes the call, so procedures can run concurrently as long
+// as they only read shared data. Top level environments are shared: new
+// definitions there fail on worker threads, see qt_scheme_in_parallel, as
+// do the builtins that modify vectors and hash tables.
+namespace QSchemeParallel {
+
+// Calls function(i) for every i in [0, count) and returns once all calls
+// have finished. After an exception, items that have not started yet are
+// skipped and the first exception is rethrown on the calling thread.
+// Calls made from inside an item run sequentially on the calling thread.
+void forEach(int count, const std::function<void(int)> &function);
+
+int threadCount();
+void setThreadCount(int count);
+
+} // namespace QSchemeParallel
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEPARALLEL_P_H
@@ -0,0 +1,291 @@
+#include "qschemeprinter_p.h"
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+namespace {
+
+// characters kept before a device printer writes them out
+const int FlushSize = 16 * 1024;
+
+} // namespace
+
+QSchemePrinter::QSchemePrinter(QString *buffer)
+    : m_buffer(buffer), m_start(buffer->size())
+{
+}
+
+QSchemePrinter::QSchemePrinter(QIODevice *device)
+    : m_buffer(&m_ownBuffer), m_device(device), m_start(0)
+{
+}
+
+QSchemePrinter::~QSchemePrinter()
+{
+    flush();
+}
+
+bool QSchemePrinter::print(const QSchemeValue &value)
+{
+    if (m_truncated)
+        return false;
+
+    m_stack.clear();
+    m_openVectors.clear();
+    open(value);
+
+    while (!m_stack.isEmpty()) {
+        if (!checkLength())
+            return false;
+        flushIfFull();
+
+        Frame &frame = m_stack.last();
+        const QSchemeValue *item = nullptr;
+
+        if (frame.end) {
+            if (frame.next != frame.end)
+                item = frame.next++;
+        } else if (frame.next) {
+            if (QSchemeValuePrivate::isPair(*frame.next)) {
+                const QSchemePairObject *pair = QSchemeValuePrivate::pair(*frame.next);
+                item = &pair->car;
+                frame.next = &pair->cdr;
+            } else if (!is_null(*frame.next)) {
+                m_buffer->append(QLatin1String(" ."));
+                item = frame.next;
+                frame.next = nullptr;
+            }
+        }
+
+        if (!item) {
+            m_buffer->append(QLatin1Char(')'));
+            if (frame.vector)
+                m_openVectors.remove(frame.vector);
+            m_stack.removeLast();
+            continue;
+        }
+
+        if (!frame.first)
+            m_buffer->append(QLatin1Char(' '));
+        frame.first = false;
+
+        // may grow the stack, frame is not used after this
+        open(*item);
+    }
+
+    return checkLength();
+}
+
+bool QSchemePrinter::flush()
+{
+    if (!m_device)
+        return true;
+
+    if (!m_buffer->isEmpty()) {
+        const QByteArray bytes = m_buffer->toUtf8();
+        if (m_device->write(bytes) != bytes.size())
+            m_deviceError = true;
+
+        m_flushed += m_buffer->size();
+        m_buffer->resize(0); // keeps the capacity
+    }
+
+    return !m_deviceError;
+}
+
+// Prints atoms, and the opening of lists and vectors, pushing a frame for
+// their items.
+void QSchemePrinter::open(const QSchemeValue &value)
+{
+    const bool pair = QSchemeValuePrivate::isPair(value);
+    if (!pair && !QSchemeValuePrivate::isObject(value, QSchemeValue::Type::Vector)) {
+        printAtom(value);
+        return;
+    }
+
+    if (m_maxDepth >= 0 && m_stack.size() >= m_maxDepth) {
+        m_buffer->append(QLatin1String("..."));
+        return;
+    }
+
+    if (pair) {
+        m_buffer->append(QLatin1Char('('));
+        m_stack.append(Frame{ &value, nullptr, nullptr, true });
+        return;
+    }
+
+    // pairs are immutable, only vectors can be part of a cycle
+    const QSchemeVectorObject *vector = QSchemeValuePrivate::object<QSchemeVectorObject>(value);
+    if (m_openVectors.contains(vector)) {
+        m_buffer->append(QLatin1String("#<cycle>"));
+        return;
+    }
+
+    m_openVectors.insert(vector);
+    m_buffer->append(QLatin1String("#("));
+    m_stack.append(Frame{ vector->items.constData(), vector->items.constData() + vector->items.size(), vector, true });
+}
+
+void QSchemePrinter::printAtom(const QSchemeValue &value)
+{
+    QString &out = *m_buffer;
+
+    switch (value.type()) {
+    case QSchemeValue::Type::ForeignSyntax:
+        out += QLatin1String("#<ForeignSyntax>");
+        break;
+
+    case QSchemeValue::Type::LambdaProcedure:
+        out += QLatin1String("#<Lambda procedure>");
+        break;
+
+    case QSchemeValue::Type::Symbol:
+        out += value.toSymbol().toString();
+        break;
+
+    case QSchemeValue::Type::Cons:
+        // only the empty list, pairs are opened
+        out += QLatin1String("()");
+        break;
+
+    case QSchemeValue::Type::String:
+    {
+        const QString &string = QSchemeValuePrivate::object<QSchemeStringObject>(value)->string;
+        out += QLatin1Char('"');
+        if (string.contains(QLatin1Char('"')))
+            out += QString(string).replace(QStringLiteral("\""), QStringLiteral("\\\""));
+        else
+            out += string;
+        out += QLatin1Char('"');
+    }
+        break;
+
+    case QSchemeValue::Type::Number:
+        if (QSchemeValuePrivate::isFixnum(value)) {
+            out += QString::number(QSchemeValuePrivate::fixnum(value));
+        } else {
+            // the shortest form that reads back as the same double
+            out += QString::number(QSchemeValuePrivate::flonum(value), 'g', QLocale::FloatingPointShortest);
+        }
+        break;
+
+    case QSchemeValue::Type::Boolean:
+        out += value.toBool() ? QLatin1String("#t") : QLatin1String("#f");
+        break;
+
+    case QSchemeValue::Type::ForeignProcedure:
+        out += QLatin1String("#<Foreign 0x")
+                + QString::number(quintptr(value.toForeignProcedure()), 16)
+                + QLatin1Char('>');
+        break;
+
+    case QSchemeValue::Type::Environment:
+        out += QLatin1String("#<Environment>");
+        break;
+
+    case QSchemeValue::Type::Vector:
+        Q_UNREACHABLE();
+        break;
+
+    case QSchemeValue::Type::Bytevector:
+    {
+        out += QLatin1String("#u8(");
+        bool first = true;
+        for (char byte : qAsConst(QSchemeValuePrivate::object<QSchemeBytevectorObject>(value)->bytes)) {
+            if (!first)
+                out += QLatin1Char(' ');
+            first = false;
+            out += QString::number(uchar(byte));
+        }
+        out += QLatin1Char(')');
+    }
+        break;
+
+    case QSchemeValue::Type::F64Vector:
+    {
+        out += QLatin1String("#f64(");
+        bool first = true;
+        for (double number : qAsConst(QSchemeValuePrivate::object<QSchemeF64VectorObject>(value)->values)) {
+            if (!first)
+                out += QLatin1Char(' ');
+            first = false;
+            out += QString::number(number, 'g', QLocale::FloatingPointShortest);
+        }
+        out += QLatin1Char(')');
+    }
+        break;
+
+    case QSchemeValue::Type::HashTable:
+        out += QStringLiteral("#<HashTable %1>").arg(QSchemeValuePrivate::object<QSchemeHashTableObject>(value)->count);
+        break;
+    }
+}
+
+// Cuts the output down to the maximum length once it went past it.
+bool QSchemePrinter::checkLength()
+{
+    if (m_truncated)
+        return false;
+
+    if (m_maxLength < 0)
+        return true;
+
+    // everything past the limit was printed since the last check, which
+    // came before the last flush
+    const qint64 printed = m_flushed + m_buffer->size() - m_start;
+    if (printed <= m_maxLength)
+        return true;
+
+    m_buffer->chop(int(printed - m_maxLength));
+    m_buffer->append(QLatin1String("..."));
+    m_stack.clear();
+    m_openVectors.clear();
+    m_truncated = true;
+    return false;
+}
+
+void QSchemePrinter::flushIfFull()
+{
+    if (m_device && m_buffer->size() >= FlushSize)
+        flush();
+}
+
+namespace QSchemePrinting {
+
+namespace {
+
+// a limit argument, no limit unless it is a non-negative integer
+qint64 limit(const QSchemeValue &value)
+{
+    return QSchemeValuePrivate::isFixnum(value) ? qMax(QSchemeValuePrivate::fixnum(value), qint64(-1)) : -1;
+}
+
+// (printable-string value [max-length [max-depth]]) -> value as printed
+QSchemeValue printable_string(const QSchemeValue &arguments)
+{
+    const QSchemeValueList values = arguments.toList();
+    if (values.isEmpty())
+        throw qt_scheme_error("printable-string", "expected a value");
+
+    QString string;
+    QSchemePrinter printer(&string);
+    if (values.size() > 1)
+        printer.setMaxLength(limit(values.at(1)));
+    if (values.size() > 2)
+        printer.setMaxDepth(int(qMin(limit(values.at(2)), qint64(INT_MAX))));
+    printer.print(values.first());
+    return string;
+}
+
+} // namespace
+
+const QSchemeBuiltinProcedure procedures[] = {
+    { "printable-string", printable_string },
+
+    { nullptr, nullptr }
+};
+
+} // namespace QSchemePrinting
+
+QT_END_NAMESPACE
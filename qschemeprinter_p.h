@@ -0,0 +1,78 @@
+#ifndef QSCHEMEPRINTER_P_H
+#define QSCHEMEPRINTER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// Prints values the way toPrintableString() shows them, appending to one
+// buffer. Lists and vectors are walked with an explicit stack, so nesting
+// depth costs neither time nor native stack. Vectors can contain themselves,
+// one that is already being printed shows as #<cycle>.
+//
+// Printing to a device writes the buffer out as UTF-8 whenever it has grown
+// past a few kilobytes, and once more on flush() or destruction.
+class QSchemePrinter
+{
+public:
+    explicit QSchemePrinter(QString *buffer);
+    explicit QSchemePrinter(QIODevice *device);
+    ~QSchemePrinter();
+
+    // Limits of the characters printed by this printer and of the levels of
+    // nesting shown, negative for no limit. Output that is cut short ends in
+    // "...", as do lists and vectors nested too deep.
+    void setMaxLength(qint64 length) { m_maxLength = length; }
+    void setMaxDepth(int depth) { m_maxDepth = depth; }
+
+    // Returns false when the output was cut short.
+    bool print(const QSchemeValue &value);
+
+    // Returns false when the device could not be written to.
+    bool flush();
+
+private:
+    struct Frame
+    {
+        // the rest of a list, or the next item of a vector; nullptr once the
+        // tail of an improper list was printed
+        const QSchemeValue *next;
+        const QSchemeValue *end; // of vector items, nullptr for lists
+        const QSchemeHeapObject *vector; // nullptr for lists
+        bool first;
+    };
+
+    void open(const QSchemeValue &value);
+    void printAtom(const QSchemeValue &value);
+    bool checkLength();
+    void flushIfFull();
+
+    QString *m_buffer;
+    QString m_ownBuffer;
+    QIODevice *m_device = nullptr;
+    bool m_deviceError = false;
+    bool m_truncated = false;
+
+    qint64 m_maxLength = -1;
+    int m_maxDepth = -1;
+    qint64 m_start;       // of this printer's output in m_buffer
+    qint64 m_flushed = 0; // characters already written to the device
+
+    QVector<Frame> m_stack;
+    QSet<const QSchemeHeapObject *> m_openVectors;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEPRINTER_P_H
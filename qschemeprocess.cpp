@@ -0,0 +1,337 @@
+#include "qschemeprocess_p.h"
+#include "qschemefiles_p.h"
+
+#include <exception>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+namespace {
+
+QAtomicInt processLimit = qMax(1, QThread::idealThreadCount());
+
+struct Job
+{
+    QStringList command;
+    QSchemeValue output;        // called with every line, nil to collect the output instead
+    QProcess *process = nullptr; // nullptr while queued
+    bool finished = false;
+    bool delivering = false;    // output is being called for a line of this job
+    int exitCode = 0;
+    QString standardOutput;
+    QString standardError;
+};
+
+// Owns the processes, which are its children. Processes still running when
+// the application object is destroyed are killed.
+class ProcessManager : public QObject
+{
+public:
+    explicit ProcessManager(QObject *parent) : QObject(parent) {}
+    ~ProcessManager();
+
+    static ProcessManager *instance(const char *name);
+
+    int spawn(const QStringList &command, const QSchemeValue &output);
+    int waitAny(const QVector<int> &ids, const char *name);
+    QSchemeValue take(int id);
+
+private:
+    void start(Job *job);
+    void startQueued();
+    void finish(Job *job, int exitCode);
+    void deliverLines(Job *job, QProcess::ProcessChannel channel, bool flush);
+    void wake();
+
+    QHash<int, Job *> jobs;
+    QQueue<Job *> queued;
+    int running = 0;
+    int nextId = 1;
+
+    // the event loops of waiting scripts, innermost last
+    QVector<QEventLoop *> loops;
+    // thrown by an output procedure, rethrown by the next wait
+    std::exception_ptr pendingError;
+};
+
+ProcessManager::~ProcessManager()
+{
+    qDeleteAll(jobs);
+}
+
+ProcessManager *ProcessManager::instance(const char *name)
+{
+    static QPointer<ProcessManager> manager;
+
+    if (!manager) {
+        if (!QCoreApplication::instance())
+            throw qt_scheme_error(name, "processes need a QCoreApplication");
+        manager = new ProcessManager(QCoreApplication::instance());
+    }
+
+    if (QThread::currentThread() != manager->thread())
+        throw qt_scheme_error(name, "processes can only be used from the thread that started the first one");
+
+    return manager;
+}
+
+int ProcessManager::spawn(const QStringList &command, const QSchemeValue &output)
+{
+    Job *job = new Job;
+    job->command = command;
+    job->output = output;
+
+    const int id = nextId++;
+    jobs.insert(id, job);
+    queued.enqueue(job);
+    startQueued();
+    return id;
+}
+
+void ProcessManager::startQueued()
+{
+    while (!queued.isEmpty() && running < processLimit.load())
+        start(queued.dequeue());
+}
+
+void ProcessManager::start(Job *job)
+{
+    QProcess *process = new QProcess(this);
+    job->process = process;
+    ++running;
+
+    if (!is_null(job->output)) {
+        connect(process, &QProcess::readyReadStandardOutput, this, [this, job]() {
+            deliverLines(job, QProcess::StandardOutput, false);
+        });
+        connect(process, &QProcess::readyReadStandardError, this, [this, job]() {
+            deliverLines(job, QProcess::StandardError, false);
+        });
+    }
+
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+            [this, job](int exitCode, QProcess::ExitStatus status) {
+        finish(job, status == QProcess::NormalExit ? exitCode : -1);
+    });
+
+    // processes that fail to start never finish
+    connect(process, &QProcess::errorOccurred, this, [this, job](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+            job->standardError = job->process->errorString();
+            finish(job, -1);
+        }
+    });
+
+    QStringList arguments = job->command;
+    process->start(arguments.takeFirst(), arguments);
+}
+
+void ProcessManager::finish(Job *job, int exitCode)
+{
+    if (job->finished)
+        return;
+
+    if (is_null(job->output)) {
+        job->standardOutput += QString::fromLocal8Bit(job->process->readAllStandardOutput());
+        job->standardError += QString::fromLocal8Bit(job->process->readAllStandardError());
+    } else {
+        deliverLines(job, QProcess::StandardOutput, true);
+        deliverLines(job, QProcess::StandardError, true);
+    }
+
+    job->finished = true;
+    job->exitCode = exitCode;
+    --running;
+
+    // the process may have created, changed or removed any file
+    QSchemeFiles::invalidateAll();
+
+    startQueued();
+    wake();
+}
+
+// Calls the output procedure of job with every complete line read from
+// channel, and with the rest of the output too when flushing.
+void ProcessManager::deliverLines(Job *job, QProcess::ProcessChannel channel, bool flush)
+{
+    QProcess *process = job->process;
+    const QSchemeValue stream(QSchemeSymbolLiteral(channel == QProcess::StandardOutput ? "stdout" : "stderr"));
+
+    process->setReadChannel(channel);
+
+    while (!is_null(job->output) && (process->canReadLine() || (flush && process->bytesAvailable() > 0))) {
+        QByteArray line = process->readLine();
+        if (line.endsWith('\n'))
+            line.chop(1);
+        if (line.endsWith('\r'))
+            line.chop(1);
+
+        job->delivering = true;
+        try {
+            qt_scheme_call(job->output, list(QSchemeValue(QString::fromLocal8Bit(line)), stream));
+        } catch (...) {
+            // stop streaming this job, the output that follows is dropped
+            if (!pendingError)
+                pendingError = std::current_exception();
+            job->output = QSchemeValue();
+            wake();
+        }
+        job->delivering = false;
+    }
+
+    if (is_null(job->output))
+        process->readAll();
+}
+
+void ProcessManager::wake()
+{
+    // an outer loop may be waiting for what just happened, it goes on
+    // waiting by itself otherwise
+    for (QEventLoop *loop : qAsConst(loops))
+        loop->quit();
+}
+
+int ProcessManager::waitAny(const QVector<int> &ids, const char *name)
+{
+    for (int id : ids) {
+        const Job *job = jobs.value(id);
+        if (!job)
+            throw qt_scheme_error(name, "unknown process");
+        if (job->delivering)
+            throw qt_scheme_error(name, "cannot wait for a process from its own output procedure");
+    }
+
+    forever {
+        if (pendingError) {
+            const std::exception_ptr exception = pendingError;
+            pendingError = nullptr;
+            std::rethrow_exception(exception);
+        }
+
+        for (int id : ids) {
+            // a nested wait may have taken it meanwhile
+            const Job *job = jobs.value(id);
+            if (!job)
+                throw qt_scheme_error(name, "unknown process");
+            if (job->finished)
+                return id;
+        }
+
+        QEventLoop loop;
+        loops.append(&loop);
+        loop.exec();
+        loops.removeLast();
+    }
+}
+
+// The result of a finished process: (exit-code stdout stderr). The handle
+// is invalid afterwards.
+QSchemeValue ProcessManager::take(int id)
+{
+    Job *job = jobs.take(id);
+    Q_ASSERT(job && job->finished);
+
+    const QSchemeValue result = list(QSchemeValue(job->exitCode), job->standardOutput, job->standardError);
+
+    // we may be inside one of its signals
+    job->process->disconnect(this);
+    job->process->deleteLater();
+    delete job;
+    return result;
+}
+
+QStringList command(const QSchemeValue &value, const char *name)
+{
+    QStringList result;
+    for (QSchemeValue it = value; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr) {
+        const QSchemeValue part = QSchemeValuePrivate::pair(it)->car;
+        if (!is_string(part))
+            throw qt_scheme_error(name, "expected a list of strings");
+        result.append(part.toString());
+    }
+
+    if (result.isEmpty())
+        throw qt_scheme_error(name, "expected a program to run");
+
+    return result;
+}
+
+int handle(const QSchemeValue &value, const char *name)
+{
+    if (!QSchemeValuePrivate::isFixnum(value))
+        throw qt_scheme_error(name, "expected a process");
+
+    return int(QSchemeValuePrivate::fixnum(value));
+}
+
+// (process-spawn (program argument ...) [output]) starts program and returns
+// its handle right away. With output, the procedure is called as
+// (output line 'stdout) or (output line 'stderr) for every line the program
+// writes, while the script waits for any process, instead of collecting the
+// output in memory.
+QSchemeValue process_spawn(const QSchemeValue &arguments)
+{
+    ProcessManager *manager = ProcessManager::instance("process-spawn");
+    const QStringList parts = command(car(arguments), "process-spawn");
+
+    QSchemeValue output;
+    if (is_pair(cdr(arguments))) {
+        output = cadr(arguments);
+        if (!is_foreign_procedure(output) && !is_native_procedure(output))
+            throw qt_scheme_error("process-spawn", "expected a procedure for the output");
+    }
+
+    return QSchemeValue(manager->spawn(parts, output));
+}
+
+// (process-wait handle) -> (exit-code stdout stderr)
+QSchemeValue process_wait(const QSchemeValue &arguments)
+{
+    ProcessManager *manager = ProcessManager::instance("process-wait");
+    const int id = manager->waitAny({ handle(car(arguments), "process-wait") }, "process-wait");
+    return manager->take(id);
+}
+
+// (process-wait-any (handle ...)) -> (handle exit-code stdout stderr) of
+// the first of them to finish
+QSchemeValue process_wait_any(const QSchemeValue &arguments)
+{
+    ProcessManager *manager = ProcessManager::instance("process-wait-any");
+
+    QVector<int> ids;
+    for (QSchemeValue it = car(arguments); is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        ids.append(handle(QSchemeValuePrivate::pair(it)->car, "process-wait-any"));
+
+    if (ids.isEmpty())
+        throw qt_scheme_error("process-wait-any", "expected a list of processes");
+
+    const int id = manager->waitAny(ids, "process-wait-any");
+    return cons(QSchemeValue(id), manager->take(id));
+}
+
+} // namespace
+
+namespace QSchemeProcesses {
+
+void setLimit(int count)
+{
+    processLimit.store(qMax(1, count));
+}
+
+int limit()
+{
+    return processLimit.load();
+}
+
+const QSchemeBuiltinProcedure procedures[] = {
+    { "process-spawn", process_spawn },
+    { "process-wait", process_wait },
+    { "process-wait-any", process_wait_any },
+
+    { nullptr, nullptr }
+};
+
+} // namespace QSchemeProcesses
+
+QT_END_NAMESPACE
@@ -0,0 +1,35 @@
+#ifndef QSCHEMEPROCESS_P_H
+#define QSCHEMEPROCESS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// Child processes started by process-spawn. They run asynchronously and are
+// driven by the Qt event loop, which runs while a script waits for one of
+// them. At most limit() processes run at once, further ones are queued and
+// started as running ones finish.
+//
+// Processes belong to the thread that created the first one, the builtins
+// fail on any other thread.
+namespace QSchemeProcesses {
+
+void setLimit(int count);
+int limit();
+
+} // namespace QSchemeProcesses
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEPROCESS_P_H
@@ -0,0 +1,241 @@
+#include "qschemeprofiler_p.h"
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+bool qt_scheme_profiling = false;
+
+namespace {
+
+// A procedure as called from the procedures on the path to it.
+struct Node
+{
+    Node(const QString &name, Node *parent) : name(name), parent(parent) {}
+    ~Node() { qDeleteAll(children); }
+
+    const QString name;
+    Node *const parent;
+    QHash<QString, Node *> children;
+
+    qint64 calls = 0;
+    qint64 self = 0;  // nanoseconds
+    qint64 total = 0; // nanoseconds, of activations not inside another of the same procedure
+};
+
+struct Activation
+{
+    Node *node;
+    qint64 start;
+    qint64 children;
+    bool outermost;
+};
+
+struct ThreadProfile
+{
+    ThreadProfile() : root(QString(), nullptr) { clock.start(); }
+
+    Node root;
+    QVector<Activation> stack;
+    QHash<QString, int> active; // activations on the stack by name
+    QHash<quintptr, QString> foreignNames;
+    QElapsedTimer clock;
+};
+
+// Profiles outlive their threads, pool threads come and go.
+struct Profiles
+{
+    ~Profiles() { qDeleteAll(threads); }
+
+    QMutex mutex;
+    QVector<ThreadProfile *> threads;
+};
+
+Q_GLOBAL_STATIC(Profiles, profiles)
+
+thread_local ThreadProfile *currentProfile = nullptr;
+
+ThreadProfile *profile()
+{
+    if (Q_UNLIKELY(!currentProfile)) {
+        currentProfile = new ThreadProfile;
+
+        QMutexLocker locker(&profiles()->mutex);
+        profiles()->threads.append(currentProfile);
+    }
+
+    return currentProfile;
+}
+
+void enterNamed(const QString &name)
+{
+    ThreadProfile *p = profile();
+
+    Node *parent = p->stack.isEmpty() ? &p->root : p->stack.last().node;
+    Node *&node = parent->children[name];
+    if (!node)
+        node = new Node(name, parent);
+
+    ++node->calls;
+
+    int &active = p->active[name];
+    p->stack.append(Activation{ node, p->clock.nsecsElapsed(), 0, active == 0 });
+    ++active;
+}
+
+QString lambdaName(const QSchemeLambdaObject *lambda)
+{
+    return lambda->name.isEmpty() ? QStringLiteral("<lambda>") : lambda->name;
+}
+
+struct Totals
+{
+    qint64 calls = 0;
+    qint64 self = 0;
+    qint64 total = 0;
+};
+
+void addTotals(const Node *node, QHash<QString, Totals> *totals)
+{
+    for (const Node *child : node->children) {
+        Totals &sum = (*totals)[child->name];
+        sum.calls += child->calls;
+        sum.self += child->self;
+        sum.total += child->total;
+        addTotals(child, totals);
+    }
+}
+
+void addStacks(const Node *node, const QString &path, QMap<QString, qint64> *stacks)
+{
+    for (const Node *child : node->children) {
+        const QString childPath = path.isEmpty() ? child->name : path + QLatin1Char(';') + child->name;
+        if (child->self >= 1000)
+            (*stacks)[childPath] += child->self / 1000;
+        addStacks(child, childPath, stacks);
+    }
+}
+
+} // namespace
+
+namespace QSchemeProfiler {
+
+void enter(const QSchemeLambdaObject *lambda)
+{
+    enterNamed(lambdaName(lambda));
+}
+
+void enter(QSchemeValue::foreign_proc_t procedure)
+{
+    ThreadProfile *p = profile();
+
+    const quintptr key = reinterpret_cast<quintptr>(procedure);
+    auto it = p->foreignNames.find(key);
+    if (it == p->foreignNames.end()) {
+        QString name = QSchemeBuiltins::name(QSchemeValue(procedure)).toString();
+        if (name.isEmpty())
+            name = QStringLiteral("<foreign procedure>");
+        it = p->foreignNames.insert(key, name);
+    }
+
+    enterNamed(*it);
+}
+
+void replace(const QSchemeLambdaObject *lambda)
+{
+    leave();
+    enter(lambda);
+}
+
+void leave()
+{
+    ThreadProfile *p = profile();
+
+    // profiling was enabled inside the call
+    if (p->stack.isEmpty())
+        return;
+
+    const Activation activation = p->stack.takeLast();
+    const qint64 elapsed = p->clock.nsecsElapsed() - activation.start;
+
+    activation.node->self += elapsed - activation.children;
+    if (activation.outermost)
+        activation.node->total += elapsed;
+
+    const auto it = p->active.find(activation.node->name);
+    if (--*it == 0)
+        p->active.erase(it);
+
+    if (!p->stack.isEmpty())
+        p->stack.last().children += elapsed;
+}
+
+int depth()
+{
+    return profile()->stack.size();
+}
+
+void unwind(int depth)
+{
+    while (profile()->stack.size() > depth)
+        leave();
+}
+
+// Procedures by the time spent in them, not counting the procedures they
+// called.
+QString report()
+{
+    QHash<QString, Totals> totals;
+    {
+        QMutexLocker locker(&profiles()->mutex);
+        for (const ThreadProfile *p : qAsConst(profiles()->threads))
+            addTotals(&p->root, &totals);
+    }
+
+    QVector<QPair<QString, Totals>> rows;
+    for (auto it = totals.cbegin(); it != totals.cend(); ++it)
+        rows.append(qMakePair(it.key(), it.value()));
+
+    std::sort(rows.begin(), rows.end(), [](const QPair<QString, Totals> &a, const QPair<QString, Totals> &b) {
+        return a.second.self != b.second.self ? a.second.self > b.second.self : a.first < b.first;
+    });
+
+    QString result = QStringLiteral("%1 %2 %3  %4\n")
+            .arg(QStringLiteral("calls"), 12)
+            .arg(QStringLiteral("total ms"), 12)
+            .arg(QStringLiteral("self ms"), 12)
+            .arg(QStringLiteral("procedure"));
+
+    for (const auto &row : qAsConst(rows)) {
+        result += QStringLiteral("%1 %2 %3  %4\n")
+                .arg(row.second.calls, 12)
+                .arg(row.second.total / 1e6, 12, 'f', 3)
+                .arg(row.second.self / 1e6, 12, 'f', 3)
+                .arg(row.first);
+    }
+
+    return result;
+}
+
+// One line per call stack, its procedures separated by semicolons and
+// followed by the microseconds spent in the last one, as read by
+// flamegraph.pl and similar tools.
+QString collapsedStacks()
+{
+    QMap<QString, qint64> stacks;
+    {
+        QMutexLocker locker(&profiles()->mutex);
+        for (const ThreadProfile *p : qAsConst(profiles()->threads))
+            addStacks(&p->root, QString(), &stacks);
+    }
+
+    QString result;
+    for (auto it = stacks.cbegin(); it != stacks.cend(); ++it)
+        result += it.key() + QLatin1Char(' ') + QString::number(it.value()) + QLatin1Char('\n');
+
+    return result;
+}
+
+} // namespace QSchemeProfiler
+
+QT_END_NAMESPACE
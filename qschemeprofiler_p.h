@@ -0,0 +1,102 @@
+#ifndef QSCHEMEPROFILER_P_H
+#define QSCHEMEPROFILER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// Set before any script runs to profile them. Every hook in the evaluators
+// tests it first, so profiling costs a single branch per call when off.
+extern bool qt_scheme_profiling;
+
+// Calls and time per procedure, kept as a tree of call stacks for every
+// thread. Lambdas are known by the name they were first defined with,
+// builtins by theirs. Tail calls replace the caller on the stack, as they
+// do in the evaluators.
+//
+// The car, cdr, cons, eq? and arithmetic the bytecode compiler inlines are
+// not calls and are not profiled.
+namespace QSchemeProfiler {
+
+void enter(const QSchemeLambdaObject *lambda);
+void enter(QSchemeValue::foreign_proc_t procedure);
+void replace(const QSchemeLambdaObject *lambda);
+void leave();
+
+// For leaving everything entered since depth() when an exception unwinds.
+int depth();
+void unwind(int depth);
+
+// Both must be called while no script runs.
+QString report();
+QString collapsedStacks();
+
+// Gives an anonymous lambda the name it is defined as. Only called while
+// profiling, lambdas defined before show as <lambda>.
+inline void name(const QSchemeValue &procedure, const QSchemeValue &name)
+{
+    // procedures shared between threads are only named by the one that
+    // created them, parallel code cannot define globals anyway
+    if (qt_scheme_in_parallel || !QSchemeValuePrivate::isObject(procedure, QSchemeValue::Type::LambdaProcedure))
+        return;
+
+    QSchemeLambdaObject *lambda = QSchemeValuePrivate::object<QSchemeLambdaObject>(procedure);
+    if (lambda->name.isEmpty())
+        lambda->name = name.toSymbol().toString();
+}
+
+// A call that ends with the scope. A lambda called again in the same scope
+// is a tail call, replacing the one before.
+class Scope
+{
+public:
+    Scope() = default;
+    ~Scope() { end(); }
+
+    void call(const QSchemeLambdaObject *lambda)
+    {
+        if (m_entered) {
+            replace(lambda);
+        } else {
+            enter(lambda);
+            m_entered = true;
+        }
+    }
+
+    void call(QSchemeValue::foreign_proc_t procedure)
+    {
+        end();
+        enter(procedure);
+        m_entered = true;
+    }
+
+    void end()
+    {
+        if (m_entered) {
+            leave();
+            m_entered = false;
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(Scope)
+
+    bool m_entered = false;
+};
+
+} // namespace QSchemeProfiler
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEPROFILER_P_H
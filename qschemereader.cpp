@@ -0,0 +1,315 @@
+#include "qschemereader_p.h"
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+namespace {
+
+enum {
+    ChunkSize = 64 * 1024
+};
+
+inline bool isDigit(QChar c)
+{
+    return c.unicode() >= '0' && c.unicode() <= '9';
+}
+
+inline bool isAtomSeparator(QChar c)
+{
+    switch (c.unicode()) {
+    case '(':
+    case ')':
+    case ';':
+        return true;
+    default:
+        return c.isSpace();
+    }
+}
+
+// Decimal numbers: [+-]digits[.digits][(e|E)[+-]digits], where either the
+// integer or the fractional digits may be left out. Integers that fit into
+// an int become fixnums, all other numbers doubles.
+bool scanNumber(QStringView text, QSchemeValue *value)
+{
+    const QChar *it = text.begin();
+    const QChar *const end = text.end();
+
+    bool negative = false;
+    if (it != end && (*it == QLatin1Char('+') || *it == QLatin1Char('-'))) {
+        negative = *it == QLatin1Char('-');
+        ++it;
+    }
+
+    qint64 integer = 0;
+    int digits = 0;
+    for (; it != end && isDigit(*it); ++it, ++digits) {
+        // stop accumulating once the value cannot fit a fixnum anyway
+        if (integer <= QSchemeValuePrivate::FixnumMax)
+            integer = integer * 10 + (it->unicode() - '0');
+    }
+
+    if (it == end) {
+        if (digits == 0)
+            return false;
+
+        if (negative)
+            integer = -integer;
+
+        if (QSchemeValuePrivate::fitsFixnum(integer)) {
+            *value = QSchemeValuePrivate::fromFixnum(integer);
+            return true;
+        }
+    } else {
+        if (*it == QLatin1Char('.')) {
+            for (++it; it != end && isDigit(*it); ++it)
+                ++digits;
+        }
+
+        if (digits == 0)
+            return false;
+
+        if (it != end && (*it == QLatin1Char('e') || *it == QLatin1Char('E'))) {
+            ++it;
+            if (it != end && (*it == QLatin1Char('+') || *it == QLatin1Char('-')))
+                ++it;
+
+            const QChar *const exponent = it;
+            while (it != end && isDigit(*it))
+                ++it;
+
+            if (it == exponent)
+                return false;
+        }
+
+        if (it != end)
+            return false;
+    }
+
+    bool ok;
+    const double d = QLocale::c().toDouble(text, &ok);
+    if (!ok)
+        return false;
+
+    *value = QSchemeValue(d);
+    return true;
+}
+
+} // namespace
+
+QSchemeReader::QSchemeReader(QStringView source)
+    : m_input(source)
+{
+}
+
+QSchemeReader::QSchemeReader(QIODevice *device)
+    : m_stream(new QTextStream(device))
+{
+}
+
+QSchemeReader::~QSchemeReader()
+{
+}
+
+// Makes sure the character offset positions past the current one is
+// buffered. Refilling may move the buffer, but keeps the current position
+// pointing at the same character.
+inline bool QSchemeReader::available(int offset)
+{
+    while (m_position + offset >= m_input.size()) {
+        if (!fill())
+            return false;
+    }
+
+    return true;
+}
+
+bool QSchemeReader::fill()
+{
+    if (!m_stream || m_stream->atEnd())
+        return false;
+
+    m_buffer.remove(0, m_position);
+    m_buffer.append(m_stream->read(ChunkSize));
+
+    m_input = m_buffer;
+    m_position = 0;
+    return true;
+}
+
+void QSchemeReader::skipWhitespace()
+{
+    while (available(0)) {
+        const QChar current = m_input.at(m_position);
+
+        if (current == QLatin1Char(';')) {
+            while (available(0) && m_input.at(m_position) != QLatin1Char('\n'))
+                ++m_position;
+        } else if (current.isSpace()) {
+            ++m_position;
+        } else {
+            return;
+        }
+    }
+}
+
+bool QSchemeReader::atEnd()
+{
+    skipWhitespace();
+    return !available(0);
+}
+
+QSchemeReader::Token QSchemeReader::nextToken()
+{
+    skipWhitespace();
+
+    if (!available(0))
+        return { TokenType::End, QStringView() };
+
+    TokenType type = TokenType::Atom;
+    int length = 1;
+
+    switch (m_input.at(m_position).unicode()) {
+    case '(':
+        type = TokenType::OpenParen;
+        break;
+
+    case ')':
+        type = TokenType::CloseParen;
+        break;
+
+    case '\'':
+        type = TokenType::Quote;
+        break;
+
+    case '"':
+        type = TokenType::String;
+
+        forever {
+            if (!available(length))
+                throw QSchemeException("Unexpected EOF while reading!");
+
+            const QChar current = m_input.at(m_position + length++);
+            if (current == QLatin1Char('"'))
+                break;
+
+            if (current == QLatin1Char('\\') && available(length) && m_input.at(m_position + length) == QLatin1Char('"'))
+                ++length;
+        }
+        break;
+
+    default:
+        while (available(length) && !isAtomSeparator(m_input.at(m_position + length)))
+            ++length;
+        break;
+    }
+
+    const Token token = { type, m_input.mid(m_position, length) };
+    m_position += length;
+    return token;
+}
+
+QSchemeValue QSchemeReader::read()
+{
+    return datum(nextToken());
+}
+
+QSchemeValue QSchemeReader::datum(const Token &token)
+{
+    switch (token.type) {
+    case TokenType::End:
+        throw QSchemeException("Unexpected EOF while reading!");
+
+    case TokenType::OpenParen:
+        return readList();
+
+    case TokenType::CloseParen:
+        throw QSchemeException("Unexpected )");
+
+    case TokenType::Quote: {
+        static const QSchemeSymbol quote = QSchemeSymbolLiteral("quote");
+        return list(QSchemeValue(quote), read());
+    }
+
+    case TokenType::String:
+        return QSchemeValue(unescape(token.text));
+
+    case TokenType::Atom:
+        break;
+    }
+
+    return atom(token.text);
+}
+
+QSchemeValue QSchemeReader::readList()
+{
+    // deeply nested input would overflow the native stack otherwise
+    const QSchemeRecursionGuard guard;
+
+    QVarLengthArray<QSchemeValue, 16> items;
+    QSchemeValue tail;
+
+    forever {
+        const Token token = nextToken();
+
+        if (token.type == TokenType::CloseParen)
+            break;
+
+        if (token.type == TokenType::End)
+            throw QSchemeException("Expected )");
+
+        if (token.type == TokenType::Atom && token.text.size() == 1 && token.text.at(0) == QLatin1Char('.')
+                && !items.isEmpty()) {
+            tail = read();
+
+            if (nextToken().type != TokenType::CloseParen)
+                throw QSchemeException("Expected )");
+            break;
+        }
+
+        items.append(datum(token));
+    }
+
+    for (int i = items.size() - 1; i >= 0; --i)
+        tail = cons(items.at(i), tail);
+
+    return tail;
+}
+
+QString QSchemeReader::unescape(QStringView text)
+{
+    const QStringView contents = text.mid(1, text.size() - 2);
+
+    QString result;
+    result.reserve(int(contents.size()));
+
+    for (int i = 0; i < contents.size(); ++i) {
+        if (contents.at(i) == QLatin1Char('\\') && i + 1 < contents.size()
+                && contents.at(i + 1) == QLatin1Char('"')) {
+            ++i;
+        }
+
+        result.append(contents.at(i));
+    }
+
+    return result;
+}
+
+QSchemeValue QSchemeReader::atom(QStringView text)
+{
+    if (text.size() == 2 && text.at(0) == QLatin1Char('#')) {
+        if (text.at(1) == QLatin1Char('t'))
+            return QSchemeValue(true);
+        if (text.at(1) == QLatin1Char('f'))
+            return QSchemeValue(false);
+    }
+
+    QSchemeValue number;
+    if (!text.isEmpty() && scanNumber(text, &number))
+        return number;
+
+    return QSchemeValue(QSchemeSymbol(text));
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,67 @@
+#ifndef QSCHEMEREADER_P_H
+#define QSCHEMEREADER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme.h"
+
+QT_BEGIN_NAMESPACE
+
+// Reads one datum at a time from a string or, in chunks, from a device.
+//
+// Tokens are views into the buffered text; only string literals and symbols
+// that are not interned yet are copied out of it. A token that straddles a
+// chunk boundary moves the unread rest of the buffer to its front, so memory
+// use is bounded by the chunk size and the longest token, not the input.
+class QSchemeReader
+{
+public:
+    explicit QSchemeReader(QStringView source);
+    explicit QSchemeReader(QIODevice *device);
+    ~QSchemeReader();
+
+    enum class TokenType { End, OpenParen, CloseParen, Quote, String, Atom };
+
+    struct Token
+    {
+        TokenType type;
+        QStringView text; // valid until the next call of nextToken()
+    };
+
+    // true when only whitespace and comments are left
+    bool atEnd();
+    QSchemeValue read();
+    Token nextToken();
+
+    // text is a string token including its double quotes
+    static QString unescape(QStringView text);
+    static QSchemeValue atom(QStringView text);
+
+private:
+    bool available(int offset);
+    bool fill();
+    void skipWhitespace();
+
+    QSchemeValue datum(const Token &token);
+    QSchemeValue readList();
+
+    QScopedPointer<QTextStream> m_stream;
+    QString m_buffer;
+    QStringView m_input;
+    int m_position = 0;
+
+    Q_DISABLE_COPY(QSchemeReader)
+};
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEREADER_P_H
@@ -0,0 +1,117 @@
+#include "qschemestatistics_p.h"
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+#ifdef QT_SCHEME_STATISTICS
+thread_local QSchemeThreadCounters qt_scheme_statistics;
+
+namespace {
+
+void add(QSchemeStatistics *sum, const QSchemeThreadCounters &counts)
+{
+    sum->valueCopies += counts.valueCopies.load();
+    sum->allocations += counts.allocations.load();
+    sum->pairs += counts.pairs.load();
+    sum->listConversions += counts.listConversions.load();
+    sum->frames += counts.frames.load();
+    sum->symbolLookups += counts.symbolLookups.load();
+    sum->symbolProbes += counts.symbolProbes.load();
+    sum->exceptions += counts.exceptions.load();
+}
+
+struct Registry
+{
+    QMutex mutex;
+    QSet<const QSchemeThreadCounters *> threads;
+    QSchemeStatistics finished = {};
+};
+
+Q_GLOBAL_STATIC(Registry, registry)
+
+// Lives as long as its thread.
+struct Registration
+{
+    Registration()
+    {
+        QMutexLocker locker(&registry()->mutex);
+        registry()->threads.insert(&qt_scheme_statistics);
+    }
+
+    ~Registration()
+    {
+        if (registry.isDestroyed())
+            return;
+
+        QMutexLocker locker(&registry()->mutex);
+        registry()->threads.remove(&qt_scheme_statistics);
+        add(&registry()->finished, qt_scheme_statistics);
+    }
+};
+
+} // namespace
+#endif
+
+namespace QSchemeCounters {
+
+#ifdef QT_SCHEME_STATISTICS
+void registerThread()
+{
+    thread_local Registration registration;
+    Q_UNUSED(registration);
+}
+#endif
+
+QSchemeStatistics sum()
+{
+    QSchemeStatistics result = {};
+
+#ifdef QT_SCHEME_STATISTICS
+    registerThread();
+
+    QMutexLocker locker(&registry()->mutex);
+    result = registry()->finished;
+    for (const QSchemeThreadCounters *counts : qAsConst(registry()->threads))
+        add(&result, *counts);
+#endif
+
+    return result;
+}
+
+} // namespace QSchemeCounters
+
+namespace {
+
+// (runtime-stats) -> ((value-copies . n) (allocations . n) ...)
+QSchemeValue runtime_stats(const QSchemeValue &)
+{
+    const QSchemeStatistics counts = QSchemeCounters::sum();
+
+    const auto entry = [](const char *name, quint64 count) {
+        return cons(QSchemeValue(QSchemeSymbolLiteral(name)), QSchemeValuePrivate::integer(qint64(count)));
+    };
+
+    return list(entry("value-copies", counts.valueCopies),
+                entry("allocations", counts.allocations),
+                entry("pairs", counts.pairs),
+                entry("list-conversions", counts.listConversions),
+                entry("frames", counts.frames),
+                entry("symbol-lookups", counts.symbolLookups),
+                entry("symbol-probes", counts.symbolProbes),
+                entry("exceptions", counts.exceptions));
+}
+
+} // namespace
+
+namespace QSchemeCounters {
+
+const QSchemeBuiltinProcedure procedures[] = {
+    { "runtime-stats", runtime_stats },
+
+    { nullptr, nullptr }
+};
+
+} // namespace QSchemeCounters
+
+QT_END_NAMESPACE
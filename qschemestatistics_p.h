@@ -0,0 +1,36 @@
+#ifndef QSCHEMESTATISTICS_P_H
+#define QSCHEMESTATISTICS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// The counters of every thread are thread local variables. Threads register
+// them before running scripts so they can be summed up; the counts of
+// threads that finished are kept.
+namespace QSchemeCounters {
+
+#ifdef QT_SCHEME_STATISTICS
+void registerThread();
+#else
+inline void registerThread() {}
+#endif
+
+QSchemeStatistics sum();
+
+} // namespace QSchemeCounters
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMESTATISTICS_P_H
@@ -0,0 +1,721 @@
+#include "qschemevector_p.h"
+#include "qschemenumber_p.h"
+
+#include <QtCore/private/qsimd_p.h>
+#include <cstring>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+namespace {
+
+// Element-wise operations, one loop per instruction set. Op provides the
+// scalar, SSE2 and AVX forms of the operation.
+struct AddOp
+{
+    static inline double scalar(double a, double b) { return a + b; }
+#ifdef __SSE2__
+    static inline __m128d sse2(__m128d a, __m128d b) { return _mm_add_pd(a, b); }
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(AVX)
+    QT_FUNCTION_TARGET(AVX) static inline __m256d avx(__m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+#endif
+};
+
+struct SubtractOp
+{
+    static inline double scalar(double a, double b) { return a - b; }
+#ifdef __SSE2__
+    static inline __m128d sse2(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(AVX)
+    QT_FUNCTION_TARGET(AVX) static inline __m256d avx(__m256d a, __m256d b) { return _mm256_sub_pd(a, b); }
+#endif
+};
+
+struct MultiplyOp
+{
+    static inline double scalar(double a, double b) { return a * b; }
+#ifdef __SSE2__
+    static inline __m128d sse2(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(AVX)
+    QT_FUNCTION_TARGET(AVX) static inline __m256d avx(__m256d a, __m256d b) { return _mm256_mul_pd(a, b); }
+#endif
+};
+
+// NaN when either is NaN, in every form, so a reduction does not depend on
+// which lane a NaN lands in. minpd returns its second operand when either
+// is NaN, so that one is a, and a NaN b sets all bits of its lane.
+struct MinOp
+{
+    static inline double scalar(double a, double b) { return a < b || qIsNaN(a) ? a : b; }
+#ifdef __SSE2__
+    static inline __m128d sse2(__m128d a, __m128d b) { return _mm_or_pd(_mm_min_pd(b, a), _mm_cmpunord_pd(b, b)); }
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(AVX)
+    QT_FUNCTION_TARGET(AVX) static inline __m256d avx(__m256d a, __m256d b) {
+        return _mm256_or_pd(_mm256_min_pd(b, a), _mm256_cmp_pd(b, b, _CMP_UNORD_Q));
+    }
+#endif
+};
+
+struct MaxOp
+{
+    static inline double scalar(double a, double b) { return a > b || qIsNaN(a) ? a : b; }
+#ifdef __SSE2__
+    static inline __m128d sse2(__m128d a, __m128d b) { return _mm_or_pd(_mm_max_pd(b, a), _mm_cmpunord_pd(b, b)); }
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(AVX)
+    QT_FUNCTION_TARGET(AVX) static inline __m256d avx(__m256d a, __m256d b) {
+        return _mm256_or_pd(_mm256_max_pd(b, a), _mm256_cmp_pd(b, b, _CMP_UNORD_Q));
+    }
+#endif
+};
+
+#if QT_COMPILER_SUPPORTS_HERE(AVX)
+template <typename Op>
+QT_FUNCTION_TARGET(AVX)
+static int elementWiseAvx(const double *a, const double *b, double *result, int size)
+{
+    int i = 0;
+    for (; i + 4 <= size; i += 4)
+        _mm256_storeu_pd(result + i, Op::avx(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    return i;
+}
+
+// Folds size elements, at least 8, into the first element of the result.
+template <typename Op>
+QT_FUNCTION_TARGET(AVX)
+static double reduceAvx(const double *data, int size, int *done)
+{
+    __m256d acc0 = _mm256_loadu_pd(data);
+    __m256d acc1 = _mm256_loadu_pd(data + 4);
+
+    int i = 8;
+    for (; i + 8 <= size; i += 8) {
+        acc0 = Op::avx(acc0, _mm256_loadu_pd(data + i));
+        acc1 = Op::avx(acc1, _mm256_loadu_pd(data + i + 4));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, Op::avx(acc0, acc1));
+    *done = i;
+    return Op::scalar(Op::scalar(lanes[0], lanes[1]), Op::scalar(lanes[2], lanes[3]));
+}
+#endif
+
+template <typename Op>
+static void elementWise(const double *a, const double *b, double *result, int size)
+{
+    int i = 0;
+
+#if QT_COMPILER_SUPPORTS_HERE(AVX)
+    if (qCpuHasFeature(AVX))
+        i = elementWiseAvx<Op>(a, b, result, size);
+#endif
+
+#ifdef __SSE2__
+    for (; i + 2 <= size; i += 2)
+        _mm_storeu_pd(result + i, Op::sse2(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+#endif
+
+    for (; i < size; ++i)
+        result[i] = Op::scalar(a[i], b[i]);
+}
+
+// Folds a non-empty range with two independent accumulators per lane, so
+// consecutive operations do not wait for each other.
+template <typename Op>
+static double reduce(const double *data, int size)
+{
+    int i = 1;
+    double result = data[0];
+
+#if QT_COMPILER_SUPPORTS_HERE(AVX)
+    if (size >= 8 && qCpuHasFeature(AVX)) {
+        result = reduceAvx<Op>(data, size, &i);
+    } else
+#endif
+#ifdef __SSE2__
+    if (size >= 4) {
+        __m128d acc0 = _mm_loadu_pd(data);
+        __m128d acc1 = _mm_loadu_pd(data + 2);
+
+        for (i = 4; i + 4 <= size; i += 4) {
+            acc0 = Op::sse2(acc0, _mm_loadu_pd(data + i));
+            acc1 = Op::sse2(acc1, _mm_loadu_pd(data + i + 2));
+        }
+
+        double lanes[2];
+        _mm_storeu_pd(lanes, Op::sse2(acc0, acc1));
+        result = Op::scalar(lanes[0], lanes[1]);
+    }
+#endif
+
+    for (; i < size; ++i)
+        result = Op::scalar(result, data[i]);
+
+    return result;
+}
+
+} // namespace
+
+namespace QSchemeKernels {
+
+void fill(double *data, int size, double value)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128d values = _mm_set1_pd(value);
+    for (; i + 2 <= size; i += 2)
+        _mm_storeu_pd(data + i, values);
+#endif
+
+    for (; i < size; ++i)
+        data[i] = value;
+}
+
+double sum(const double *data, int size)
+{
+    return size > 0 ? reduce<AddOp>(data, size) : 0.0;
+}
+
+double minimum(const double *data, int size)
+{
+    return reduce<MinOp>(data, size);
+}
+
+double maximum(const double *data, int size)
+{
+    return reduce<MaxOp>(data, size);
+}
+
+void add(const double *a, const double *b, double *result, int size)
+{
+    elementWise<AddOp>(a, b, result, size);
+}
+
+void subtract(const double *a, const double *b, double *result, int size)
+{
+    elementWise<SubtractOp>(a, b, result, size);
+}
+
+void multiply(const double *a, const double *b, double *result, int size)
+{
+    elementWise<MultiplyOp>(a, b, result, size);
+}
+
+quint64 byteSum(const uchar *data, int size)
+{
+    quint64 result = 0;
+    int i = 0;
+
+#ifdef __SSE2__
+    // psadbw against zero adds up each half of 16 bytes into a 64 bit lane
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(chunk, zero));
+    }
+
+    quint64 lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    result = lanes[0] + lanes[1];
+#endif
+
+    for (; i < size; ++i)
+        result += data[i];
+
+    return result;
+}
+
+int indexOf(const uchar *data, int size, uchar byte)
+{
+    // memchr is vectorized by the C library already
+    const void *found = size > 0 ? memchr(data, byte, size_t(size)) : nullptr;
+    return found ? int(static_cast<const uchar *>(found) - data) : -1;
+}
+
+} // namespace QSchemeKernels
+
+namespace {
+
+template <typename T>
+T *checked(const QSchemeValue &value, QSchemeValue::Type type, const char *name)
+{
+    if (value.type() != type) {
+        switch (type) {
+        case QSchemeValue::Type::Vector:
+            throw qt_scheme_error(name, "expected a vector");
+        case QSchemeValue::Type::Bytevector:
+            throw qt_scheme_error(name, "expected a bytevector");
+        default:
+            throw qt_scheme_error(name, "expected an f64vector");
+        }
+    }
+
+    return QSchemeValuePrivate::object<T>(value);
+}
+
+inline QSchemeVectorObject *vector(const QSchemeValue &value, const char *name)
+{
+    return checked<QSchemeVectorObject>(value, QSchemeValue::Type::Vector, name);
+}
+
+inline QSchemeBytevectorObject *bytevector(const QSchemeValue &value, const char *name)
+{
+    return checked<QSchemeBytevectorObject>(value, QSchemeValue::Type::Bytevector, name);
+}
+
+inline QSchemeF64VectorObject *f64vector(const QSchemeValue &value, const char *name)
+{
+    return checked<QSchemeF64VectorObject>(value, QSchemeValue::Type::F64Vector, name);
+}
+
+int toInt(const QSchemeValue &value, qint64 minimum, qint64 maximum, const char *name)
+{
+    if (!QSchemeValuePrivate::isFixnum(value))
+        throw qt_scheme_error(name, "expected an integer");
+
+    const qint64 i = QSchemeValuePrivate::fixnum(value);
+    if (i < minimum || i > maximum)
+        throw qt_scheme_error(name, "argument out of range");
+
+    return int(i);
+}
+
+inline int toLength(const QSchemeValue &value, const char *name)
+{
+    return toInt(value, 0, std::numeric_limits<int>::max(), name);
+}
+
+inline int toIndex(const QSchemeValue &value, int size, const char *name)
+{
+    return toInt(value, 0, qint64(size) - 1, name);
+}
+
+inline uchar toByte(const QSchemeValue &value, const char *name)
+{
+    return uchar(toInt(value, 0, 255, name));
+}
+
+// The optional start and end arguments of the copying procedures.
+void range(const QSchemeValue &arguments, int size, int *start, int *end, const char *name)
+{
+    *start = is_pair(arguments) ? toInt(car(arguments), 0, size, name) : 0;
+    *end = is_pair(arguments) && is_pair(cdr(arguments)) ? toInt(cadr(arguments), *start, size, name) : size;
+}
+
+template <typename T>
+QSchemeValue allocate(QSchemeValue::Type type, T **object)
+{
+    *object = QSchemeValuePrivate::allocate<T>(type);
+    return QSchemeValuePrivate::adopt(*object);
+}
+
+int listLength(const QSchemeValue &list, const char *name)
+{
+    int length = 0;
+    QSchemeValue it = list;
+    for (; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        ++length;
+
+    if (!is_null(it))
+        throw qt_scheme_error(name, "expected a proper list");
+
+    return length;
+}
+
+// vectors
+
+QSchemeValue vector_make(const QSchemeValue &arguments)
+{
+    const int size = toLength(car(arguments), "make-vector");
+    const QSchemeValue fill = is_pair(cdr(arguments)) ? cadr(arguments) : QSchemeValue();
+
+    QSchemeVectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::Vector, &object);
+    object->items.fill(fill, size);
+    return result;
+}
+
+QSchemeValue vector_from_list(const QSchemeValue &list, const char *name)
+{
+    QSchemeVectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::Vector, &object);
+
+    object->items.reserve(listLength(list, name));
+    for (QSchemeValue it = list; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        object->items.append(QSchemeValuePrivate::pair(it)->car);
+
+    return result;
+}
+
+QSchemeValue vector_vector(const QSchemeValue &arguments)
+{
+    return vector_from_list(arguments, "vector");
+}
+
+QSchemeValue vector_list_to_vector(const QSchemeValue &arguments)
+{
+    return vector_from_list(car(arguments), "list->vector");
+}
+
+QSchemeValue vector_vectorp(const QSchemeValue &arguments)
+{
+    return QSchemeValue(car(arguments).type() == QSchemeValue::Type::Vector);
+}
+
+QSchemeValue vector_length(const QSchemeValue &arguments)
+{
+    return QSchemeValue(vector(car(arguments), "vector-length")->items.size());
+}
+
+QSchemeValue vector_ref(const QSchemeValue &arguments)
+{
+    const QSchemeVectorObject *object = vector(car(arguments), "vector-ref");
+    return object->items.at(toIndex(cadr(arguments), object->items.size(), "vector-ref"));
+}
+
+QSchemeValue vector_set(const QSchemeValue &arguments)
+{
+    qt_scheme_check_not_parallel("vector-set!");
+    QSchemeVectorObject *object = vector(car(arguments), "vector-set!");
+    const int index = toIndex(cadr(arguments), object->items.size(), "vector-set!");
+    const QSchemeValue value = caddr(arguments);
+
+    object->items[index] = value;
+    return value;
+}
+
+QSchemeValue vector_to_list(const QSchemeValue &arguments)
+{
+    const QSchemeVectorObject *object = vector(car(arguments), "vector->list");
+
+    QSchemeValue result;
+    for (int i = object->items.size() - 1; i >= 0; --i)
+        result = cons(object->items.at(i), result);
+    return result;
+}
+
+QSchemeValue vector_fill(const QSchemeValue &arguments)
+{
+    qt_scheme_check_not_parallel("vector-fill!");
+    QSchemeVectorObject *object = vector(car(arguments), "vector-fill!");
+    object->items.fill(cadr(arguments));
+    return car(arguments);
+}
+
+QSchemeValue vector_copy(const QSchemeValue &arguments)
+{
+    const QSchemeVectorObject *source = vector(car(arguments), "vector-copy");
+
+    int start, end;
+    range(cdr(arguments), source->items.size(), &start, &end, "vector-copy");
+
+    QSchemeVectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::Vector, &object);
+    // never shared with the source: the collector visits the items of
+    // each vector, but the items of a shared buffer hold one reference
+    object->items.reserve(end - start);
+    for (int i = start; i < end; ++i)
+        object->items.append(source->items.at(i));
+    return result;
+}
+
+// bytevectors
+
+QSchemeValue bytevector_make(const QSchemeValue &arguments)
+{
+    const int size = toLength(car(arguments), "make-bytevector");
+    const uchar fill = is_pair(cdr(arguments)) ? toByte(cadr(arguments), "make-bytevector") : 0;
+
+    QSchemeBytevectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::Bytevector, &object);
+    object->bytes.fill(char(fill), size);
+    return result;
+}
+
+QSchemeValue bytevector_bytevector(const QSchemeValue &arguments)
+{
+    QSchemeBytevectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::Bytevector, &object);
+
+    object->bytes.reserve(listLength(arguments, "bytevector"));
+    for (QSchemeValue it = arguments; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        object->bytes.append(char(toByte(QSchemeValuePrivate::pair(it)->car, "bytevector")));
+
+    return result;
+}
+
+QSchemeValue bytevector_bytevectorp(const QSchemeValue &arguments)
+{
+    return QSchemeValue(car(arguments).type() == QSchemeValue::Type::Bytevector);
+}
+
+QSchemeValue bytevector_length(const QSchemeValue &arguments)
+{
+    return QSchemeValue(bytevector(car(arguments), "bytevector-length")->bytes.size());
+}
+
+QSchemeValue bytevector_u8_ref(const QSchemeValue &arguments)
+{
+    const QSchemeBytevectorObject *object = bytevector(car(arguments), "bytevector-u8-ref");
+    const int index = toIndex(cadr(arguments), object->bytes.size(), "bytevector-u8-ref");
+    return QSchemeValue(int(uchar(object->bytes.at(index))));
+}
+
+QSchemeValue bytevector_u8_set(const QSchemeValue &arguments)
+{
+    qt_scheme_check_not_parallel("bytevector-u8-set!");
+    QSchemeBytevectorObject *object = bytevector(car(arguments), "bytevector-u8-set!");
+    const int index = toIndex(cadr(arguments), object->bytes.size(), "bytevector-u8-set!");
+    object->bytes[index] = char(toByte(caddr(arguments), "bytevector-u8-set!"));
+    return caddr(arguments);
+}
+
+QSchemeValue bytevector_fill(const QSchemeValue &arguments)
+{
+    qt_scheme_check_not_parallel("bytevector-fill!");
+    QSchemeBytevectorObject *object = bytevector(car(arguments), "bytevector-fill!");
+    object->bytes.fill(char(toByte(cadr(arguments), "bytevector-fill!")));
+    return car(arguments);
+}
+
+QSchemeValue bytevector_copy(const QSchemeValue &arguments)
+{
+    const QSchemeBytevectorObject *source = bytevector(car(arguments), "bytevector-copy");
+
+    int start, end;
+    range(cdr(arguments), source->bytes.size(), &start, &end, "bytevector-copy");
+
+    QSchemeBytevectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::Bytevector, &object);
+    object->bytes = source->bytes.mid(start, end - start);
+    return result;
+}
+
+// (bytevector-index bv byte [start]) -> index or #f
+QSchemeValue bytevector_index(const QSchemeValue &arguments)
+{
+    const QSchemeBytevectorObject *object = bytevector(car(arguments), "bytevector-index");
+    const uchar byte = toByte(cadr(arguments), "bytevector-index");
+    const int size = object->bytes.size();
+    const int start = is_pair(cddr(arguments)) ? toInt(caddr(arguments), 0, size, "bytevector-index") : 0;
+
+    const uchar *data = reinterpret_cast<const uchar *>(object->bytes.constData());
+    const int index = QSchemeKernels::indexOf(data + start, size - start, byte);
+    return index < 0 ? QSchemeValue(false) : QSchemeValue(start + index);
+}
+
+QSchemeValue bytevector_sum(const QSchemeValue &arguments)
+{
+    const QSchemeBytevectorObject *object = bytevector(car(arguments), "bytevector-sum");
+    const uchar *data = reinterpret_cast<const uchar *>(object->bytes.constData());
+
+    // at most 255 * INT_MAX, which fits a fixnum
+    return QSchemeValuePrivate::fromFixnum(qint64(QSchemeKernels::byteSum(data, object->bytes.size())));
+}
+
+// f64vectors
+
+QSchemeValue f64vector_make(const QSchemeValue &arguments)
+{
+    const int size = toLength(car(arguments), "make-f64vector");
+    const double fill = is_pair(cdr(arguments)) ? QSchemeNumbers::toDouble(cadr(arguments), "make-f64vector") : 0.0;
+
+    QSchemeF64VectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::F64Vector, &object);
+    object->values.resize(size);
+    QSchemeKernels::fill(object->values.data(), size, fill);
+    return result;
+}
+
+QSchemeValue f64vector_from_list(const QSchemeValue &list, const char *name)
+{
+    QSchemeF64VectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::F64Vector, &object);
+
+    object->values.reserve(listLength(list, name));
+    for (QSchemeValue it = list; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        object->values.append(QSchemeNumbers::toDouble(QSchemeValuePrivate::pair(it)->car, name));
+
+    return result;
+}
+
+QSchemeValue f64vector_f64vector(const QSchemeValue &arguments)
+{
+    return f64vector_from_list(arguments, "f64vector");
+}
+
+QSchemeValue f64vector_list_to_f64vector(const QSchemeValue &arguments)
+{
+    return f64vector_from_list(car(arguments), "list->f64vector");
+}
+
+QSchemeValue f64vector_f64vectorp(const QSchemeValue &arguments)
+{
+    return QSchemeValue(car(arguments).type() == QSchemeValue::Type::F64Vector);
+}
+
+QSchemeValue f64vector_length(const QSchemeValue &arguments)
+{
+    return QSchemeValue(f64vector(car(arguments), "f64vector-length")->values.size());
+}
+
+QSchemeValue f64vector_ref(const QSchemeValue &arguments)
+{
+    const QSchemeF64VectorObject *object = f64vector(car(arguments), "f64vector-ref");
+    return QSchemeValue(object->values.at(toIndex(cadr(arguments), object->values.size(), "f64vector-ref")));
+}
+
+QSchemeValue f64vector_set(const QSchemeValue &arguments)
+{
+    qt_scheme_check_not_parallel("f64vector-set!");
+    QSchemeF64VectorObject *object = f64vector(car(arguments), "f64vector-set!");
+    const int index = toIndex(cadr(arguments), object->values.size(), "f64vector-set!");
+    object->values[index] = QSchemeNumbers::toDouble(caddr(arguments), "f64vector-set!");
+    return caddr(arguments);
+}
+
+QSchemeValue f64vector_to_list(const QSchemeValue &arguments)
+{
+    const QSchemeF64VectorObject *object = f64vector(car(arguments), "f64vector->list");
+
+    QSchemeValue result;
+    for (int i = object->values.size() - 1; i >= 0; --i)
+        result = cons(QSchemeValue(object->values.at(i)), result);
+    return result;
+}
+
+QSchemeValue f64vector_fill(const QSchemeValue &arguments)
+{
+    qt_scheme_check_not_parallel("f64vector-fill!");
+    QSchemeF64VectorObject *object = f64vector(car(arguments), "f64vector-fill!");
+    QSchemeKernels::fill(object->values.data(), object->values.size(),
+                         QSchemeNumbers::toDouble(cadr(arguments), "f64vector-fill!"));
+    return car(arguments);
+}
+
+QSchemeValue f64vector_copy(const QSchemeValue &arguments)
+{
+    const QSchemeF64VectorObject *source = f64vector(car(arguments), "f64vector-copy");
+
+    int start, end;
+    range(cdr(arguments), source->values.size(), &start, &end, "f64vector-copy");
+
+    QSchemeF64VectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::F64Vector, &object);
+    object->values = source->values.mid(start, end - start);
+    return result;
+}
+
+QSchemeValue f64vector_sum(const QSchemeValue &arguments)
+{
+    const QSchemeF64VectorObject *object = f64vector(car(arguments), "f64vector-sum");
+    return QSchemeValue(QSchemeKernels::sum(object->values.constData(), object->values.size()));
+}
+
+QSchemeValue f64vector_min(const QSchemeValue &arguments)
+{
+    const QSchemeF64VectorObject *object = f64vector(car(arguments), "f64vector-min");
+    if (object->values.isEmpty())
+        throw qt_scheme_error("f64vector-min", "empty vector");
+    return QSchemeValue(QSchemeKernels::minimum(object->values.constData(), object->values.size()));
+}
+
+QSchemeValue f64vector_max(const QSchemeValue &arguments)
+{
+    const QSchemeF64VectorObject *object = f64vector(car(arguments), "f64vector-max");
+    if (object->values.isEmpty())
+        throw qt_scheme_error("f64vector-max", "empty vector");
+    return QSchemeValue(QSchemeKernels::maximum(object->values.constData(), object->values.size()));
+}
+
+// (f64vector-add a b) and friends return a new vector, the operands must
+// have the same length
+template <void (*kernel)(const double *, const double *, double *, int)>
+QSchemeValue f64vector_elementwise(const QSchemeValue &arguments, const char *name)
+{
+    const QSchemeF64VectorObject *a = f64vector(car(arguments), name);
+    const QSchemeF64VectorObject *b = f64vector(cadr(arguments), name);
+
+    if (a->values.size() != b->values.size())
+        throw qt_scheme_error(name, "vectors differ in length");
+
+    QSchemeF64VectorObject *object;
+    const QSchemeValue result = allocate(QSchemeValue::Type::F64Vector, &object);
+    object->values.resize(a->values.size());
+    kernel(a->values.constData(), b->values.constData(), object->values.data(), a->values.size());
+    return result;
+}
+
+QSchemeValue f64vector_add(const QSchemeValue &arguments)
+{
+    return f64vector_elementwise<QSchemeKernels::add>(arguments, "f64vector-add");
+}
+
+QSchemeValue f64vector_subtract(const QSchemeValue &arguments)
+{
+    return f64vector_elementwise<QSchemeKernels::subtract>(arguments, "f64vector-subtract");
+}
+
+QSchemeValue f64vector_multiply(const QSchemeValue &arguments)
+{
+    return f64vector_elementwise<QSchemeKernels::multiply>(arguments, "f64vector-multiply");
+}
+
+} // namespace
+
+namespace QSchemeVectors {
+
+const QSchemeBuiltinProcedure procedures[] = {
+    { "vector", vector_vector },
+    { "make-vector", vector_make },
+    { "vector?", vector_vectorp },
+    { "vector-length", vector_length },
+    { "vector-ref", vector_ref },
+    { "vector-set!", vector_set },
+    { "vector->list", vector_to_list },
+    { "list->vector", vector_list_to_vector },
+    { "vector-fill!", vector_fill },
+    { "vector-copy", vector_copy },
+
+    { "bytevector", bytevector_bytevector },
+    { "make-bytevector", bytevector_make },
+    { "bytevector?", bytevector_bytevectorp },
+    { "bytevector-length", bytevector_length },
+    { "bytevector-u8-ref", bytevector_u8_ref },
+    { "bytevector-u8-set!", bytevector_u8_set },
+    { "bytevector-fill!", bytevector_fill },
+    { "bytevector-copy", bytevector_copy },
+    { "bytevector-index", bytevector_index },
+    { "bytevector-sum", bytevector_sum },
+
+    { "f64vector", f64vector_f64vector },
+    { "make-f64vector", f64vector_make },
+    { "f64vector?", f64vector_f64vectorp },
+    { "f64vector-length", f64vector_length },
+    { "f64vector-ref", f64vector_ref },
+    { "f64vector-set!", f64vector_set },
+    { "f64vector->list", f64vector_to_list },
+    { "list->f64vector", f64vector_list_to_f64vector },
+    { "f64vector-fill!", f64vector_fill },
+    { "f64vector-copy", f64vector_copy },
+    { "f64vector-sum", f64vector_sum },
+    { "f64vector-min", f64vector_min },
+    { "f64vector-max", f64vector_max },
+    { "f64vector-add", f64vector_add },
+    { "f64vector-subtract", f64vector_subtract },
+    { "f64vector-multiply", f64vector_multiply },
+
+    { nullptr, nullptr }
+};
+
+} // namespace QSchemeVectors
+
+QT_END_NAMESPACE
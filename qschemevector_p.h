@@ -0,0 +1,45 @@
+#ifndef QSCHEMEVECTOR_P_H
+#define QSCHEMEVECTOR_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// Bulk operations on the unboxed storage of bytevectors and f64vectors.
+//
+// Where the compiler supports it the loops use SSE2, and AVX if the CPU
+// has it at run time; other targets get plain loops. Vectorized sums add
+// in a different order than a plain loop would, so their rounding may
+// differ in the last bits. minimum() and maximum() return NaN when any
+// element is NaN.
+namespace QSchemeKernels {
+
+void fill(double *data, int size, double value);
+double sum(const double *data, int size);
+double minimum(const double *data, int size); // size > 0
+double maximum(const double *data, int size); // size > 0
+
+// result may alias either operand
+void add(const double *a, const double *b, double *result, int size);
+void subtract(const double *a, const double *b, double *result, int size);
+void multiply(const double *a, const double *b, double *result, int size);
+
+quint64 byteSum(const uchar *data, int size);
+int indexOf(const uchar *data, int size, uchar byte); // -1 if not found
+
+} // namespace QSchemeKernels
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEVECTOR_P_H
@@ -0,0 +1,642 @@
+#include "qschemevm_p.h"
+#include "qschemenumber_p.h"
+#include "qschemeprofiler_p.h"
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtSchemeFunctions;
+
+static QSchemeValue builtinOf(const QSchemeValue &head)
+{
+    // closure forms carry their syntax directly
+    if (head.type() == QSchemeValue::Type::ForeignSyntax)
+        return head;
+
+    if (QSchemeValuePrivate::isVariable(head)) {
+        const QSchemeVariableObject *variable = QSchemeValuePrivate::variable(head);
+        if (variable->depth == QSchemeVariableObject::Global)
+            return variable->value;
+    }
+
+    return QSchemeValue();
+}
+
+static int listLength(const QSchemeValue &list)
+{
+    int length = 0;
+    QSchemeValue it = list;
+    for (; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        ++length;
+
+    return is_null(it) ? length : -1;
+}
+
+QSchemeValue QSchemeCompiler::compile(const QSchemeValue &closure)
+{
+    QSchemeCodeObject *code =
+            QSchemeValuePrivate::allocate<QSchemeCodeObject>(QSchemeValue::Type(QSchemeHeap::CodeKind));
+    const QSchemeValue handle = QSchemeValuePrivate::adopt(code);
+
+    code->argnames = car(closure).toList();
+    code->slotNames = code->argnames + cadr(closure).toList();
+    code->body = caddr(closure);
+
+    QSchemeCompiler compiler(code);
+    compiler.expression(code->body, true);
+    compiler.write(QSchemeBytecode::Return);
+
+    return handle;
+}
+
+int QSchemeCompiler::constant(const QSchemeValue &value)
+{
+    const quint64 bits = QSchemeValuePrivate::bits(value);
+
+    for (int i = 0; i < code->constants.size(); ++i) {
+        if (QSchemeValuePrivate::bits(code->constants.at(i)) == bits)
+            return i;
+    }
+
+    code->constants.append(value);
+    return code->constants.size() - 1;
+}
+
+void QSchemeCompiler::expression(const QSchemeValue &exp, bool tail)
+{
+    using namespace QSchemeBytecode;
+
+    if (QSchemeValuePrivate::isVariable(exp)) {
+        const QSchemeVariableObject *variable = QSchemeValuePrivate::variable(exp);
+
+        if (variable->depth == QSchemeVariableObject::Global) {
+            write(GlobalRef);
+            write(constant(exp));
+        } else {
+            write(LocalRef);
+            write(variable->depth);
+            write(variable->slot);
+        }
+        return;
+    }
+
+    switch (exp.type()) {
+    case QSchemeValue::Type::String:
+    case QSchemeValue::Type::Number:
+    case QSchemeValue::Type::Boolean:
+    case QSchemeValue::Type::ForeignProcedure:
+    case QSchemeValue::Type::ForeignSyntax:
+    case QSchemeValue::Type::Vector:
+    case QSchemeValue::Type::Bytevector:
+    case QSchemeValue::Type::F64Vector:
+    case QSchemeValue::Type::HashTable:
+        write(Constant);
+        write(constant(exp));
+        return;
+
+    case QSchemeValue::Type::Cons:
+        if (is_null(exp)) {
+            write(Constant);
+            write(constant(exp));
+            return;
+        }
+
+        if (specialForm(exp, tail) || builtinCall(exp))
+            return;
+
+        // forms of unknown syntax keep unresolved symbols in head position
+        if (listLength(exp) >= 0 && !(is_symbol(car(exp)) && !QSchemeValuePrivate::isVariable(car(exp)))) {
+            call(exp, tail);
+            return;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    // unresolved symbols and anything unusual keep the tree walker's semantics
+    write(Evaluate);
+    write(constant(exp));
+}
+
+bool QSchemeCompiler::specialForm(const QSchemeValue &exp, bool tail)
+{
+    using namespace QSchemeBytecode;
+    using QSchemeBuiltins::Syntax;
+
+    const QSchemeValue builtin = builtinOf(car(exp));
+    if (builtin.type() != QSchemeValue::Type::ForeignSyntax)
+        return false;
+
+    const QSchemeValue args = cdr(exp);
+    const int argc = listLength(args);
+
+    switch (QSchemeBuiltins::classify(builtin.toForeignSyntax())) {
+    case Syntax::Quote:
+        if (argc < 1)
+            break;
+
+        write(Constant);
+        write(constant(car(args)));
+        return true;
+
+    case Syntax::Closure:
+        write(MakeClosure);
+        write(constant(compile(args)));
+        return true;
+
+    case Syntax::Define: {
+        if (argc < 2)
+            break;
+
+        const quint64 target = QSchemeValuePrivate::bits(car(args));
+        int slot = code->slotNames.size() - 1;
+        while (slot >= 0 && QSchemeValuePrivate::bits(code->slotNames.at(slot)) != target)
+            --slot;
+
+        if (slot < 0)
+            break;
+
+        expression(cadr(args), false);
+        write(DefineLocal);
+        write(slot);
+        return true;
+    }
+
+    case Syntax::If: {
+        if (argc < 3)
+            break;
+
+        expression(car(args), false);
+        write(JumpIfFalse);
+        const int elseJump = position();
+        write(0);
+
+        expression(cadr(args), tail);
+
+        int endJump = -1;
+        if (tail) {
+            write(Return);
+        } else {
+            write(Jump);
+            endJump = position();
+            write(0);
+        }
+
+        code->instructions[elseJump] = position();
+        expression(caddr(args), tail);
+
+        if (endJump >= 0)
+            code->instructions[endJump] = position();
+        return true;
+    }
+
+    case Syntax::Apply:
+        if (argc != 2)
+            break;
+
+        expression(car(args), false);
+        expression(cadr(args), false);
+        write(tail ? TailApply : Apply);
+        return true;
+
+    default:
+        break;
+    }
+
+    write(Evaluate);
+    write(constant(exp));
+    return true;
+}
+
+// Calls of car, cdr, cons, eq? and of the binary arithmetic and comparison
+// builtins are run inline for as long as the variable they are called
+// through still holds the builtin.
+bool QSchemeCompiler::builtinCall(const QSchemeValue &exp)
+{
+    using namespace QSchemeBytecode;
+    using QSchemeBuiltins::Procedure;
+
+    const QSchemeValue head = car(exp);
+    const QSchemeValue builtin = builtinOf(head);
+
+    if (!QSchemeValuePrivate::isVariable(head) || builtin.type() != QSchemeValue::Type::ForeignProcedure)
+        return false;
+
+    const Procedure procedure = QSchemeBuiltins::classify(builtin.toForeignProcedure());
+    const int argc = listLength(cdr(exp));
+
+    switch (procedure) {
+    case Procedure::Car:
+    case Procedure::Cdr:
+        if (argc != 1)
+            return false;
+        break;
+    case Procedure::Cons:
+    case Procedure::Eq:
+    case Procedure::Add:
+    case Procedure::Subtract:
+    case Procedure::Multiply:
+    case Procedure::NumberEqual:
+    case Procedure::Less:
+    case Procedure::Greater:
+    case Procedure::LessEqual:
+    case Procedure::GreaterEqual:
+        if (argc != 2)
+            return false;
+        break;
+    case Procedure::Other:
+        return false;
+    }
+
+    for (QSchemeValue it = cdr(exp); is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr)
+        expression(QSchemeValuePrivate::pair(it)->car, false);
+
+    write(CallBuiltin);
+    write(constant(head));
+    write(constant(builtin));
+    write(qint32(procedure));
+    write(argc);
+    return true;
+}
+
+void QSchemeCompiler::call(const QSchemeValue &exp, bool tail)
+{
+    using namespace QSchemeBytecode;
+
+    int argc = -1;
+    for (QSchemeValue it = exp; is_pair(it); it = QSchemeValuePrivate::pair(it)->cdr, ++argc)
+        expression(QSchemeValuePrivate::pair(it)->car, false);
+
+    write(tail ? TailCall : Call);
+    write(argc);
+}
+
+namespace {
+
+struct Activation
+{
+    QSchemeValue code;
+    QSchemeValue frame;
+    int pc;
+};
+
+// Nested calls count towards the recursion limit like nested evaluations
+// do. Whichever way execute() is left, the depth is reset to where it was.
+struct DepthRestorer
+{
+    const int depth;
+    ~DepthRestorer() { qt_scheme_recursion_depth = depth; }
+};
+
+// The same for the calls the profiler has seen.
+struct ProfileRestorer
+{
+    const int depth;
+    ~ProfileRestorer()
+    {
+        if (Q_UNLIKELY(qt_scheme_profiling))
+            QSchemeProfiler::unwind(depth);
+    }
+};
+
+} // namespace
+
+QSchemeValue QSchemeVirtualMachine::makeProcedure(const QSchemeValue &code, const QSchemeValue &environment)
+{
+    const QSchemeCodeObject *codeObject = QSchemeValuePrivate::object<QSchemeCodeObject>(code);
+
+    QSchemeLambdaObject *lambda =
+            QSchemeValuePrivate::allocate<QSchemeLambdaObject>(QSchemeValue::Type::LambdaProcedure);
+    const QSchemeValue handle = QSchemeValuePrivate::adopt(lambda);
+
+    lambda->argnames = codeObject->argnames;
+    lambda->slotNames = codeObject->slotNames;
+    lambda->body = codeObject->body;
+    lambda->environment = environment;
+    lambda->code = code;
+
+    return handle;
+}
+
+static QSchemeValue applyProcedure(const QSchemeValue &frame, const QSchemeValue &procedure,
+                                   const QSchemeValue &arguments)
+{
+    QSchemeEnvironment env(QSchemeValuePrivate::environment(frame));
+    return env.apply(procedure, arguments);
+}
+
+// Replace the two topmost values of the stack by the result of a binary
+// builtin applied to them.
+template <typename Stack, typename Operation>
+static inline void binaryArithmetic(Stack &stack, Operation operation)
+{
+    QSchemeValue result = operation(stack[stack.size() - 2], stack.last());
+    stack.removeLast();
+    stack.last() = std::move(result);
+}
+
+template <typename Stack>
+static inline void binaryComparison(Stack &stack, QSchemeNumbers::Comparison comparison)
+{
+    const bool result = QSchemeNumbers::compare(stack[stack.size() - 2], stack.last(), comparison);
+    stack.removeLast();
+    stack.last() = QSchemeValue(result);
+}
+
+template <typename Stack>
+static QSchemeValue popArguments(Stack &stack, int argc)
+{
+    QSchemeValue arguments;
+    for (int i = 0; i < argc; ++i) {
+        arguments = cons(stack.last(), arguments);
+        stack.removeLast();
+    }
+
+    return arguments;
+}
+
+static inline bool isCompiledProcedure(const QSchemeValue &value)
+{
+    return QSchemeValuePrivate::isObject(value, QSchemeValue::Type::LambdaProcedure)
+            && !is_null(QSchemeValuePrivate::object<QSchemeLambdaObject>(value)->code);
+}
+
+static inline bool canReuseFrame(const QSchemeLambdaObject *callee, const QSchemeValue &code,
+                                 const QSchemeValue &frame, int argc)
+{
+    const QSchemeEnvironmentPrivate *env = QSchemeValuePrivate::environment(frame);
+
+    return QSchemeValuePrivate::bits(callee->code) == QSchemeValuePrivate::bits(code)
+            && QSchemeValuePrivate::bits(callee->environment) == QSchemeValuePrivate::bits(env->outer)
+            && env->ref.load() == 1 && env->symtab.isEmpty() && argc == callee->argnames.size();
+}
+
+QSchemeValue QSchemeVirtualMachine::execute(const QSchemeLambdaObject *lambda, const QSchemeValue &arguments)
+{
+    using namespace QSchemeBytecode;
+
+    const DepthRestorer restorer = { qt_scheme_recursion_depth };
+    QSchemeRecursionGuard::enter();
+
+    const ProfileRestorer profileRestorer = { Q_UNLIKELY(qt_scheme_profiling) ? QSchemeProfiler::depth() : 0 };
+    if (Q_UNLIKELY(qt_scheme_profiling))
+        QSchemeProfiler::enter(lambda);
+
+    QVarLengthArray<QSchemeValue, 64> stack;
+    QVector<Activation> activations;
+
+    QSchemeValue code = lambda->code;
+    QSchemeValue frame;
+    QSchemeEnvironmentPrivate *env = QSchemeEnvironmentPrivate::makeFrame(lambda, arguments, frame);
+
+    const QSchemeCodeObject *codeObject = QSchemeValuePrivate::object<QSchemeCodeObject>(code);
+    const qint32 *instructions = codeObject->instructions.constData();
+    const QSchemeValue *constants = codeObject->constants.constData();
+    const qint32 *pc = instructions;
+
+    const auto enter = [&](const QSchemeValue &procedure, QSchemeValue &&newFrame) {
+        code = QSchemeValuePrivate::object<QSchemeLambdaObject>(procedure)->code;
+        frame = std::move(newFrame);
+        env = QSchemeValuePrivate::environment(frame);
+
+        codeObject = QSchemeValuePrivate::object<QSchemeCodeObject>(code);
+        instructions = codeObject->instructions.constData();
+        constants = codeObject->constants.constData();
+        pc = instructions;
+    };
+
+    forever {
+        const qint32 opcode = *pc++;
+
+        switch (opcode) {
+        case Constant:
+            stack.append(constants[*pc++]);
+            break;
+
+        case LocalRef: {
+            QSchemeEnvironmentPrivate *d = env;
+            for (int depth = *pc++; depth > 0; --depth)
+                d = QSchemeValuePrivate::environment(d->outer);
+
+            const int slot = *pc++;
+            const QSchemeValue &value = d->slotValues.at(slot);
+            if (Q_UNLIKELY(QSchemeValuePrivate::isUnbound(value)))
+                throw QSchemeUndefinedSymbolException(d->slotNames.at(slot).toSymbol());
+
+            stack.append(value);
+        }
+            break;
+
+        case GlobalRef: {
+            const QSchemeVariableObject *cell = QSchemeValuePrivate::variable(constants[*pc++]);
+            if (Q_UNLIKELY(QSchemeValuePrivate::isUnbound(cell->value)))
+                throw QSchemeUndefinedSymbolException(cell->name.toSymbol());
+
+            stack.append(cell->value);
+        }
+            break;
+
+        case DefineLocal: {
+            const int slot = *pc++;
+            if (Q_UNLIKELY(qt_scheme_profiling))
+                QSchemeProfiler::name(stack.last(), env->slotNames.at(slot));
+            env->slotValues[slot] = stack.last();
+        }
+            break;
+
+        case Jump:
+            pc = instructions + *pc;
+            break;
+
+        case JumpIfFalse: {
+            const qint32 target = *pc++;
+            const bool condition = is_true(stack.last());
+            stack.removeLast();
+
+            if (!condition)
+                pc = instructions + target;
+        }
+            break;
+
+        case MakeClosure:
+            stack.append(makeProcedure(constants[*pc++], frame));
+            break;
+
+        case Call:
+        case TailCall: {
+            const int argc = *pc++;
+            const int base = stack.size() - argc - 1;
+            QSchemeValue procedure = std::move(stack[base]);
+
+            if (!isCompiledProcedure(procedure)) {
+                const QSchemeValue args = popArguments(stack, argc);
+                stack.last() = applyProcedure(frame, procedure, args);
+                break;
+            }
+
+            const QSchemeLambdaObject *callee = QSchemeValuePrivate::object<QSchemeLambdaObject>(procedure);
+
+            if (Q_UNLIKELY(qt_scheme_profiling)) {
+                if (opcode == Call)
+                    QSchemeProfiler::enter(callee);
+                else
+                    QSchemeProfiler::replace(callee);
+            }
+
+            // a loop: nothing else can see the current frame, so refill it
+            if (opcode == TailCall && canReuseFrame(callee, code, frame, argc)) {
+                for (int i = 0; i < argc; ++i)
+                    env->slotValues[i] = std::move(stack[base + 1 + i]);
+                for (int i = argc; i < env->slotValues.size(); ++i)
+                    env->slotValues[i] = QSchemeValuePrivate::unbound();
+
+                stack.resize(base);
+                pc = instructions;
+                break;
+            }
+
+            QSchemeValue newFrame;
+            QSchemeEnvironmentPrivate::makeFrame(callee, stack.data() + base + 1, argc, newFrame);
+            stack.resize(base);
+
+            if (opcode == Call) {
+                QSchemeRecursionGuard::enter();
+                activations.append(Activation{ std::move(code), std::move(frame), int(pc - instructions) });
+            }
+
+            enter(procedure, std::move(newFrame));
+        }
+            break;
+
+        case Apply:
+        case TailApply: {
+            const QSchemeValue args = stack.last();
+            stack.removeLast();
+            const QSchemeValue procedure = stack.last();
+            stack.removeLast();
+
+            if (!isCompiledProcedure(procedure)) {
+                stack.append(applyProcedure(frame, procedure, args));
+                break;
+            }
+
+            const QSchemeLambdaObject *callee = QSchemeValuePrivate::object<QSchemeLambdaObject>(procedure);
+            if (Q_UNLIKELY(qt_scheme_profiling)) {
+                if (opcode == Apply)
+                    QSchemeProfiler::enter(callee);
+                else
+                    QSchemeProfiler::replace(callee);
+            }
+
+            QSchemeValue newFrame;
+            QSchemeEnvironmentPrivate::makeFrame(callee, args, newFrame);
+
+            if (opcode == Apply) {
+                QSchemeRecursionGuard::enter();
+                activations.append(Activation{ std::move(code), std::move(frame), int(pc - instructions) });
+            }
+
+            enter(procedure, std::move(newFrame));
+        }
+            break;
+
+        case CallBuiltin: {
+            const QSchemeVariableObject *cell = QSchemeValuePrivate::variable(constants[pc[0]]);
+            const QSchemeValue &builtin = constants[pc[1]];
+            const auto procedure = QSchemeBuiltins::Procedure(pc[2]);
+            const int argc = pc[3];
+            pc += 4;
+
+            if (Q_UNLIKELY(QSchemeValuePrivate::bits(cell->value) != QSchemeValuePrivate::bits(builtin))) {
+                if (QSchemeValuePrivate::isUnbound(cell->value))
+                    throw QSchemeUndefinedSymbolException(cell->name.toSymbol());
+
+                const QSchemeValue args = popArguments(stack, argc);
+                stack.append(applyProcedure(frame, cell->value, args));
+                break;
+            }
+
+            switch (procedure) {
+            case QSchemeBuiltins::Procedure::Car:
+                stack.last() = car(stack.last());
+                break;
+            case QSchemeBuiltins::Procedure::Cdr:
+                stack.last() = cdr(stack.last());
+                break;
+            case QSchemeBuiltins::Procedure::Cons: {
+                const QSchemeValue pair = cons(stack[stack.size() - 2], stack.last());
+                stack.removeLast();
+                stack.last() = pair;
+            }
+                break;
+            case QSchemeBuiltins::Procedure::Eq: {
+                const bool equal = stack[stack.size() - 2] == stack.last();
+                stack.removeLast();
+                stack.last() = QSchemeValue(equal);
+            }
+                break;
+            case QSchemeBuiltins::Procedure::Add:
+                binaryArithmetic(stack, QSchemeNumbers::add);
+                break;
+            case QSchemeBuiltins::Procedure::Subtract:
+                binaryArithmetic(stack, QSchemeNumbers::subtract);
+                break;
+            case QSchemeBuiltins::Procedure::Multiply:
+                binaryArithmetic(stack, QSchemeNumbers::multiply);
+                break;
+            case QSchemeBuiltins::Procedure::NumberEqual:
+                binaryComparison(stack, QSchemeNumbers::Comparison::Equal);
+                break;
+            case QSchemeBuiltins::Procedure::Less:
+                binaryComparison(stack, QSchemeNumbers::Comparison::Less);
+                break;
+            case QSchemeBuiltins::Procedure::Greater:
+                binaryComparison(stack, QSchemeNumbers::Comparison::Greater);
+                break;
+            case QSchemeBuiltins::Procedure::LessEqual:
+                binaryComparison(stack, QSchemeNumbers::Comparison::LessEqual);
+                break;
+            case QSchemeBuiltins::Procedure::GreaterEqual:
+                binaryComparison(stack, QSchemeNumbers::Comparison::GreaterEqual);
+                break;
+            case QSchemeBuiltins::Procedure::Other:
+                Q_UNREACHABLE();
+            }
+        }
+            break;
+
+        case Evaluate: {
+            QSchemeEnvironment environment(env);
+            stack.append(environment.eval(constants[*pc++]));
+        }
+            break;
+
+        case Return: {
+            if (activations.isEmpty())
+                return stack.last();
+
+            Activation caller = activations.takeLast();
+            --qt_scheme_recursion_depth;
+
+            if (Q_UNLIKELY(qt_scheme_profiling))
+                QSchemeProfiler::leave();
+
+            code = std::move(caller.code);
+            frame = std::move(caller.frame);
+            env = QSchemeValuePrivate::environment(frame);
+
+            codeObject = QSchemeValuePrivate::object<QSchemeCodeObject>(code);
+            instructions = codeObject->instructions.constData();
+            constants = codeObject->constants.constData();
+            pc = instructions + caller.pc;
+        }
+            break;
+
+        default:
+            Q_UNREACHABLE();
+        }
+    }
+}
+
+QT_END_NAMESPACE
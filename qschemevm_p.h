@@ -0,0 +1,78 @@
+#ifndef QSCHEMEVM_P_H
+#define QSCHEMEVM_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtScheme API. It exists purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qscheme_p.h"
+
+QT_BEGIN_NAMESPACE
+
+// Instructions of a QSchemeCodeObject. Operands follow the opcode in the
+// instruction stream, jump targets are absolute instruction indices.
+namespace QSchemeBytecode {
+
+enum Opcode : qint32 {
+    Constant,       // k                push constants[k]
+    LocalRef,       // depth slot       push a local variable
+    GlobalRef,      // k                push the value of the cell constants[k]
+    DefineLocal,    // slot             define a local of the current frame, keeps the value
+    Jump,           // target
+    JumpIfFalse,    // target           pops the condition
+    MakeClosure,    // k                push a procedure for the code constants[k]
+    Call,           // argc             (fn args...) -> result
+    TailCall,       // argc
+    Apply,          //                  (fn list) -> result
+    TailApply,
+    CallBuiltin,    // cell builtin procedure argc
+                    //                  (args...) -> result, inline while constants[cell] holds constants[builtin]
+    Evaluate,       // k                run constants[k] through the tree walker
+    Return
+};
+
+} // namespace QSchemeBytecode
+
+// Compiles the analyzed lambda bodies produced by QSchemeAnalyzer. Forms the
+// compiler has no instructions for are left to the tree walker.
+class QSchemeCompiler
+{
+public:
+    // (params locals analyzed-body) -> QSchemeCodeObject
+    static QSchemeValue compile(const QSchemeValue &closure);
+
+private:
+    explicit QSchemeCompiler(QSchemeCodeObject *code) : code(code) {}
+
+    void expression(const QSchemeValue &exp, bool tail);
+    bool specialForm(const QSchemeValue &exp, bool tail);
+    bool builtinCall(const QSchemeValue &exp);
+    void call(const QSchemeValue &exp, bool tail);
+
+    int constant(const QSchemeValue &value);
+    void write(qint32 word) { code->instructions.append(word); }
+    int position() const { return code->instructions.size(); }
+
+    QSchemeCodeObject *code;
+};
+
+// Runs compiled procedures. Calls between compiled procedures do not use
+// the native stack, only calls into foreign procedures and the tree walker
+// do.
+class QSchemeVirtualMachine
+{
+public:
+    static QSchemeValue makeProcedure(const QSchemeValue &code, const QSchemeValue &environment);
+    static QSchemeValue execute(const QSchemeLambdaObject *lambda, const QSchemeValue &arguments);
+};
+
+QT_END_NAMESPACE
+
+#endif // QSCHEMEVM_P_H
@@ -77,6 +77,7 @@
 (ls "/")
 
 (map-list (list car cdr) (list (list 1 2 3) (list 4 5 6)))
+(map (list car cdr) (list (list 1 2 3) (list 4 5 6)))
 
 
 (define fn-list '(car cdr ls))
@@ -106,3 +107,166 @@
 (define (list-apply elems) (apply (car elems) (cdr elems)))
 (list-apply (list car '(1 2 3)))
 (list-apply (list cdr '(1 2 3)))
+
+(cons 1 2)
+(cons 1 '(2 3))
+'(1 2 . 3)
+(cdr '(a . b))
+(car (cdr '(1 . (2 . ()))))
+
+(define (make-self-referencing)
+    (define self (lambda () self))
+    self)
+(make-self-referencing)
+(collect-garbage)
+
+(define (shadow-builtins car cdr) (cons cdr car))
+(shadow-builtins 1 2)
+(car (shadow-builtins 1 2))
+
+(define (make-pair-with n) (lambda (x) (cons n x)))
+((make-pair-with 1) 2)
+(define (nested-scopes a) ((lambda (b) ((lambda (c) (list a b c)) 'c)) 'b))
+(nested-scopes 'a)
+(define (forward-reference) (defined-later 5))
+(define (defined-later x) (list 'later x))
+(forward-reference)
+
+(define (tail-reverse-onto L acc) (if (null? L) acc (tail-reverse-onto (cdr L) (cons (car L) acc))))
+(define (tail-double L) (tail-reverse-onto L L))
+(define (tail-walk L) (if (null? L) 'done (tail-walk (cdr L))))
+(tail-walk (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double (tail-double '(1 2))))))))))))))))))
+
+(define (call-with-first f L) (f (car L)))
+(call-with-first (lambda (x) (cons x x)) '(1 2))
+(define (last-element L) (if (null? (cdr L)) (car L) (last-element (cdr L))))
+(last-element '(1 2 3))
+(define (capture-then-loop n f) (if (eq? n 'stop) (f) (capture-then-loop 'stop (lambda () n))))
+(capture-then-loop 'go (lambda () 'none))
+
+'(1 -2 +3 .5 1e3 2147483648 - a1 1a) ; numbers and symbols that look like them
+"escaped \"quote\""
+
+(+ 1 2 3)
+(- 10 4 3)
+(- 5)
+(* 6 7)
+(/ 12 4)
+(/ 1 3)
+(* 140737488355327 2) ; overflows fixnums, becomes a double
+(< 1 2 3)
+(>= 3 3 4)
+(= 1 1.0)
+(quotient 17 5)
+(remainder -17 5)
+(modulo -17 5)
+(max 1 5 3)
+(integer? 4.0)
+(integer? 4.5)
+(integer? (* 1e308 10))
+(integer? (- (* 1e308 10)))
+(define (count-down n) (if (zero? n) 'done (count-down (- n 1))))
+(count-down 100000)
+
+(define v (make-vector 3 'x))
+(vector-set! v 1 'y)
+(vector->list v)
+(vector-ref (list->vector '(a b c)) 2)
+(define kept (list 'kept))
+(define (make-copied-cycle)
+    (define v (vector kept (lambda () c)))
+    (define c (vector-copy v))
+    'done)
+(make-copied-cycle)
+(collect-garbage)
+(car kept)
+(define bv (bytevector 1 2 3 250 5 6 7 8 9 10 11 12 13 14 15 16 17))
+(bytevector-sum bv)
+(bytevector-index bv 250)
+(bytevector-u8-ref (bytevector-copy bv 3) 0)
+(define fv (list->f64vector '(1 2 3 4 5 6 7 8 9)))
+(f64vector-sum fv)
+(f64vector-min fv)
+(f64vector-max fv)
+(define nan (- (* 1e308 10) (* 1e308 10)))
+(f64vector-min (f64vector 1 nan))
+(f64vector-max (f64vector nan 1))
+(f64vector-min (list->f64vector (list 1 2 3 4 5 nan 7 8 9)))
+(f64vector->list (f64vector-multiply fv (make-f64vector 9 2)))
+
+(define h (make-hash-table))
+(hash-set! h "one" 1)
+(hash-set! h '(a b) 2)
+(hash-ref h "one")
+(hash-ref h (list 'a 'b))
+(hash-ref h 'missing 'none)
+(hash-update! h "one" (lambda (n) (+ n 10)))
+(hash-update! h 'count (lambda (n) (+ n 1)) 0)
+(hash-remove! h '(a b))
+(hash-count h)
+(define ids (list->hash-table (list (cons 'x 1) (cons 'y 2) (cons 'x 3)) 'eq))
+(hash-ref ids 'x)
+(hash-contains? ids 'z)
+
+(append '(1 2) '(3) '() '(4 5))
+(reverse '(1 2 3))
+(map + '(1 2 3) '(10 20 30 40))
+(for-each car '((1) (2)))
+(filter (lambda (x) (< x 3)) '(1 5 2 4))
+(fold-left - 0 '(1 2 3))
+(fold-right cons '() '(1 2 3))
+(length long-list)
+(list-ref '(a b c) 1)
+(member 2 '(1 2 3))
+(assoc "b" (list (cons "a" 1) (cons "b" 2)))
+(sort (list (cons 2 'a) (cons 1 'b) (cons 2 'c)) (lambda (x y) (< (car x) (car y))))
+(length (map (lambda (x) (* x x)) (vector->list (make-vector 50000 3))))
+
+(parallel-map (lambda (x) (* x x)) '(1 2 3 4 5 6 7 8))
+(parallel-map + '(1 2 3) '(10 20 30))
+(length (parallel-map (lambda (x) (fold-left + 0 x)) (map (lambda (n) (list n n n)) (vector->list (make-vector 10000 1)))))
+(parallel-for-each car '((1) (2)))
+
+(define echo (process-spawn (list "echo" "spawned")))
+(process-wait echo)
+(define echo-lines (process-spawn (list "printf" "a\nb\n") (lambda (line stream) (print line stream))))
+(process-wait-any (list echo-lines))
+
+(build-state-file "/tmp/qscheme-build-test.state")
+(build-target "greeting" '() '("/tmp/qscheme-build-greeting.txt") '("sh" "-c" "echo hello > /tmp/qscheme-build-greeting.txt"))
+(build-target "copy" '("/tmp/qscheme-build-greeting.txt") '("/tmp/qscheme-build-copy.txt") '("cp" "/tmp/qscheme-build-greeting.txt" "/tmp/qscheme-build-copy.txt"))
+(build-target "report" '() '() (lambda () (print "built")) '("copy"))
+(build "report")
+(build "copy")
+
+(file-exists? "tests.scm")
+(file-exists? "no-such-file")
+(file-mtime "no-such-file")
+(> (file-mtime "tests.scm") 0)
+(member "tests.scm" (directory-list "."))
+(glob "*.scm")
+(glob "qscheme*.h" "qtscheme*.h")
+(length (glob "**/*.pro"))
+
+(write-file-if-changed "/tmp/qscheme-output-test.txt" "generated " 1)
+(write-file-if-changed "/tmp/qscheme-output-test.txt" "generated " 1)
+(define generated (output-file "/tmp/qscheme-output-test.txt"))
+(output-write generated "generated " 2)
+(output-commit generated)
+(define batch-a (output-file "/tmp/qscheme-output-a.txt"))
+(define batch-b (output-file "/tmp/qscheme-output-b.txt"))
+(output-write batch-a '(a list))
+(output-write batch-b "text")
+(output-commit-all)
+
+(length (runtime-stats))
+(assoc (quote pairs) (runtime-stats))
+
+(define (nest n acc) (if (= n 0) acc (nest (- n 1) (list acc))))
+(printable-string (nest 10000 '()) 24)
+(string? (printable-string (nest 10000 '())))
+(printable-string (list 1 '(2 (3 (4))) (vector 5 '(6))) -1 2)
+(printable-string '(a . b))
+(define cyclic (vector 1 2))
+(vector-set! cyclic 1 (list cyclic))
+cyclic
@@ -0,0 +1,8 @@
+TARGET = tst_image
+CONFIG += c++14 testcase
+QT = core testlib
+
+include(../../qscheme.pri)
+
+SOURCES += \
+    tst_image.cpp
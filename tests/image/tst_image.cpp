@@ -0,0 +1,108 @@
+#include <QtTest>
+#include "qscheme.h"
+
+// Saving environments to images and restoring them, including images that
+// were damaged on disk.
+class tst_Image : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void roundTrip();
+    void damagedVariable_data();
+    void damagedVariable();
+
+private:
+    QByteArray savedImage();
+
+    QTemporaryDir m_dir;
+};
+
+static const QByteArray Key = QByteArrayLiteral("tst_image");
+
+static const char *const Definitions[] = {
+    "(define (adder n) (lambda (x) (+ x n)))",
+    "(define add2 (adder 2))"
+};
+
+void tst_Image::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+}
+
+QByteArray tst_Image::savedImage()
+{
+    QSchemeEnvironment environment;
+    for (const char *definition : Definitions)
+        environment.eval(environment.parse(QLatin1String(definition)));
+
+    const QString path = m_dir.filePath(QStringLiteral("saved.img"));
+    if (!environment.saveImage(path, Key))
+        return QByteArray();
+
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+void tst_Image::roundTrip()
+{
+    const QByteArray image = savedImage();
+    QVERIFY(!image.isEmpty());
+
+    QSchemeEnvironment environment;
+    QVERIFY(environment.restoreImage(m_dir.filePath(QStringLiteral("saved.img")), Key));
+    QCOMPARE(environment.eval(environment.parse(QStringLiteral("(add2 3)"))), QSchemeValue(5));
+}
+
+void tst_Image::damagedVariable_data()
+{
+    QTest::addColumn<qint32>("depth");
+    QTest::addColumn<qint32>("slot");
+
+    QTest::newRow("depth past the frames") << 5 << 0;
+    QTest::newRow("slot past the frame") << 1 << 3;
+}
+
+// n in the body of the lambda made by adder is a local one frame out, its
+// cell is stored as a symbol, then depth and slot as big endian qint32. Any
+// other depth or slot must make the restore fail rather than run off the
+// frames when add2 is called.
+void tst_Image::damagedVariable()
+{
+    QFETCH(qint32, depth);
+    QFETCH(qint32, slot);
+
+    QByteArray image = savedImage();
+    QVERIFY(!image.isEmpty());
+
+    static const char original[] = { 0, 0, 0, 1, 0, 0, 0, 0 };
+    const QByteArray pattern(original, sizeof(original));
+
+    int patched = 0;
+    for (int i = image.indexOf(pattern); i >= 0; i = image.indexOf(pattern, i + 1)) {
+        if (i < 5 || image.at(i - 5) != 6) // SymbolValue, quint32 symbol
+            continue;
+
+        qToBigEndian(depth, reinterpret_cast<uchar *>(image.data() + i));
+        qToBigEndian(slot, reinterpret_cast<uchar *>(image.data() + i + 4));
+        ++patched;
+    }
+    QVERIFY(patched > 0);
+
+    const QString path = m_dir.filePath(QStringLiteral("damaged.img"));
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(file.write(image), qint64(image.size()));
+    file.close();
+
+    QSchemeEnvironment environment;
+    QVERIFY(!environment.restoreImage(path, Key));
+    QVERIFY_EXCEPTION_THROWN(environment.eval(environment.parse(QStringLiteral("add2"))),
+                             QSchemeUndefinedSymbolException);
+}
+
+QTEST_GUILESS_MAIN(tst_Image)
+
+#include "tst_image.moc"
@@ -0,0 +1,8 @@
+TARGET = tst_parallel
+CONFIG += c++14 testcase
+QT = core testlib
+
+include(../../qscheme.pri)
+
+SOURCES += \
+    tst_parallel.cpp
@@ -0,0 +1,82 @@
+#include <QtTest>
+#include "qscheme.h"
+
+// Parallel code may read shared data but not modify it.
+class tst_Parallel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void modifySharedData_data();
+    void modifySharedData();
+    void modifyAfterwards();
+};
+
+static const char *const Definitions[] = {
+    "(define v (make-vector 4 0))",
+    "(define bv (make-bytevector 4 0))",
+    "(define fv (make-f64vector 4 0))",
+    "(define table (make-hash-table 'equal))",
+    "(hash-set! table 'x 1)"
+};
+
+static void define(QSchemeEnvironment &environment)
+{
+    for (const char *definition : Definitions)
+        environment.eval(environment.parse(QLatin1String(definition)));
+}
+
+void tst_Parallel::modifySharedData_data()
+{
+    QTest::addColumn<QString>("body");
+    QTest::addColumn<QString>("name");
+
+    QTest::newRow("vector-set!") << QStringLiteral("(vector-set! v 0 x)") << QStringLiteral("vector-set!");
+    QTest::newRow("vector-fill!") << QStringLiteral("(vector-fill! v x)") << QStringLiteral("vector-fill!");
+    QTest::newRow("bytevector-u8-set!") << QStringLiteral("(bytevector-u8-set! bv 0 x)")
+                                        << QStringLiteral("bytevector-u8-set!");
+    QTest::newRow("bytevector-fill!") << QStringLiteral("(bytevector-fill! bv x)")
+                                      << QStringLiteral("bytevector-fill!");
+    QTest::newRow("f64vector-set!") << QStringLiteral("(f64vector-set! fv 0 x)") << QStringLiteral("f64vector-set!");
+    QTest::newRow("f64vector-fill!") << QStringLiteral("(f64vector-fill! fv x)") << QStringLiteral("f64vector-fill!");
+    QTest::newRow("hash-set!") << QStringLiteral("(hash-set! table x x)") << QStringLiteral("hash-set!");
+    QTest::newRow("hash-update!") << QStringLiteral("(hash-update! table 'x (lambda (n) (+ n x)))")
+                                  << QStringLiteral("hash-update!");
+    QTest::newRow("hash-remove!") << QStringLiteral("(hash-remove! table 'x)") << QStringLiteral("hash-remove!");
+}
+
+// Every item runs on the pool, there are more items than one thread takes.
+void tst_Parallel::modifySharedData()
+{
+    QFETCH(QString, body);
+    QFETCH(QString, name);
+
+    QSchemeEnvironment environment;
+    define(environment);
+
+    const QSchemeValue exp = environment.parse(QStringLiteral("(parallel-for-each (lambda (x) %1) '(1 2 3 4 5 6 7 8))")
+                                               .arg(body));
+
+    QString message;
+    try {
+        environment.eval(exp);
+    } catch (const QSchemeException &exception) {
+        message = QString::fromUtf8(exception.what());
+    }
+
+    QCOMPARE(message, name + QLatin1String(": cannot modify shared data in parallel code"));
+}
+
+void tst_Parallel::modifyAfterwards()
+{
+    QSchemeEnvironment environment;
+    define(environment);
+
+    environment.eval(environment.parse(QStringLiteral("(parallel-map (lambda (x) (vector-ref v 0)) '(1 2 3 4))")));
+    environment.eval(environment.parse(QStringLiteral("(vector-set! v 0 5)")));
+    QCOMPARE(environment.eval(environment.parse(QStringLiteral("(vector-ref v 0)"))), QSchemeValue(5));
+}
+
+QTEST_GUILESS_MAIN(tst_Parallel)
+
+#include "tst_parallel.moc"